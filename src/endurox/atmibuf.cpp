@@ -113,7 +113,25 @@ void atmibuf::reinit(const char *type, const char *subtype, long len_)
          * used for recursive buffer processing
          */
         UBFH *fbfr = reinterpret_cast<UBFH *>(*pp);
-        Binit(fbfr, Bsizeof(fbfr));
+        long cur = Bsizeof(fbfr);
+
+        /* grow to requested size, so that buffer is not regrown field by field */
+        if (cur < len_)
+        {
+            char *np = tprealloc(*pp, len_);
+
+            if (nullptr==np)
+            {
+                NDRX_LOG(log_error, "Failed to realloc: %s", tpstrerror(tperrno));
+                throw atmi_exception(tperrno);
+            }
+            *pp = np;
+            fbfr = reinterpret_cast<UBFH *>(*pp);
+            cur = len_;
+        }
+
+        len = cur;
+        Binit(fbfr, cur);
     }
 }
 
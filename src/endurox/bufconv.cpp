@@ -58,61 +58,228 @@
 /*---------------------------Enums--------------------------------------*/
 /*---------------------------Typedefs-----------------------------------*/
 /*---------------------------Globals------------------------------------*/
+
+/** STRING field encoding, see NDRXPY_STRENC_* */
+expublic int G_ndrxpy_strenc = NDRXPY_STRENC_UTF8;
+
 /*---------------------------Statics------------------------------------*/
+
+/** per call encoding override, EXFAIL if not set */
+static thread_local int M_strenc_call = EXFAIL;
+
 /*---------------------------Prototypes---------------------------------*/
 namespace py = pybind11;
 
 /**
- * @brief This will add all ATMI related stuff under the {"data":<ATMI data...>}
- *  TODO: Free incoming UBF buffer (somehere marking shall be put)
+ * @brief Parse string encoding name
+ * @param enc encoding name: utf-8, locale or bytes
+ * @return NDRXPY_STRENC_* constant
+ */
+expublic int ndrxpy_strenc_parse(const std::string &enc)
+{
+    if ("utf-8"==enc)
+    {
+        return NDRXPY_STRENC_UTF8;
+    }
+    else if ("locale"==enc)
+    {
+        return NDRXPY_STRENC_LOCALE;
+    }
+    else if ("bytes"==enc)
+    {
+        return NDRXPY_STRENC_BYTES;
+    }
+
+    throw std::invalid_argument("Unsupported string encoding: "+enc);
+}
+
+ndrxpy_strenc_guard::ndrxpy_strenc_guard(const std::string &enc) : prev(M_strenc_call)
+{
+    if (!enc.empty())
+    {
+        M_strenc_call = ndrxpy_strenc_parse(enc);
+    }
+}
+
+ndrxpy_strenc_guard::~ndrxpy_strenc_guard()
+{
+    M_strenc_call = prev;
+}
+
+/**
+ * @brief Encode python string for STRING/CARRAY field.
+ *  In UTF-8 mode interpreter's cached UTF-8 representation is returned
+ *  directly (no copy). Locale encoding is used if configured, or if string
+ *  cannot be represented in UTF-8 (e.g. contains surrogate escapes).
+ * 
+ * @param obj python string
+ * @param len [out] encoded length (w/o EOS)
+ * @param tmp holder of the encoded value in locale mode
+ * @return encoded string, valid while obj/tmp is alive
+ */
+expublic const char *ndrxpy_str_enc(py::handle obj, Py_ssize_t *len, py::object &tmp)
+{
+    const char *ret = nullptr;
+
+    if (NDRXPY_STRENC_LOCALE!=G_ndrxpy_strenc)
+    {
+        ret = PyUnicode_AsUTF8AndSize(obj.ptr(), len);
+
+        if (nullptr==ret)
+        {
+            /* lone surrogates, try locale */
+            PyErr_Clear();
+        }
+        else if (nullptr!=memchr(ret, EXEOS, *len))
+        {
+            char errbuf[128];
+            snprintf(errbuf, sizeof(errbuf), "Invalid string value contains 0x00 (len=%ld)",
+                static_cast<long>(*len));
+            throw std::invalid_argument(errbuf);
+        }
+    }
+
+    if (nullptr==ret)
+    {
+        tmp = py::reinterpret_steal<py::object>(
+            PyUnicode_EncodeLocale(obj.ptr(), "surrogateescape"));
+
+        //If we get NULL ptr, then string contains null characters, and that is not supported
+        if (nullptr==tmp.ptr())
+        {
+            PyErr_Clear();
+            char errbuf[128];
+            snprintf(errbuf, sizeof(errbuf), "Invalid string value probably contains 0x00 (len=%ld)",
+                static_cast<long>(PyUnicode_GET_LENGTH(obj.ptr())));
+            throw std::invalid_argument(errbuf);
+        }
+
+        ret = PyBytes_AS_STRING(tmp.ptr());
+        *len = PyBytes_GET_SIZE(tmp.ptr());
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Decode STRING field value with known length.
+ *  In bytes mode value is returned as bytes object.
+ * 
+ * @param str string data
+ * @param len string length (w/o EOS)
+ * @return python string
+ */
+expublic py::object ndrxpy_str_dec(const char *str, Py_ssize_t len)
+{
+    PyObject *ret;
+    int enc = (EXFAIL!=M_strenc_call)?M_strenc_call:G_ndrxpy_strenc;
+
+    switch (enc)
+    {
+        case NDRXPY_STRENC_LOCALE:
+            ret = PyUnicode_DecodeLocaleAndSize(str, len, "surrogateescape");
+            break;
+        case NDRXPY_STRENC_BYTES:
+            ret = PyBytes_FromStringAndSize(str, len);
+            break;
+        default:
+            ret = PyUnicode_DecodeUTF8(str, len, "surrogateescape");
+            break;
+    }
+
+    if (nullptr==ret)
+    {
+        throw py::error_already_set();
+    }
+
+    return py::reinterpret_steal<py::object>(ret);
+}
+
+/**
+ * @brief First phase of buffer conversion: buffer type, UBF fields and
+ *  call info are located. Python objects are not used, thus may be called
+ *  without GIL (e.g. by server dispatcher).
  * @param buf ATMI buffer to conver to Python
- * @param is_master is master buffer (from atmi?)
- * @return python object (dict)
+ * @param dec [out] decoded buffer
  */
-expublic py::object ndrx_to_py(atmibuf &buf)
+expublic void ndrxpy_predecode(atmibuf &buf, ndrxpy_bufdec &dec)
 {
-    char type[8]={EXEOS};
-    char subtype[16]={EXEOS};
-    long size;
-    py::dict result;
     int ret;
 
-    if ((size=tptypes(*buf.pp, type, subtype)) == EXFAIL)
+    if ((dec.size=tptypes(*buf.pp, dec.type, dec.subtype)) == EXFAIL)
     {
         NDRX_LOG(log_error, "Invalid buffer type");
         throw std::invalid_argument("Invalid buffer type");
     }
 
+    NDRX_LOG(log_debug, "Into ndrxpy_predecode() type=[%s] subtype=[%s] size=%ld pp=%p", 
+        dec.type, dec.subtype, dec.size, *buf.pp);
+
+    if (strcmp(dec.type, "UBF") == 0)
+    {
+        ndrxpy_ubf_scan(*buf.fbfr(), dec.flds);
+    }
+
+    // locate call info, if have any.
+    if (strcmp(dec.type, "NULL") != 0)
+    {
+        ret = tpgetcallinfo(*buf.pp, reinterpret_cast<UBFH **>(dec.cibuf.pp), TPCI_NOEOFERR);
+        
+        if (EXTRUE==ret)
+        {
+            dec.has_ci = true;
+            ndrxpy_ubf_scan(*dec.cibuf.fbfr(), dec.ciflds);
+        }
+        else if (EXFAIL==ret)
+        {
+            NDRX_LOG(log_debug, "Error checking tpgetcallinfo()");
+            throw atmi_exception(tperrno);
+        }
+    }
+}
+
+/**
+ * @brief This will add all ATMI related stuff under the {"data":<ATMI data...>}
+ *  Second phase of conversion, GIL must be held.
+ * @param buf ATMI buffer to conver to Python
+ * @param dec buffer decoded by ndrxpy_predecode()
+ * @return python object (dict)
+ */
+expublic py::object ndrx_to_py(atmibuf &buf, ndrxpy_bufdec &dec)
+{
+    py::dict result;
+    ndrxpy_ptrmemo memo;
+
     NDRX_LOG(log_debug, "Into ndrx_to_py() type=[%s] subtype=[%s] size=%ld pp=%p", 
-        type, subtype, size, *buf.pp);
+        dec.type, dec.subtype, dec.size, *buf.pp);
 
     //Return buffer sub-type
-    result["buftype"] = type;
+    result["buftype"] = dec.type;
 
-    if (EXEOS!=subtype[0])
+    if (EXEOS!=dec.subtype[0])
     {
-        result["subtype"]=subtype;
+        result["subtype"]=dec.subtype;
     }
 
-    NDRX_LOG(log_debug, "Converting buffer type [%s]", type);
+    NDRX_LOG(log_debug, "Converting buffer type [%s]", dec.type);
 
-    if (strcmp(type, "STRING") == 0 || strcmp(type, "JSON") == 0)
+    if (strcmp(dec.type, "STRING") == 0 || strcmp(dec.type, "JSON") == 0)
     {
-        result["data"]=py::cast(*buf.pp);
+        result["data"]=ndrxpy_str_dec(*buf.pp, strlen(*buf.pp));
     }
-    else if (strcmp(type, "CARRAY") == 0 || strcmp(type, "X_OCTET") == 0)
+    else if (strcmp(dec.type, "CARRAY") == 0 || strcmp(dec.type, "X_OCTET") == 0)
     {
         result["data"]=py::bytes(*buf.pp, buf.len);
     }
-    else if (strcmp(type, "UBF") == 0)
+    else if (strcmp(dec.type, "UBF") == 0)
     {
-        result["data"]=ndrxpy_to_py_ubf(*buf.fbfr(), 0);
+        result["data"]=ndrxpy_ubf_build(dec.flds);
     }
-    else if (strcmp(type, "VIEW") == 0)
+    else if (strcmp(dec.type, "VIEW") == 0)
     {
-        result["data"] = ndrxpy_to_py_view(*buf.pp, subtype, size);
+        result["data"] = ndrxpy_to_py_view(*buf.pp, dec.subtype, dec.size);
     }
-    else if (strcmp(type, "NULL") == 0)
+    else if (strcmp(dec.type, "NULL") == 0)
     {
         /* data field not present -> NULL */
     } 
@@ -122,26 +289,29 @@ expublic py::object ndrx_to_py(atmibuf &buf)
     }
 
     // attach call info, if have any.
-    atmibuf cibuf;
-    if (strcmp(type, "NULL") != 0)
+    if (dec.has_ci)
     {
-        ret = tpgetcallinfo(*buf.pp, reinterpret_cast<UBFH **>(cibuf.pp), TPCI_NOEOFERR);
-        
-        if (EXTRUE==ret)
-        {
-            // setup callinfo block
-            result[NDRXPY_DATA_CALLINFO]=ndrxpy_to_py_ubf(*cibuf.fbfr(), 0);
-        }
-        else if (EXFAIL==ret)
-        {
-            NDRX_LOG(log_debug, "Error checking tpgetcallinfo()");
-            throw atmi_exception(tperrno);
-        }
+        // setup callinfo block
+        result[NDRXPY_DATA_CALLINFO]=ndrxpy_ubf_build(dec.ciflds);
     }
 
     return result;
 }
 
+/**
+ * @brief Convert ATMI buffer to python object
+ * @param buf ATMI buffer to conver to Python
+ * @return python object (dict)
+ */
+expublic py::object ndrx_to_py(atmibuf &buf)
+{
+    ndrxpy_bufdec dec;
+
+    ndrxpy_predecode(buf, dec);
+
+    return ndrx_to_py(buf, dec);
+}
+
 /**
  * @brief Process call info from main call dict
  * 
@@ -184,6 +354,8 @@ exprivate void set_callinfo(py::dict & dict, atmibuf &buf)
  * {"data":<ATMI_BUFFER>, "buftype":"UBF|VIEW|STRING|JSON|CARRAY|NULL", "subtype":"<VIEW_TYPE>", ["callinfo":{<UBF_DATA>}]}
  * 
  * For NULL buffers, data field is not present.
+ * AtmiBuf handle is accepted too, in which case returned buffer
+ * is not owned (i.e. is not freed by destructor).
  * 
  * @param obj Pyton object
  * @return converted ATMI buffer
@@ -193,9 +365,19 @@ expublic atmibuf ndrx_from_py(py::object obj)
     std::string buftype = "";
     std::string subtype = "";
     atmibuf buf;
+    ndrxpy_ptrmemo memo;
 
     NDRX_LOG(log_debug, "Into ndrx_from_py()");
 
+    if (py::isinstance<pyatmibuf>(obj))
+    {
+        /* buffer stays owned by the handle */
+        auto h = obj.cast<pyatmibuf *>();
+        buf.pp = h->buf.pp;
+        buf.len = h->buf.len;
+        return buf;
+    }
+
     if (!py::isinstance<py::dict>(obj))
     {
         throw std::invalid_argument("Unsupported buffer type");
@@ -225,17 +407,30 @@ expublic atmibuf ndrx_from_py(py::object obj)
     NDRX_LOG(log_debug, "Converting out: [%s] / [%s]", buftype.c_str(), subtype.c_str());
 
     /* process JSON data... as string */
-    if (buftype=="JSON")
+    if (buftype=="JSON" || (buftype=="STRING" && py::isinstance<py::bytes>(data)))
     {
-        if (!py::isinstance<py::str>(data))
+        py::object tmp;
+        Py_ssize_t len;
+        const char *s;
+
+        /* bytes are accepted as is (e.g. received in bytes mode) */
+        if (py::isinstance<py::bytes>(data))
+        {
+            s = PyBytes_AS_STRING(data.ptr());
+            len = PyBytes_GET_SIZE(data.ptr());
+        }
+        else if (py::isinstance<py::str>(data))
+        {
+            s = ndrxpy_str_enc(data, &len, tmp);
+        }
+        else
         {
             throw std::invalid_argument("String expected for JSON buftype, got: "+buftype);
-        } 
-
-        std::string s = py::str(data);
+        }
 
-        buf = atmibuf("JSON", s.size() + 1);
-        strcpy(*buf.pp, s.c_str());
+        buf = atmibuf(buftype.c_str(), len + 1);
+        memcpy(*buf.pp, s, len);
+        (*buf.pp)[len] = EXEOS;
     }
     else if (buftype=="VIEW")
     {
@@ -267,9 +462,13 @@ expublic atmibuf ndrx_from_py(py::object obj)
                 "expected STRING buftype, got: "+buftype);
         }
 
-        std::string s = py::str(data);
-        buf = atmibuf("STRING", s.size() + 1);
-        strcpy(*buf.pp, s.c_str());
+        py::object tmp;
+        Py_ssize_t len;
+        const char *s = ndrxpy_str_enc(data, &len, tmp);
+
+        buf = atmibuf("STRING", len + 1);
+        memcpy(*buf.pp, s, len);
+        (*buf.pp)[len] = EXEOS;
     }
     else if (!dict.contains(NDRXPY_DATA_DATA))
     {
@@ -288,7 +487,7 @@ expublic atmibuf ndrx_from_py(py::object obj)
             throw std::invalid_argument("For dict data "
                 "expected UBF buftype, got: "+buftype);
         }
-        buf = atmibuf("UBF", 1024);
+        /* allocated with estimated size */
         ndrxpy_from_py_ubf(static_cast<py::dict>(data), buf);
     }
     else
@@ -51,44 +51,139 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <algorithm>
+#include <climits>
 #include <functional>
+#include <map>
+#include <vector>
 
 /*---------------------------Externs------------------------------------*/
 /*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_UBF_MINSIZE      1024    /**< minimum UBF buffer size */
+
 /*---------------------------Enums--------------------------------------*/
 /*---------------------------Typedefs-----------------------------------*/
 /*---------------------------Globals------------------------------------*/
+
+thread_local ndrxpy_ptrmemo *ndrxpy_ptrmemo::current = nullptr;
+
 /*---------------------------Statics------------------------------------*/
+
+/** nested UBF dict sizes of current conversion */
+static thread_local std::map<PyObject *, long> *M_ubfsizes = nullptr;
+
 /*---------------------------Prototypes---------------------------------*/
 namespace py = pybind11;
 
+static long ubf_estimate(py::dict obj, std::map<PyObject *, long> &sizes);
+
 /**
- * @brief Convert UBF buffer to python object
+ * @brief Convert single UBF field occurrence to python object
  * 
- * @param fbfr UBF buffer handler
- * @param buflen buffer len (opt)
- * @return py::object converted object
+ * @param fieldid field id
+ * @param d_ptr field data
+ * @param len field data len
+ * @return py::object converted value
  */
-expublic py::object ndrxpy_to_py_ubf(UBFH *fbfr, BFLDLEN buflen = 0)
+static py::object fld_to_py(BFLDID fieldid, char *d_ptr, BFLDLEN len)
 {
-    BFLDID fieldid = BFIRSTFLDID;
-    Bnext_state_t state;
-    BFLDOCC oc = 0;
-    char *d_ptr;
-    BVIEWFLD *p_vf;
+    switch (Bfldtype(fieldid))
+    {
+    case BFLD_CHAR:
+        /* if EOS char is used, convert to byte array.
+         * as it is possible to get this value from C
+         */
+        if  (EXEOS==d_ptr[0])
+        {
+            return py::bytes(d_ptr, 1);
+        }
+        return py::cast(d_ptr[0]);
+    case BFLD_SHORT:
+        return py::cast(*reinterpret_cast<short *>(d_ptr));
+    case BFLD_LONG:
+        return py::cast(*reinterpret_cast<long *>(d_ptr));
+    case BFLD_FLOAT:
+        return py::cast(*reinterpret_cast<float *>(d_ptr));
+    case BFLD_DOUBLE:
+        return py::cast(*reinterpret_cast<double *>(d_ptr));
+    case BFLD_STRING:
+
+        NDRX_LOG(log_dump, "Processing FLD_STRING... [%s]", d_ptr);
+        /* len includes EOS */
+        return ndrxpy_str_dec(d_ptr, len - 1);
+    case BFLD_CARRAY:
+        return py::bytes(d_ptr, len);
+    case BFLD_UBF:
+        /* embedded buffer is sized by its own data */
+        return ndrxpy_to_py_ubf(reinterpret_cast<UBFH *>(d_ptr), len);
+    case BFLD_VIEW:
+    {
+        py::dict vdict;
 
-    py::dict result;
-    py::list val;
+        /* d_ptr points to BVIEWFIELD */
+        BVIEWFLD *p_vf = reinterpret_cast<BVIEWFLD *>(d_ptr);
 
-    NDRX_LOG(log_debug, "Into ndrxpy_to_py_ubf()");
+        if (EXEOS!=p_vf->vname[0])
+        {
+            /* not empty occ */
+            vdict["vname"] = p_vf->vname;
+            vdict["data"]= ndrxpy_to_py_view(p_vf->data, p_vf->vname, len);
+        }
 
-    if (buflen == 0)
+        return vdict;
+    }
+    case BFLD_PTR:
     {
-        buflen = Bsizeof(fbfr);
+        atmibuf ptrbuf;
+        ptrbuf.p = nullptr;
+        ptrbuf.pp = reinterpret_cast<char **>(d_ptr);
+        ndrxpy_ptrmemo *memo = ndrxpy_ptrmemo::get();
+
+        /* shared buffer, already converted */
+        if (nullptr!=memo)
+        {
+            auto it = memo->topy.find(*ptrbuf.pp);
+
+            if (memo->topy.end()!=it)
+            {
+                return it->second;
+            }
+        }
+
+        /* process stuff recursively + free up leave buffers,
+         * as we are not using them any more
+         */
+        py::object ret = ndrx_to_py(ptrbuf);
+
+        if (nullptr!=memo)
+        {
+            memo->topy[*ptrbuf.pp] = ret;
+        }
+
+        return ret;
     }
-    /*std::unique_ptr<char[]> value(new char[buflen]); */
+    default:
+        throw std::invalid_argument("Unsupported field " +
+                                    std::to_string(fieldid));
+    }
+}
 
-    //Bprint(fbfr);
+/**
+ * @brief Walk UBF buffer and collect field occurrences. Python objects
+ *  are not used, thus may be called without GIL.
+ * 
+ * @param fbfr UBF buffer handler
+ * @param flds [out] field occurrences in buffer order
+ */
+expublic void ndrxpy_ubf_scan(UBFH *fbfr, std::vector<ndrxpy_ubffld> &flds)
+{
+    BFLDID fieldid = BFIRSTFLDID;
+    Bnext_state_t state;
+    BFLDOCC oc = 0;
+    char *d_ptr;
+    char *name = nullptr;
+    BFLDLEN buflen = Bsizeof(fbfr);
 
     for (;;)
     {
@@ -105,103 +200,67 @@ expublic py::object ndrxpy_to_py_ubf(UBFH *fbfr, BFLDLEN buflen = 0)
             break;
         }
 
+        /* name lookup once per field */
         if (oc == 0)
+        {
+            name = Bfname(fieldid);
+        }
+
+        flds.push_back({fieldid, oc, d_ptr, len, name});
+    }
+}
+
+/**
+ * @brief Build python dict from field occurrences collected by
+ *  ndrxpy_ubf_scan(), GIL must be held.
+ * 
+ * @param flds field occurrences
+ * @return py::object converted object
+ */
+expublic py::object ndrxpy_ubf_build(std::vector<ndrxpy_ubffld> &flds)
+{
+    ndrxpy_ptrmemo memo;
+    py::dict result;
+    py::list val;
+
+    for (auto &f : flds)
+    {
+        if (f.occ == 0)
         {
             val = py::list();
 
-            char *name = Bfname(fieldid);
-            if (name != nullptr)
+            if (f.name != nullptr)
             {
-                result[name] = val;
+                result[f.name] = val;
             }
             else
             {
-                result[py::int_(fieldid)] = val;
+                result[py::int_(f.fldid)] = val;
             }
         }
 
-        switch (Bfldtype(fieldid))
-        {
-        case BFLD_CHAR:
-            /* if EOS char is used, convert to byte array.
-             * as it is possible to get this value from C
-             */
-            if  (EXEOS==d_ptr[0])
-            {
-                val.append(py::bytes(d_ptr, 1));
-            }
-            else
-            {
-                val.append(py::cast(d_ptr[0]));
-            }            
-            break;
-        case BFLD_SHORT:
-            val.append(py::cast(*reinterpret_cast<short *>(d_ptr)));
-            break;
-        case BFLD_LONG:
-            val.append(py::cast(*reinterpret_cast<long *>(d_ptr)));
-            break;
-        case BFLD_FLOAT:
-            val.append(py::cast(*reinterpret_cast<float *>(d_ptr)));
-            break;
-        case BFLD_DOUBLE:
-            val.append(py::cast(*reinterpret_cast<double *>(d_ptr)));
-            break;
-        case BFLD_STRING:
+        val.append(fld_to_py(f.fldid, f.d_ptr, f.len));
+    }
 
-            NDRX_LOG(log_dump, "Processing FLD_STRING... [%s]", d_ptr);
-            val.append(
-#if PY_MAJOR_VERSION >= 3
-                py::str(d_ptr)
-                //Seems like this one causes memory leak:
-                //Thus assume t
-                //py::str(PyUnicode_DecodeLocale(value.get(), "surrogateescape"))
-#else
-                py::bytes(d_ptr, len - 1)
-#endif
-            );
-            break;
-        case BFLD_CARRAY:
-            val.append(py::bytes(d_ptr, len));
-            break;
-        case BFLD_UBF:
-            val.append(ndrxpy_to_py_ubf(reinterpret_cast<UBFH *>(d_ptr), buflen));
-            break;
-        case BFLD_VIEW:
-        {
-            py::dict vdict;
+    return result;
+}
 
-            /* d_ptr points to BVIEWFIELD */
-            p_vf = reinterpret_cast<BVIEWFLD *>(d_ptr);
+/**
+ * @brief Convert UBF buffer to python object
+ * 
+ * @param fbfr UBF buffer handler
+ * @param buflen buffer len (opt), not used
+ * @return py::object converted object
+ */
+expublic py::object ndrxpy_to_py_ubf(UBFH *fbfr, BFLDLEN buflen = 0)
+{
+    std::vector<ndrxpy_ubffld> flds;
 
-            if (EXEOS!=p_vf->vname[0])
-            {
-                /* not empty occ */
-                vdict["vname"] = p_vf->vname;
-                vdict["data"]= ndrxpy_to_py_view(p_vf->data, p_vf->vname, len);
-            }
+    NDRX_LOG(log_debug, "Into ndrxpy_to_py_ubf()");
 
-            val.append(vdict);
-            break;
-        }
-        case BFLD_PTR:
-        {
-            atmibuf ptrbuf;
-            ptrbuf.p = nullptr;
-            ptrbuf.pp = reinterpret_cast<char **>(d_ptr);
+    ndrxpy_ubf_scan(fbfr, flds);
 
-            /* process stuff recursively + free up leave buffers,
-             * as we are not using them any more
-             */
-            val.append(ndrx_to_py(ptrbuf));
-        }
-        break;
-        default:
-            throw std::invalid_argument("Unsupported field " +
-                                        std::to_string(fieldid));
-        }
-    }
-    return result;
+    return ndrxpy_ubf_build(flds);
 }
 
 /**
@@ -223,54 +282,18 @@ static void from_py1_ubf(atmibuf &buf, BFLDID fieldid, BFLDOCC oc,
     }
     else if (py::isinstance<py::bytes>(obj))
     {
-        std::string val(PyBytes_AsString(obj.ptr()), PyBytes_Size(obj.ptr()));
-
+        /* passed as is, also for STRING fields */
         buf.mutate([&](UBFH *fbfr)
-                   { return CBchg(fbfr, fieldid, oc, const_cast<char *>(val.data()),
-                                  val.size(), BFLD_CARRAY); });
+                   { return CBchg(fbfr, fieldid, oc, PyBytes_AS_STRING(obj.ptr()),
+                                  PyBytes_GET_SIZE(obj.ptr()), BFLD_CARRAY); });
 #endif
     }
     else if (py::isinstance<py::str>(obj))
     {
-        char *ptr_val =NULL;
-        BFLDLEN len;
-
-#if PY_MAJOR_VERSION >= 3
-        py::bytes b = py::reinterpret_steal<py::bytes>(
-            PyUnicode_EncodeLocale(obj.ptr(), "surrogateescape"));
+        py::object tmp;
+        Py_ssize_t len;
+        char *ptr_val = const_cast<char *>(ndrxpy_str_enc(obj, &len, tmp));
 
-        //If we get NULL ptr, then string contains null characters, and that is not supported
-        //In case of string we get EOS
-        //In case of single char field, will get NULL field.
-        std::string val = "";
-
-        if (nullptr!=b.ptr())
-        {
-            //TODO: well this goes out of the scope?
-            val.assign(PyBytes_AsString(b.ptr()), PyBytes_Size(b.ptr()));
-            ptr_val = const_cast<char *>(val.data());
-            len = val.size();
-        }
-        else
-        {
-            PyErr_Print();
-            char tmp[128];
-            snprintf(tmp, sizeof(tmp), "Invalid string value probably contains 0x00 (len=%ld), field=%d",
-                PyBytes_Size(obj.ptr()), fieldid);
-            throw std::invalid_argument(tmp);
-        }
-
-#else
-        if (PyUnicode_Check(obj.ptr()))
-        { 
-            obj = PyUnicode_AsEncodedString(obj.ptr(), "utf-8", "surrogateescape");
-        }
-        std::string val(PyString_AsString(obj.ptr()), PyString_Size(obj.ptr()));
-
-        ptr_val = const_cast<char *>(val.data());
-        len = val.size();
-
-#endif
         buf.mutate([&](UBFH *fbfr)
                    { return CBchg(fbfr, fieldid, oc, ptr_val, len, BFLD_CARRAY); });
     }
@@ -352,13 +375,36 @@ static void from_py1_ubf(atmibuf &buf, BFLDID fieldid, BFLDOCC oc,
                 NDRX_LOG(log_error, "%s", tmp);
                 throw std::invalid_argument(tmp);
             }
-            atmibuf tmp = ndrx_from_py(obj.cast<py::object>());
-            
-            buf.mutate([&](UBFH *fbfr)
-                    { return Bchg(fbfr, fieldid, oc, reinterpret_cast<char *>(tmp.pp), 0); });
+            ndrxpy_ptrmemo *memo = ndrxpy_ptrmemo::get();
+            char *ptr = nullptr;
+
+            /* the same dict is referenced several times, share the buffer */
+            if (nullptr!=memo)
+            {
+                auto it = memo->frompy.find(obj.ptr());
 
-            //Do not remove this buffer... as needed by mbuf
-            tmp.p = nullptr;
+                if (memo->frompy.end()!=it)
+                {
+                    ptr = it->second;
+                }
+            }
+
+            if (nullptr==ptr)
+            {
+                atmibuf tmp = ndrx_from_py(obj.cast<py::object>());
+                ptr = *tmp.pp;
+
+                //Do not remove this buffer... as needed by mbuf
+                tmp.release();
+
+                if (nullptr!=memo)
+                {
+                    memo->frompy[obj.ptr()] = ptr;
+                }
+            }
+
+            buf.mutate([&](UBFH *fbfr)
+                    { return Bchg(fbfr, fieldid, oc, reinterpret_cast<char *>(&ptr), 0); });
 
         }
     }
@@ -369,28 +415,341 @@ static void from_py1_ubf(atmibuf &buf, BFLDID fieldid, BFLDOCC oc,
 }
 
 /**
- * @brief Convert PY to UBF
+ * @brief Resolve dictionary key to field id
  * 
- * @param obj 
- * @param b 
+ * @param key field id (int) or field name
+ * @return field id or BBADFLDID
  */
-expublic void ndrxpy_from_py_ubf(py::dict obj, atmibuf &b)
+static BFLDID key_to_fldid(py::handle key)
+{
+    if (py::isinstance<py::int_>(key))
+    {
+        return key.cast<py::int_>();
+    }
+
+    return Bfldid(const_cast<char *>(std::string(py::str(key)).c_str()));
+}
+
+/**
+ * @brief Check is UBF field occurrence equal to Python value.
+ *  Only simple cases are compared (where value encoding is not ambiguous),
+ *  for all others false is returned and field is set.
+ * 
+ * @param fbfr UBF buffer
+ * @param fieldid field id
+ * @param oc occurrence
+ * @param obj python value
+ * @return true if field holds the same value
+ */
+static bool fld_same(UBFH *fbfr, BFLDID fieldid, BFLDOCC oc, py::handle obj)
 {
-    b.reinit("UBF", nullptr, 1024);
+    BFLDLEN len;
+    char *p = Bfind(fbfr, fieldid, oc, &len);
+    const char *s = nullptr;
+    Py_ssize_t n = 0;
+    long lval;
+    int overflow = 0;
+
+    if (nullptr==p)
+    {
+        return false;
+    }
+
+    if (py::isinstance<py::bytes>(obj))
+    {
+        s = PyBytes_AS_STRING(obj.ptr());
+        n = PyBytes_GET_SIZE(obj.ptr());
+    }
+    else if (py::isinstance<py::str>(obj) && PyUnicode_IS_ASCII(obj.ptr()))
+    {
+        s = PyUnicode_AsUTF8AndSize(obj.ptr(), &n);
+    }
+
+    switch (Bfldtype(fieldid))
+    {
+        case BFLD_STRING:
+            return nullptr!=s && len==n+1 && 0==memcmp(p, s, n);
+        case BFLD_CARRAY:
+            return nullptr!=s && len==n && 0==memcmp(p, s, n);
+        case BFLD_SHORT:
+        case BFLD_LONG:
+
+            if (!py::isinstance<py::int_>(obj))
+            {
+                return false;
+            }
+
+            lval = PyLong_AsLongAndOverflow(obj.ptr(), &overflow);
+
+            if (overflow || (-1==lval && PyErr_Occurred()))
+            {
+                PyErr_Clear();
+                return false;
+            }
+
+            return BFLD_SHORT==Bfldtype(fieldid) ?
+                *reinterpret_cast<short *>(p)==lval : *reinterpret_cast<long *>(p)==lval;
+        case BFLD_DOUBLE:
+            return py::isinstance<py::float_>(obj) && 
+                *reinterpret_cast<double *>(p)==PyFloat_AS_DOUBLE(obj.ptr());
+    }
+
+    return false;
+}
+
+/**
+ * @brief Update existing UBF buffer from Python dict in place.
+ *  Fields which hold the same value are not touched, fields and occurrences
+ *  not present in dict are removed, thus result is the same as building
+ *  buffer from scratch with ndrxpy_from_py_ubf(). 
+ *  Buffers with PTR fields are not updated (embedded buffers would leak).
+ * 
+ * @param obj UBF dictionary
+ * @param b existing UBF buffer, len must be set to allocated size
+ * @return EXSUCCEED if updated, EXFAIL if buffer cannot be updated in place
+ *  (buffer is not changed then)
+ */
+expublic int ndrxpy_from_py_ubf_delta(py::dict obj, atmibuf &b)
+{
+    std::map<BFLDID, py::handle> flds;
+    std::vector<BFLDID> del;
+    BFLDID fieldid = BFIRSTFLDID;
+    BFLDOCC oc;
     atmibuf f;
+    int ret;
 
     for (auto it : obj)
     {
-        BFLDID fieldid;
-        if (py::isinstance<py::int_>(it.first))
+        fieldid = key_to_fldid(it.first);
+
+        if (BBADFLDID==fieldid || BFLD_PTR==Bfldtype(fieldid))
+        {
+            return EXFAIL;
+        }
+
+        flds[fieldid] = it.second;
+    }
+
+    /* collect fields to remove */
+    fieldid = BFIRSTFLDID;
+    while (1==(ret=Bnext(*b.fbfr(), &fieldid, &oc, NULL, NULL)))
+    {
+        if (0==oc && flds.end()==flds.find(fieldid))
+        {
+            if (BFLD_PTR==Bfldtype(fieldid))
+            {
+                return EXFAIL;
+            }
+            del.push_back(fieldid);
+        }
+    }
+
+    if (EXFAIL==ret)
+    {
+        throw ubf_exception(Berror);
+    }
+
+    for (auto fid : del)
+    {
+        if (EXFAIL==Bdelall(*b.fbfr(), fid))
+        {
+            throw ubf_exception(Berror);
+        }
+    }
+
+    for (auto &it : flds)
+    {
+        BFLDOCC occs = 0;
+
+        if (py::isinstance<py::list>(it.second))
         {
-            fieldid = it.first.cast<py::int_>();
+            for (auto e : it.second.cast<py::list>())
+            {
+                if (!fld_same(*b.fbfr(), it.first, occs, e))
+                {
+                    from_py1_ubf(b, it.first, occs, e, f);
+                }
+                occs++;
+            }
         }
         else
         {
-            fieldid =
-                Bfldid(const_cast<char *>(std::string(py::str(it.first)).c_str()));
+            if (!fld_same(*b.fbfr(), it.first, 0, it.second))
+            {
+                from_py1_ubf(b, it.first, 0, it.second, f);
+            }
+            occs++;
+        }
+
+        /* remove trailing occurrences */
+        for (oc=Boccur(*b.fbfr(), it.first)-1; oc>=occs; oc--)
+        {
+            if (EXSUCCEED!=Bdel(*b.fbfr(), it.first, oc))
+            {
+                throw ubf_exception(Berror);
+            }
+        }
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Estimate UBF storage of single python value
+ * 
+ * @param fieldid field id
+ * @param obj python value
+ * @param sizes nested dict sizes (filled)
+ * @return data bytes
+ */
+static long fld_estimate(BFLDID fieldid, py::handle obj, std::map<PyObject *, long> &sizes)
+{
+    if (py::isinstance<py::bytes>(obj))
+    {
+        return PyBytes_GET_SIZE(obj.ptr());
+    }
+    else if (py::isinstance<py::str>(obj))
+    {
+        /* non ascii chars may take up to 4 bytes in encoded form */
+        return PyUnicode_GET_LENGTH(obj.ptr()) * (PyUnicode_IS_ASCII(obj.ptr())?1:4) + 1;
+    }
+    else if (py::isinstance<py::dict>(obj))
+    {
+        switch (Bfldtype(fieldid))
+        {
+            case BFLD_UBF:
+                return ubf_estimate(obj.cast<py::dict>(), sizes);
+            case BFLD_VIEW:
+            {
+                auto view_d = obj.cast<py::dict>();
+                long vsize = 0;
+
+                if (view_d.contains("vname"))
+                {
+                    std::string vname = py::str(view_d["vname"]);
+                    vsize = Bvsizeof(const_cast<char *>(vname.c_str()));
+                }
+
+                return sizeof(BVIEWFLD) + std::max(vsize, 0L);
+            }
+            default:
+                return sizeof(char *);
+        }
+    }
+
+    /* numbers & others */
+    return sizeof(double);
+}
+
+/**
+ * @brief Estimate UBF buffer size needed for python dict, bottom-up.
+ *  Sizes of all nested UBF dicts are collected in one pass, so that
+ *  each (sub-)buffer is allocated once with final size.
+ * 
+ * @param obj UBF dict
+ * @param sizes nested dict sizes (filled)
+ * @return buffer size
+ */
+static long ubf_estimate(py::dict obj, std::map<PyObject *, long> &sizes)
+{
+    BFLDOCC nflds = 0;
+    long tot = 0;
+    long ret;
+
+    for (auto it : obj)
+    {
+        BFLDID fieldid = key_to_fldid(it.first);
+
+        if (BBADFLDID==fieldid)
+        {
+            /* reported by conversion */
+            continue;
+        }
+
+        py::handle o = it.second;
+        if (py::isinstance<py::list>(o))
+        {
+            for (auto e : o.cast<py::list>())
+            {
+                tot+=fld_estimate(fieldid, e, sizes);
+                nflds++;
+            }
+        }
+        else
+        {
+            tot+=fld_estimate(fieldid, o, sizes);
+            nflds++;
+        }
+    }
+
+    ret = Bneeded(nflds, static_cast<BFLDLEN>(std::min(tot, static_cast<long>(INT_MAX))));
+
+    if (ret < NDRXPY_UBF_MINSIZE)
+    {
+        /* too large for estimate or small: grown on demand */
+        ret = NDRXPY_UBF_MINSIZE;
+    }
+
+    sizes[obj.ptr()] = ret;
+
+    return ret;
+}
+
+/**
+ * @brief Sizes of nested UBF dicts, used during top level conversion
+ */
+struct ubfsizes_guard
+{
+    bool top;
+
+    ubfsizes_guard(std::map<PyObject *, long> &sizes) : top(nullptr==M_ubfsizes)
+    {
+        if (top)
+        {
+            M_ubfsizes = &sizes;
+        }
+    }
+
+    ~ubfsizes_guard()
+    {
+        if (top)
+        {
+            M_ubfsizes = nullptr;
         }
+    }
+};
+
+/**
+ * @brief Convert PY to UBF
+ * 
+ * @param obj 
+ * @param b 
+ */
+expublic void ndrxpy_from_py_ubf(py::dict obj, atmibuf &b)
+{
+    std::map<PyObject *, long> sizes;
+    ubfsizes_guard guard(sizes);
+    ndrxpy_ptrmemo memo;
+    long need;
+    atmibuf f;
+
+    /* nested dicts are already estimated by the parent */
+    auto sz = M_ubfsizes->find(obj.ptr());
+
+    if (M_ubfsizes->end()!=sz)
+    {
+        need = sz->second;
+    }
+    else
+    {
+        need = ubf_estimate(obj, *M_ubfsizes);
+    }
+
+    b.reinit("UBF", nullptr, need);
+
+    for (auto it : obj)
+    {
+        BFLDID fieldid = key_to_fldid(it.first);
 
         py::handle o = it.second;
         if (py::isinstance<py::list>(o))
@@ -411,6 +770,59 @@ expublic void ndrxpy_from_py_ubf(py::dict obj, atmibuf &b)
     //Bprint(*b.fbfr());
 }
 
+/**
+ * @brief Resolve python key to field id
+ * 
+ * @param key field id (int) or field name
+ * @return field id
+ */
+expublic BFLDID ndrxpy_fldid(py::handle key)
+{
+    BFLDID ret = key_to_fldid(key);
+
+    if (BBADFLDID==ret)
+    {
+        throw ubf_exception(py::isinstance<py::int_>(key)?BBADFLD:Berror);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Set single field occurrence in the UBF buffer
+ * 
+ * @param b UBF buffer (grown on demand)
+ * @param fieldid field id
+ * @param oc occurrence
+ * @param obj python value
+ */
+expublic void ndrxpy_ubf_set(atmibuf &b, BFLDID fieldid, BFLDOCC oc, py::handle obj)
+{
+    atmibuf tmp;
+    from_py1_ubf(b, fieldid, oc, obj, tmp);
+}
+
+/**
+ * @brief Get single field occurrence from the UBF buffer
+ * 
+ * @param fbfr UBF buffer
+ * @param fieldid field id
+ * @param oc occurrence
+ * @return python value
+ */
+expublic py::object ndrxpy_ubf_get(UBFH *fbfr, BFLDID fieldid, BFLDOCC oc)
+{
+    BFLDLEN len;
+    char *d_ptr = Bfind(fbfr, fieldid, oc, &len);
+
+    if (nullptr==d_ptr)
+    {
+        throw ubf_exception(Berror);
+    }
+
+    return fld_to_py(fieldid, d_ptr, len);
+}
+
 /**
  * @brief Register UBF specific functions
  * 
@@ -811,6 +1223,64 @@ expublic void ndrxpy_register_ubf(py::module &m)
         ret : dict
             Restored UBF buffer.
             )pbdoc", py::arg("iop"));
+
+    m.def(
+        "set_strenc",
+        [](const std::string &enc)
+        {
+            G_ndrxpy_strenc = ndrxpy_strenc_parse(enc);
+        },
+        R"pbdoc(
+        Set encoding used for **STRING** (and **JSON**) buffers, UBF and VIEW string
+        fields. Default is *utf-8* where Python string internal UTF-8 representation
+        is passed to ATMI directly and received data is decoded with known length.
+        Strings which cannot be encoded in UTF-8 (e.g. with surrogate escapes) are
+        encoded with locale encoding. Mode *locale* encodes and decodes all strings
+        with locale encoding and *surrogateescape* error handler.
+        Mode *bytes* returns received string fields (and **STRING** buffers) as
+        bytes, without decoding. Bytes are accepted for string fields and
+        **STRING** buffers when sending, thus data may be passed through as is.
+        Encoding may be set for particular call too, see *strenc* argument
+        of :func:`.tpcall`, :func:`.tpgetrply`, :func:`.tprecv`.
+
+        .. code-block:: python
+            :caption: set_strenc example
+            :name: set_strenc-example
+
+                import endurox as e
+                e.set_strenc("locale")
+
+        :raise ValueError: 
+            | Unsupported encoding.
+
+        Parameters
+        ----------
+        enc : str
+            Encoding, *utf-8*, *locale* or *bytes*.
+            )pbdoc", py::arg("enc"));
+
+    m.def(
+        "get_strenc",
+        []()
+        {
+            switch (G_ndrxpy_strenc)
+            {
+                case NDRXPY_STRENC_LOCALE:
+                    return "locale";
+                case NDRXPY_STRENC_BYTES:
+                    return "bytes";
+                default:
+                    return "utf-8";
+            }
+        },
+        R"pbdoc(
+        Get encoding used for string fields, see :func:`.set_strenc`.
+
+        Returns
+        -------
+        enc : str
+            Encoding, *utf-8*, *locale* or *bytes*.
+            )pbdoc");
 }
 
 /* vim: set ts=4 sw=4 et smartindent: */
@@ -166,16 +166,7 @@ expublic py::object ndrxpy_to_py_view(char *cstruct, char *view, long size)
             case BFLD_STRING:
 
                 NDRX_LOG(log_dump, "Processing FLD_STRING...");
-                val.append(
-    #if PY_MAJOR_VERSION >= 3
-                    py::str(tmp.buf)
-                    //Seems like this one causes memory leak:
-                    //Thus assume t
-                    //py::str(PyUnicode_DecodeLocale(value.get(), "surrogateescape"))
-    #else
-                    py::bytes(tmp.buf, len - 1)
-    #endif
-                );
+                val.append(ndrxpy_str_dec(tmp.buf, strnlen(tmp.buf, len)));
                 break;
             case BFLD_CARRAY:
                 val.append(py::bytes(tmp.buf, len));
@@ -211,12 +202,10 @@ static void from_py1_view(atmibuf &buf, const char *view, const char *cname, BFL
     }
     else if (py::isinstance<py::bytes>(obj))
     {
-        std::string val(PyBytes_AsString(obj.ptr()), PyBytes_Size(obj.ptr()));
-
-        //Set view field finally
+        //Set view field finally, passed as is, also for string fields
         if (EXSUCCEED!=CBvchg(*buf.pp, const_cast<char *>(view), 
                 const_cast<char *>(cname), oc, 
-                const_cast<char *>(val.data()), val.size(), BFLD_CARRAY))
+                PyBytes_AS_STRING(obj.ptr()), PyBytes_GET_SIZE(obj.ptr()), BFLD_CARRAY))
         {
             throw ubf_exception(Berror);    
         }
@@ -225,43 +214,10 @@ static void from_py1_view(atmibuf &buf, const char *view, const char *cname, BFL
     }
     else if (py::isinstance<py::str>(obj))
     {
-        char *ptr_val =NULL;
-        BFLDLEN len;
-
-#if PY_MAJOR_VERSION >= 3
-       std::string val = "";
-        py::bytes b = py::reinterpret_steal<py::bytes>(
-            PyUnicode_EncodeLocale(obj.ptr(), "surrogateescape"));
+        py::object tmp;
+        Py_ssize_t len;
+        char *ptr_val = const_cast<char *>(ndrxpy_str_enc(obj, &len, tmp));
 
-        //If we get NULL ptr, then string contains null characters, and that is not supported
-        //In case of string we get EOS
-        //In case of single char field, will get NULL field.
-        if (nullptr!=b.ptr())
-        {
-            val.assign(PyBytes_AsString(b.ptr()), PyBytes_Size(b.ptr()));
-            ptr_val = const_cast<char *>(val.data());
-            len = val.size();
-        }
-        else
-        {
-            PyErr_Print();
-            char tmp[64];
-            snprintf(tmp, sizeof(tmp), "Invalid string value probably contains 0x00 (len=%ld)",
-                PyBytes_Size(obj.ptr()));
-            throw std::invalid_argument(tmp);
-        }
-
-#else
-        if (PyUnicode_Check(obj.ptr()))
-        { 
-            obj = PyUnicode_AsEncodedString(obj.ptr(), "utf-8", "surrogateescape");
-        }
-        std::string val(PyString_AsString(obj.ptr()), PyString_Size(obj.ptr()));
-
-        ptr_val = const_cast<char *>(val.data());
-        len = val.size();
-
-#endif
         if (EXSUCCEED!=CBvchg(*buf.pp, const_cast<char *>(view), 
                     const_cast<char *>(cname), oc, ptr_val,
                     len, BFLD_CARRAY))
@@ -0,0 +1,240 @@
+/**
+ * @brief Native ATMI buffer handle (in place UBF access)
+ *
+ * @file bufhandle.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <atmi.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+/*---------------------------Prototypes---------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Create buffer handle from standard buffer dictionary
+ * @param data buffer dict, if None empty UBF buffer is allocated
+ * @return buffer handle
+ */
+exprivate std::unique_ptr<pyatmibuf> atmibufh_new(py::object data)
+{
+    if (data.is_none())
+    {
+        return std::unique_ptr<pyatmibuf>(new pyatmibuf(atmibuf("UBF", 1024)));
+    }
+
+    if (py::isinstance<pyatmibuf>(data))
+    {
+        throw std::invalid_argument("AtmiBuf cannot be created from AtmiBuf");
+    }
+
+    return std::unique_ptr<pyatmibuf>(new pyatmibuf(ndrx_from_py(data)));
+}
+
+/**
+ * @brief Get buffer type
+ * @param h buffer handle
+ * @param sub return sub-type
+ * @return type or sub-type
+ */
+exprivate std::string atmibufh_type(pyatmibuf &h, bool sub)
+{
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+
+    if (nullptr==*h.buf.pp)
+    {
+        return sub?"":"NULL";
+    }
+
+    if (EXFAIL==tptypes(*h.buf.pp, type, subtype))
+    {
+        throw atmi_exception(tperrno);
+    }
+
+    return sub?subtype:type;
+}
+
+/**
+ * @brief Delete field occurrence
+ * @param h buffer handle
+ * @param key field id or name
+ * @param occ occurrence
+ */
+exprivate void atmibufh_del(pyatmibuf &h, py::handle key, BFLDOCC occ)
+{
+    if (EXSUCCEED!=Bdel(h.ubf(), ndrxpy_fldid(key), occ))
+    {
+        throw ubf_exception(Berror);
+    }
+}
+
+/**
+ * @brief Update buffer fields from the dict (Bupdate())
+ * @param h buffer handle
+ * @param data UBF dict (field/value lists)
+ */
+exprivate void atmibufh_update(pyatmibuf &h, py::dict data)
+{
+    atmibuf src;
+
+    h.ubf(); /* type check */
+    ndrxpy_from_py_ubf(data, src);
+
+    h.buf.mutate([&](UBFH *fbfr)
+        { return Bupdate(fbfr, *src.fbfr()); });
+}
+
+/**
+ * @brief Keep only given fields in the buffer (Bproj())
+ * @param h buffer handle
+ * @param fields list of field ids or names
+ */
+exprivate void atmibufh_project(pyatmibuf &h, py::list fields)
+{
+    std::vector<BFLDID> flds;
+    UBFH *p_ub = h.ubf();
+
+    for (auto f : fields)
+    {
+        flds.push_back(ndrxpy_fldid(f));
+    }
+    flds.push_back(BBADFLDID);
+
+    if (EXSUCCEED!=Bproj(p_ub, &flds[0]))
+    {
+        throw ubf_exception(Berror);
+    }
+}
+
+/**
+ * @brief Register AtmiBuf class
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_atmibuf(py::module &m)
+{
+    py::class_<pyatmibuf>(m, "AtmiBuf", R"pbdoc(
+        Native ATMI buffer handle. Buffer is kept in ATMI format and **UBF**
+        fields are read and changed in place, i.e. only touched fields are
+        converted between Python and C, instead of converting the whole buffer to
+        dictionary and back. Handle may be passed to any call accepting buffer
+        dictionary (e.g. :func:`.tpcall`, :func:`.tpreturn`, :func:`.tpforward`),
+        in which case buffer is used directly without conversion.
+
+        Services receive the request buffer handle in *args.buf*, thus reply may be
+        built by patching the request.
+
+        .. code-block:: python
+            :caption: AtmiBuf example
+            :name: AtmiBuf-example
+
+                def ECHO(self, args):
+                    b = args.buf
+                    b.set("T_STRING_FLD", 0, "HELLO")
+                    b.delete("T_LONG_FLD")
+                    b.update({"T_SHORT_FLD":[1, 2]})
+                    return e.tpreturn(e.TPSUCCESS, 0, b)
+
+        :raise UbfException: 
+            | Following error codes may be present:
+            | :data:`.BBADFLD` - Invalid field id.
+            | :data:`.BBADNAME` - Field name not found.
+            | :data:`.BNOTPRES` - Field occurrence not present.
+
+        Parameters
+        ----------
+        data : dict
+            Buffer dictionary, as used by :func:`.tpcall`. If not set, empty
+            **UBF** buffer is allocated.
+        )pbdoc")
+        .def(py::init(&atmibufh_new), py::arg("data") = py::none())
+        .def("get", [](pyatmibuf &h, py::handle key, BFLDOCC occ, const std::string &strenc)
+            {
+                ndrxpy_strenc_guard enc(strenc);
+                return ndrxpy_ubf_get(h.ubf(), ndrxpy_fldid(key), occ);
+            },
+            "Get field occurrence value", py::arg("field"), py::arg("occ") = 0,
+            py::arg("strenc") = "")
+        .def("set", [](pyatmibuf &h, py::handle key, BFLDOCC occ, py::handle value)
+            { h.ubf(); ndrxpy_ubf_set(h.buf, ndrxpy_fldid(key), occ, value); },
+            "Set field occurrence value", py::arg("field"), py::arg("occ"), py::arg("value"))
+        .def("delete", &atmibufh_del,
+            "Delete field occurrence", py::arg("field"), py::arg("occ") = 0)
+        .def("update", &atmibufh_update,
+            "Update buffer with fields from UBF dict (occurrences are replaced)",
+            py::arg("data"))
+        .def("project", &atmibufh_project,
+            "Remove all fields except listed ones", py::arg("fields"))
+        .def("occur", [](pyatmibuf &h, py::handle key)
+            {
+                BFLDOCC ret = Boccur(h.ubf(), ndrxpy_fldid(key));
+                if (EXFAIL==ret)
+                {
+                    throw ubf_exception(Berror);
+                }
+                return ret;
+            },
+            "Get number of field occurrences", py::arg("field"))
+        .def("__contains__", [](pyatmibuf &h, py::handle key)
+            { return EXTRUE==Bpres(h.ubf(), ndrxpy_fldid(key), 0); })
+        .def("todict", [](pyatmibuf &h, const std::string &strenc)
+            {
+                ndrxpy_strenc_guard enc(strenc);
+                return ndrx_to_py(h.buf);
+            },
+            "Convert buffer to standard buffer dictionary", py::arg("strenc") = "")
+        .def_property_readonly("buftype", [](pyatmibuf &h) { return atmibufh_type(h, false); })
+        .def_property_readonly("subtype", [](pyatmibuf &h) { return atmibufh_type(h, true); })
+        .def_property_readonly("used", [](pyatmibuf &h) 
+            { return static_cast<long>(Bused(h.ubf())); });
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
@@ -0,0 +1,536 @@
+/**
+ * @brief Binary ATMI buffer snapshots, record files
+ *
+ * @file bufsnap.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <atmi.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_SNAP_MAGIC       "NXS1"  /**< record magic, format version 1 */
+#define NDRXPY_SNAP_ALIGN       8       /**< record alignment               */
+
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Snapshot record header, followed by buffer image of len bytes,
+ *  padded to NDRXPY_SNAP_ALIGN. Size is multiple of alignment, thus
+ *  buffer images in mapped files are aligned.
+ */
+typedef struct
+{
+    char magic[4];      /**< NDRXPY_SNAP_MAGIC                      */
+    uint32_t len;       /**< buffer image length                    */
+    char type[8];       /**< buffer type                            */
+    char subtype[40];   /**< buffer sub-type (VIEW name)            */
+} ndrxpy_snaphdr_t;
+
+/**
+ * @brief Appends buffers to record file
+ */
+class ndrxpy_snapwriter
+{
+public:
+
+    std::string path;   /**< file name                  */
+    long records;       /**< records written            */
+
+    ndrxpy_snapwriter(const std::string &path) : path(path), records(0)
+    {
+        fd = open(path.c_str(), O_WRONLY|O_CREAT|O_APPEND, 0666);
+
+        if (EXFAIL==fd)
+        {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            throw py::error_already_set();
+        }
+    }
+
+    ~ndrxpy_snapwriter()
+    {
+        close();
+    }
+
+    /**
+     * @brief Write buffer as one record (single write of header and image)
+     * @param data buffer dict or AtmiBuf
+     * @return record length in file
+     */
+    long write(py::object data)
+    {
+        ndrxpy_snaphdr_t hdr;
+        char pad[NDRXPY_SNAP_ALIGN]={EXEOS};
+        struct iovec iov[3];
+        long len;
+        ssize_t ret;
+
+        if (EXFAIL==fd)
+        {
+            throw std::invalid_argument("Snapshot file is closed");
+        }
+
+        auto in = ndrx_from_py(data);
+        len = image(in, hdr);
+
+        iov[0].iov_base = &hdr;
+        iov[0].iov_len = sizeof(hdr);
+        iov[1].iov_base = *in.pp;
+        iov[1].iov_len = len;
+        iov[2].iov_base = pad;
+        iov[2].iov_len = (NDRXPY_SNAP_ALIGN - len % NDRXPY_SNAP_ALIGN) % NDRXPY_SNAP_ALIGN;
+
+        {
+            py::gil_scoped_release release;
+            ret = writev(fd, iov, 3);
+        }
+
+        if (ret < 0)
+        {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            throw py::error_already_set();
+        }
+        else if (static_cast<size_t>(ret)!=iov[0].iov_len+iov[1].iov_len+iov[2].iov_len)
+        {
+            throw std::runtime_error("Short write to snapshot file "+path);
+        }
+
+        records++;
+
+        return ret;
+    }
+
+    /**
+     * @brief Close the file
+     */
+    void close(void)
+    {
+        if (EXFAIL!=fd)
+        {
+            ::close(fd);
+            fd = EXFAIL;
+        }
+    }
+
+private:
+
+    int fd;
+
+    /**
+     * @brief Fill record header and return image length of the buffer
+     * @param in ATMI buffer
+     * @param hdr header to fill
+     * @return image length
+     */
+    long image(atmibuf &in, ndrxpy_snaphdr_t &hdr)
+    {
+        char subtype[XATMI_SUBTYPE_LEN+1]={EXEOS};
+        long len;
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, NDRXPY_SNAP_MAGIC, sizeof(hdr.magic));
+
+        if (nullptr==*in.pp)
+        {
+            NDRX_STRCPY_SAFE(hdr.type, "NULL");
+            hdr.len = 0;
+            return 0;
+        }
+
+        if (EXFAIL==(len=tptypes(*in.pp, hdr.type, subtype)))
+        {
+            throw atmi_exception(tperrno);
+        }
+
+        NDRX_STRCPY_SAFE(hdr.subtype, subtype);
+
+        if (0==strcmp(hdr.type, "UBF"))
+        {
+            UBFH *p_ub = *in.fbfr();
+            BFLDID fldid = BFIRSTFLDID;
+            BFLDOCC occ;
+            int ret;
+
+            /* pointers cannot be persisted */
+            while (1==(ret=Bnext(p_ub, &fldid, &occ, NULL, NULL)))
+            {
+                if (BFLD_PTR==Bfldtype(fldid))
+                {
+                    throw std::invalid_argument("UBF buffers with PTR fields "
+                        "cannot be written to snapshot");
+                }
+            }
+
+            if (EXFAIL==ret)
+            {
+                throw ubf_exception(Berror);
+            }
+
+            len = Bused(p_ub);
+        }
+        else if (0==strcmp(hdr.type, "STRING") || 0==strcmp(hdr.type, "JSON"))
+        {
+            len = strlen(*in.pp)+1;
+        }
+        else if (0==strcmp(hdr.type, "CARRAY") || 0==strcmp(hdr.type, "X_OCTET"))
+        {
+            len = in.len;
+        }
+        else if (0==strcmp(hdr.type, "NULL"))
+        {
+            len = 0;
+        }
+        /* VIEW: whole structure, as allocated */
+
+        hdr.len = len;
+
+        return len;
+    }
+};
+
+/**
+ * @brief Memory mapped record file reader. Records are loaded into
+ *  ATMI buffers directly, without conversion to Python.
+ */
+class ndrxpy_snapreader
+{
+public:
+
+    std::string path;   /**< file name                  */
+    long pos;           /**< current record             */
+
+    ndrxpy_snapreader(const std::string &path) : path(path), pos(0), 
+        map(nullptr), size(0)
+    {
+        struct stat st;
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (EXFAIL==fd)
+        {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            throw py::error_already_set();
+        }
+
+        if (EXSUCCEED!=fstat(fd, &st))
+        {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            ::close(fd);
+            throw py::error_already_set();
+        }
+
+        size = st.st_size;
+
+        if (size > 0)
+        {
+            map = reinterpret_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
+
+            if (MAP_FAILED==map)
+            {
+                map = nullptr;
+                PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+                ::close(fd);
+                throw py::error_already_set();
+            }
+        }
+
+        ::close(fd);
+        index();
+    }
+
+    ~ndrxpy_snapreader()
+    {
+        close();
+    }
+
+    /**
+     * @return number of records
+     */
+    long count(void)
+    {
+        return offs.size();
+    }
+
+    /**
+     * @brief Load record into ATMI buffer
+     * @param i record number (negative counts from the end)
+     * @return AtmiBuf handle
+     */
+    py::object get(long i)
+    {
+        if (i < 0)
+        {
+            i+=offs.size();
+        }
+
+        if (i < 0 || i >= static_cast<long>(offs.size()))
+        {
+            throw py::index_error("Record index out of range");
+        }
+
+        const ndrxpy_snaphdr_t *hdr = 
+            reinterpret_cast<const ndrxpy_snaphdr_t *>(map + offs[i]);
+        char *img = map + offs[i] + sizeof(ndrxpy_snaphdr_t);
+        atmibuf b;
+
+        if (0==strcmp(hdr->type, "NULL"))
+        {
+            b.reinit("NULL", nullptr, 0);
+        }
+        else if (0==strcmp(hdr->type, "UBF"))
+        {
+            b.reinit("UBF", nullptr, hdr->len);
+
+            if (EXSUCCEED!=Bcpy(*b.fbfr(), reinterpret_cast<UBFH *>(img)))
+            {
+                throw ubf_exception(Berror);
+            }
+        }
+        else
+        {
+            b.reinit(hdr->type, EXEOS!=hdr->subtype[0]?hdr->subtype:nullptr, hdr->len);
+            memcpy(*b.pp, img, hdr->len);
+        }
+
+        return py::cast(new pyatmibuf(std::move(b)), py::return_value_policy::take_ownership);
+    }
+
+    /**
+     * @return next record, StopIteration at the end
+     */
+    py::object next(void)
+    {
+        if (pos >= static_cast<long>(offs.size()))
+        {
+            throw py::stop_iteration();
+        }
+
+        return get(pos++);
+    }
+
+    /**
+     * @brief Position to record
+     * @param i record number
+     */
+    void seek(long i)
+    {
+        if (i < 0 || i > static_cast<long>(offs.size()))
+        {
+            throw py::index_error("Record index out of range");
+        }
+        pos = i;
+    }
+
+    /**
+     * @brief Unmap the file
+     */
+    void close(void)
+    {
+        if (nullptr!=map)
+        {
+            munmap(map, size);
+            map = nullptr;
+        }
+        offs.clear();
+        pos = 0;
+    }
+
+private:
+
+    char *map;                  /**< mapped file                */
+    size_t size;                /**< file size                  */
+    std::vector<size_t> offs;   /**< record offsets             */
+
+    /**
+     * @brief Build record index, by walking record headers.
+     *  Partially written record at the end is ignored.
+     */
+    void index(void)
+    {
+        size_t off = 0;
+
+        while (off + sizeof(ndrxpy_snaphdr_t) <= size)
+        {
+            const ndrxpy_snaphdr_t *hdr = 
+                reinterpret_cast<const ndrxpy_snaphdr_t *>(map + off);
+            size_t reclen = sizeof(ndrxpy_snaphdr_t) + hdr->len;
+
+            reclen+=(NDRXPY_SNAP_ALIGN - reclen % NDRXPY_SNAP_ALIGN) % NDRXPY_SNAP_ALIGN;
+
+            if (0!=memcmp(hdr->magic, NDRXPY_SNAP_MAGIC, sizeof(hdr->magic))
+                || EXEOS!=hdr->type[sizeof(hdr->type)-1]
+                || EXEOS!=hdr->subtype[sizeof(hdr->subtype)-1])
+            {
+                NDRX_LOG(log_error, "Invalid snapshot record at offset %ld in [%s]", 
+                    static_cast<long>(off), path.c_str());
+                throw std::invalid_argument("Invalid snapshot record in "+path);
+            }
+
+            if (off + reclen > size)
+            {
+                NDRX_LOG(log_warn, "Incomplete snapshot record at offset %ld in [%s], ignored", 
+                    static_cast<long>(off), path.c_str());
+                break;
+            }
+
+            offs.push_back(off);
+            off+=reclen;
+        }
+
+        NDRX_LOG(log_debug, "Snapshot file [%s] records: %ld", path.c_str(), 
+            static_cast<long>(offs.size()));
+    }
+};
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+/*---------------------------Prototypes---------------------------------*/
+
+/**
+ * @brief Register snapshot file classes
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_bufsnap(py::module &m)
+{
+    py::class_<ndrxpy_snapwriter>(m, "BufSnapWriter", R"pbdoc(
+        Append-only binary record file of ATMI buffers. Each record is
+        written with single **writev(2)** call and consists of small header
+        and binary image of the buffer (**UBF** buffer used bytes, **VIEW**
+        structure, or the data of **STRING**, **JSON**, **CARRAY**, **X_OCTET**).
+        The file may be read by :class:`.BufSnapReader`. Image format is
+        platform dependent, i.e. files shall be read on the same platform and
+        the same UBF/VIEW definitions.
+
+        .. code-block:: python
+            :caption: BufSnapWriter example
+            :name: BufSnapWriter-example
+
+                import endurox as e
+
+                with e.BufSnapWriter("/tmp/traffic.snap") as w:
+                    w.write({"data":{"T_STRING_FLD":"Hi Jim"}})
+
+        :raise OSError: 
+            | File open or write failed.
+        :raise ValueError: 
+            | UBF buffer contains **BFLD_PTR** fields.
+
+        Parameters
+        ----------
+        path : str
+            Record file name, created if does not exist.
+        )pbdoc")
+        .def(py::init([](const std::string &path)
+            {
+                return std::unique_ptr<ndrxpy_snapwriter>(new ndrxpy_snapwriter(path));
+            }), py::arg("path"))
+        .def("write", &ndrxpy_snapwriter::write,
+            "Append buffer (dict or AtmiBuf) as record, returns bytes written",
+            py::arg("data"))
+        .def("close", &ndrxpy_snapwriter::close, "Close the file")
+        .def("__enter__", [](py::object self) { return self; })
+        .def("__exit__", [](ndrxpy_snapwriter &w, py::object exc_type,
+                py::object exc_value, py::object traceback) { w.close(); })
+        .def_readonly("path", &ndrxpy_snapwriter::path)
+        .def_readonly("records", &ndrxpy_snapwriter::records);
+
+    py::class_<ndrxpy_snapreader>(m, "BufSnapReader", R"pbdoc(
+        Memory mapped reader of record file written by :class:`.BufSnapWriter`.
+        Records are loaded into ATMI buffers and returned as :class:`.AtmiBuf`
+        handles, which may be sent by :func:`.tpcall` and similar calls without
+        conversion to Python dictionaries. Records may be accessed by index, or
+        iterated from the current position (see :meth:`seek`).
+
+        .. code-block:: python
+            :caption: BufSnapReader example
+            :name: BufSnapReader-example
+
+                import endurox as e
+
+                with e.BufSnapReader("/tmp/traffic.snap") as r:
+                    for b in r:
+                        e.tpacall("TESTSV", b, e.TPNOREPLY)
+
+        :raise OSError: 
+            | File open or mapping failed.
+        :raise ValueError: 
+            | File is not a snapshot record file.
+
+        Parameters
+        ----------
+        path : str
+            Record file name.
+        )pbdoc")
+        .def(py::init([](const std::string &path)
+            {
+                return std::unique_ptr<ndrxpy_snapreader>(new ndrxpy_snapreader(path));
+            }), py::arg("path"))
+        .def("__len__", &ndrxpy_snapreader::count)
+        .def("__getitem__", &ndrxpy_snapreader::get, py::arg("i"))
+        .def("__iter__", [](py::object self) { return self; })
+        .def("__next__", &ndrxpy_snapreader::next)
+        .def("seek", &ndrxpy_snapreader::seek, 
+            "Set position of the next record returned by iteration", py::arg("i"))
+        .def("tell", [](ndrxpy_snapreader &r) { return r.pos; },
+            "Position of the next record returned by iteration")
+        .def("close", &ndrxpy_snapreader::close, "Unmap the file")
+        .def("__enter__", [](py::object self) { return self; })
+        .def("__exit__", [](ndrxpy_snapreader &r, py::object exc_type,
+                py::object exc_value, py::object traceback) { r.close(); })
+        .def_readonly("path", &ndrxpy_snapreader::path);
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
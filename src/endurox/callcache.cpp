@@ -0,0 +1,809 @@
+/**
+ * @brief Client side tpcall() reply cache and call coalescing
+ *
+ * @file callcache.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <string.h>
+
+#include <atmi.h>
+#include <userlog.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief FNV-1a hash of the raw request
+ */
+struct ndrxpy_rawhash
+{
+    size_t operator()(const std::string &s) const noexcept
+    {
+        unsigned long long h = 14695981039346656037ULL;
+
+        for (unsigned char c : s)
+        {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+
+        return static_cast<size_t>(h);
+    }
+};
+
+/**
+ * @brief Cached reply
+ */
+typedef struct
+{
+    std::string key;            /**< raw request                    */
+    std::string type;           /**< reply buffer type              */
+    std::string subtype;        /**< reply buffer sub-type          */
+    long size;                  /**< reply buffer allocation size   */
+    std::string data;           /**< reply buffer used bytes        */
+    long urcode;                /**< tpurcode of the reply          */
+    long long expires;          /**< expiry time, ms monotonic      */
+} ndrxpy_ccentry_t;
+
+/**
+ * @brief Cache of the service
+ */
+typedef struct
+{
+    long ttl;                   /**< time to live, ms               */
+    long max_entries;           /**< max entries, 0 - unlimited     */
+    long max_bytes;             /**< max bytes, 0 - unlimited       */
+    long bytes;                 /**< bytes used by entries          */
+    /** entries, most recently used first */
+    std::list<ndrxpy_ccentry_t> lru;
+    /** entries by raw request */
+    std::unordered_map<std::string, std::list<ndrxpy_ccentry_t>::iterator,
+        ndrxpy_rawhash> idx;
+    long hits;
+    long misses;
+    long evictions;
+    long expired;
+} ndrxpy_callcache_t;
+
+/**
+ * @brief Call in progress, shared by identical concurrent calls
+ */
+struct ndrxpy_flight
+{
+    std::string key;            /**< service, flags and raw request */
+    bool done = false;          /**< leader completed the call      */
+    int err = 0;                /**< tperrno of the call, 0 - ok    */
+    bool has_reply = false;     /**< reply image is set             */
+    ndrxpy_ccentry_t reply;     /**< reply image                    */
+};
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+
+/** protects the caches */
+exprivate std::mutex M_callcache_mutex;
+
+/** caches by service name */
+exprivate std::map<std::string, ndrxpy_callcache_t*> M_callcache {};
+
+/** any service cached, avoids lock on normal calls */
+exprivate std::atomic<bool> M_callcache_used {false};
+
+/** protects the flights */
+exprivate std::mutex M_flight_mutex;
+
+/** flight completed */
+exprivate std::condition_variable M_flight_cv;
+
+/** services with coalesced calls */
+exprivate std::set<std::string> M_flight_svcs {};
+
+/** calls in progress by key */
+exprivate std::unordered_map<std::string, std::shared_ptr<ndrxpy_flight>,
+        ndrxpy_rawhash> M_flights {};
+
+/** any service coalesced, avoids lock on normal calls */
+exprivate std::atomic<bool> M_flight_used {false};
+
+exprivate long M_flight_leaders = 0;    /**< calls performed            */
+exprivate long M_flight_followers = 0;  /**< calls joined to the leader */
+
+/*---------------------------Prototypes---------------------------------*/
+
+/**
+ * @return monotonic time in milliseconds
+ */
+exprivate long long callcache_now(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Get raw image of the buffer (type, sub-type and used bytes)
+ * @param p ATMI buffer
+ * @param len buffer length
+ * @param raw [out] raw image
+ * @param size [out] allocation size
+ * @param type [out] buffer type
+ * @param subtype [out] buffer sub-type
+ * @return EXSUCCEED/EXFAIL
+ */
+exprivate int callcache_raw(char *p, long len, std::string &raw, long *size,
+        char *type, char *subtype)
+{
+    long used;
+
+    if (nullptr==p)
+    {
+        strcpy(type, "NULL");
+        *size = 0;
+        raw.assign(type);
+        return EXSUCCEED;
+    }
+
+    if (EXFAIL==(*size=tptypes(p, type, subtype)))
+    {
+        return EXFAIL;
+    }
+
+    if (0==strcmp(type, "UBF"))
+    {
+        used = Bused(reinterpret_cast<UBFH *>(p));
+    }
+    else if (0==strcmp(type, "STRING") || 0==strcmp(type, "JSON"))
+    {
+        used = strlen(p)+1;
+    }
+    else if (0==strcmp(type, "VIEW"))
+    {
+        used = *size;
+    }
+    else
+    {
+        used = len;
+    }
+
+    if (used < 0)
+    {
+        return EXFAIL;
+    }
+
+    raw.reserve(used+24);
+    raw.assign(type);
+    raw.push_back(EXEOS);
+    raw.append(subtype);
+    raw.push_back(EXEOS);
+    raw.append(p, used);
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Save reply buffer image to the entry
+ * @param out reply buffer
+ * @param e [out] entry, type, sub-type, size and data are set
+ * @return EXSUCCEED/EXFAIL
+ */
+exprivate int callcache_save(atmibuf &out, ndrxpy_ccentry_t &e)
+{
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+
+    if (EXSUCCEED!=callcache_raw(*out.pp, out.len, e.data, &e.size, type, subtype))
+    {
+        return EXFAIL;
+    }
+
+    /* raw image has type prefix, store data only */
+    if (nullptr!=*out.pp)
+    {
+        e.data.erase(0, strlen(type)+strlen(subtype)+2);
+    }
+    else
+    {
+        e.data.clear();
+    }
+
+    e.type = type;
+    e.subtype = subtype;
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Restore reply buffer from the entry image
+ * @param e entry
+ * @param out [out] new reply buffer
+ */
+exprivate void callcache_load(ndrxpy_ccentry_t &e, atmibuf &out)
+{
+    if (e.type=="NULL")
+    {
+        out.reinit("NULL", nullptr, 0);
+    }
+    else
+    {
+        out.reinit(e.type.c_str(), e.subtype.empty()?nullptr:e.subtype.c_str(), e.size);
+        memcpy(*out.pp, e.data.data(), e.data.size());
+        out.len = e.data.size();
+    }
+}
+
+/**
+ * @brief Remove least recently used entries over the limits
+ * @param cc service cache
+ */
+exprivate void callcache_trim(ndrxpy_callcache_t *cc)
+{
+    while (!cc->lru.empty() &&
+        ((cc->max_entries > 0 && static_cast<long>(cc->lru.size()) > cc->max_entries) ||
+         (cc->max_bytes > 0 && cc->bytes > cc->max_bytes)))
+    {
+        auto &e = cc->lru.back();
+        cc->bytes -= e.key.size() + e.data.size();
+        cc->idx.erase(e.key);
+        cc->lru.pop_back();
+        cc->evictions++;
+    }
+}
+
+/**
+ * @brief Drop all entries of the cache
+ * @param cc service cache
+ */
+exprivate void callcache_clear(ndrxpy_callcache_t *cc)
+{
+    cc->idx.clear();
+    cc->lru.clear();
+    cc->bytes = 0;
+}
+
+/**
+ * @brief Lookup reply in cache. GIL held.
+ * @param svc service name
+ * @param in request buffer
+ * @param key [out] raw request, empty if service is not cached
+ * @param out [out] cached reply
+ * @param urcode [out] cached user return code
+ * @return true on hit
+ */
+expublic bool ndrxpy_callcache_get(const char *svc, atmibuf &in, std::string &key,
+        atmibuf &out, long *urcode)
+{
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+    long size;
+
+    if (!M_callcache_used.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(M_callcache_mutex);
+
+        if (M_callcache.end()==M_callcache.find(svc))
+        {
+            return false;
+        }
+    }
+
+    /* global transaction shall see the current data */
+    if (tpgetlev() > 0)
+    {
+        return false;
+    }
+
+    if (EXSUCCEED!=callcache_raw(*in.pp, in.len, key, &size, type, subtype))
+    {
+        key.clear();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(M_callcache_mutex);
+
+    auto cit = M_callcache.find(svc);
+
+    if (M_callcache.end()==cit)
+    {
+        key.clear();
+        return false;
+    }
+
+    ndrxpy_callcache_t *cc = cit->second;
+    auto it = cc->idx.find(key);
+
+    if (cc->idx.end()==it)
+    {
+        cc->misses++;
+        return false;
+    }
+
+    auto e = it->second;
+
+    if (e->expires <= callcache_now())
+    {
+        cc->bytes -= e->key.size() + e->data.size();
+        cc->lru.erase(e);
+        cc->idx.erase(it);
+        cc->expired++;
+        cc->misses++;
+        return false;
+    }
+
+    callcache_load(*e, out);
+
+    *urcode = e->urcode;
+
+    /* most recently used */
+    cc->lru.splice(cc->lru.begin(), cc->lru, e);
+    cc->hits++;
+
+    return true;
+}
+
+/**
+ * @brief Store reply of the successful call
+ * @param svc service name
+ * @param key raw request returned by ndrxpy_callcache_get()
+ * @param out reply buffer
+ * @param urcode user return code
+ */
+expublic void ndrxpy_callcache_put(const char *svc, std::string &key, atmibuf &out, long urcode)
+{
+    ndrxpy_ccentry_t e;
+
+    if (EXSUCCEED!=callcache_save(out, e))
+    {
+        return;
+    }
+
+    e.urcode = urcode;
+
+    std::lock_guard<std::mutex> lock(M_callcache_mutex);
+
+    auto cit = M_callcache.find(svc);
+
+    if (M_callcache.end()==cit)
+    {
+        return;
+    }
+
+    ndrxpy_callcache_t *cc = cit->second;
+
+    /* other thread may have stored it */
+    auto it = cc->idx.find(key);
+
+    if (cc->idx.end()!=it)
+    {
+        cc->bytes -= it->second->key.size() + it->second->data.size();
+        cc->lru.erase(it->second);
+        cc->idx.erase(it);
+    }
+
+    e.expires = callcache_now() + cc->ttl;
+    e.key.swap(key);
+
+    cc->bytes += e.key.size() + e.data.size();
+    cc->lru.push_front(std::move(e));
+    cc->idx[cc->lru.front().key] = cc->lru.begin();
+
+    callcache_trim(cc);
+}
+
+/**
+ * @brief Join identical call in progress or start a new one. GIL held.
+ * @param svc service name
+ * @param flags call flags
+ * @param in request buffer
+ * @param leader [out] true if caller shall perform the call and complete
+ *  the flight with ndrxpy_callflight_end(), false if caller shall wait for
+ *  the reply with ndrxpy_callflight_wait()
+ * @return flight or nullptr if service calls are not coalesced
+ */
+expublic std::shared_ptr<ndrxpy_flight> ndrxpy_callflight_begin(const char *svc,
+        long flags, atmibuf &in, bool *leader)
+{
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+    long size;
+    std::string raw;
+
+    if (!M_flight_used.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(M_flight_mutex);
+
+        if (M_flight_svcs.end()==M_flight_svcs.find(svc))
+        {
+            return nullptr;
+        }
+    }
+
+    /* transactional calls are not shared */
+    if (tpgetlev() > 0 ||
+        EXSUCCEED!=callcache_raw(*in.pp, in.len, raw, &size, type, subtype))
+    {
+        return nullptr;
+    }
+
+    std::string key(svc);
+    key.push_back(EXEOS);
+    key.append(reinterpret_cast<char *>(&flags), sizeof(flags));
+    key.append(raw);
+
+    std::lock_guard<std::mutex> lock(M_flight_mutex);
+
+    auto it = M_flights.find(key);
+
+    if (M_flights.end()!=it)
+    {
+        *leader = false;
+        M_flight_followers++;
+        return it->second;
+    }
+
+    auto f = std::make_shared<ndrxpy_flight>();
+    f->key.swap(key);
+    M_flights[f->key] = f;
+    *leader = true;
+    M_flight_leaders++;
+
+    return f;
+}
+
+/**
+ * @brief Complete the call and wake up the followers. GIL not required.
+ * @param f flight
+ * @param err tperrno of the call, 0 - succeed
+ * @param out reply buffer, nullptr if not available
+ * @param urcode user return code
+ */
+expublic void ndrxpy_callflight_end(std::shared_ptr<ndrxpy_flight> &f, int err,
+        atmibuf *out, long urcode)
+{
+    f->err = err;
+
+    if (nullptr!=out && EXSUCCEED==callcache_save(*out, f->reply))
+    {
+        f->has_reply = true;
+        f->reply.urcode = urcode;
+    }
+    else if (0==err || TPESVCFAIL==err)
+    {
+        f->err = TPESYSTEM;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(M_flight_mutex);
+        f->done = true;
+        M_flights.erase(f->key);
+    }
+
+    M_flight_cv.notify_all();
+}
+
+/**
+ * @brief Wait for the leader to complete the call. GIL shall be released.
+ * @param f flight
+ * @param out [out] reply buffer (copy of the leader's reply)
+ * @param urcode [out] user return code
+ * @return tperrno of the call, 0 - succeed
+ */
+expublic int ndrxpy_callflight_wait(std::shared_ptr<ndrxpy_flight> &f, atmibuf &out,
+        long *urcode)
+{
+    {
+        std::unique_lock<std::mutex> lock(M_flight_mutex);
+        M_flight_cv.wait(lock, [&f]{ return f->done; });
+    }
+
+    /* reply image is not changed after done */
+    if (f->has_reply)
+    {
+        callcache_load(f->reply, out);
+        *urcode = f->reply.urcode;
+    }
+
+    return f->err;
+}
+
+/**
+ * @brief Register tpcall cache api
+ *
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_callcache(py::module &m)
+{
+    m.def(
+        "tpcallcache_config",
+        [](const std::string &svc, long ttl, long max_entries, long max_bytes)
+        {
+            if (ttl < 0 || max_entries < 0 || max_bytes < 0)
+            {
+                throw std::invalid_argument("Invalid cache limits");
+            }
+
+            std::lock_guard<std::mutex> lock(M_callcache_mutex);
+            auto it = M_callcache.find(svc);
+
+            if (0==ttl)
+            {
+                if (M_callcache.end()!=it)
+                {
+                    delete it->second;
+                    M_callcache.erase(it);
+                }
+            }
+            else
+            {
+                ndrxpy_callcache_t *cc;
+
+                if (M_callcache.end()!=it)
+                {
+                    cc = it->second;
+                }
+                else
+                {
+                    cc = new ndrxpy_callcache_t();
+                    cc->bytes = 0;
+                    cc->hits = cc->misses = cc->evictions = cc->expired = 0;
+                    M_callcache[svc] = cc;
+                }
+
+                cc->ttl = ttl;
+                cc->max_entries = max_entries;
+                cc->max_bytes = max_bytes;
+                callcache_trim(cc);
+            }
+
+            M_callcache_used = !M_callcache.empty();
+        },
+        R"pbdoc(
+        Configure client side reply cache of the service, used by :func:`.tpcall`.
+        Cache key is the request buffer image (type, sub-type and used data),
+        value is the reply buffer image, which is converted to Python on each hit.
+        Successful replies only are cached (:data:`.TPFAIL` replies and errors
+        are not). Calls in global transaction bypass the cache.
+
+        Cache is shared by the threads of the process. Least recently used entries
+        are removed when limits are reached.
+
+        Service shall be idempotent: cached reply is returned without calling
+        the service until *ttl* expires or the cache is invalidated by
+        :func:`.tpcallcache_invalidate`.
+
+        .. code-block:: python
+            :caption: tpcallcache_config example
+            :name: tpcallcache_config-example
+
+                import endurox as e
+
+                def notif(data):
+                    # CCYINV event subscribed by e.tpsubscribe("CCYINV", None, None)
+                    e.tpcallcache_invalidate("GETCCY")
+
+                e.tpsetunsol(notif)
+                e.tpsubscribe("CCYINV", None, None)
+                e.tpcallcache_config("GETCCY", 60000, 1000)
+                tperrno, tpurcode, retbuf = e.tpcall("GETCCY", {"data":{"T_STRING_FLD":"EUR"}})
+
+        :raise ValueError:
+            | Invalid limits.
+
+        Parameters
+        ----------
+        svc : str
+            Service name.
+        ttl : int
+            Time to live of the entry in milliseconds. **0** removes the cache
+            of the service.
+        max_entries : int
+            Max number of entries, **0** - unlimited.
+        max_bytes : int
+            Max bytes of requests and replies, **0** - unlimited.
+
+         )pbdoc",
+        py::arg("svc"), py::arg("ttl"), py::arg("max_entries")=1000,
+        py::arg("max_bytes")=0);
+
+    m.def(
+        "tpcallcache_invalidate",
+        [](py::object svc)
+        {
+            std::lock_guard<std::mutex> lock(M_callcache_mutex);
+
+            if (svc.is_none())
+            {
+                for (auto &it : M_callcache)
+                {
+                    callcache_clear(it.second);
+                }
+            }
+            else
+            {
+                auto it = M_callcache.find(svc.cast<std::string>());
+
+                if (M_callcache.end()!=it)
+                {
+                    callcache_clear(it->second);
+                }
+            }
+        },
+        R"pbdoc(
+        Drop cached replies. Typically called from the unsolicited message
+        handler (see :func:`.tpsetunsol`) of the event subscription, which
+        notifies changes of the reference data.
+
+        Parameters
+        ----------
+        svc : str
+            Service name, **None** - all services.
+
+         )pbdoc",
+        py::arg("svc")=py::none());
+
+    m.def(
+        "tpcallcache_stats",
+        [](void)
+        {
+            py::dict ret;
+            std::lock_guard<std::mutex> lock(M_callcache_mutex);
+
+            for (auto &it : M_callcache)
+            {
+                py::dict s;
+                s["hits"] = it.second->hits;
+                s["misses"] = it.second->misses;
+                s["entries"] = it.second->lru.size();
+                s["bytes"] = it.second->bytes;
+                s["evictions"] = it.second->evictions;
+                s["expired"] = it.second->expired;
+                ret[py::str(it.first)] = s;
+            }
+
+            return ret;
+        },
+        R"pbdoc(
+        Return reply cache statistics.
+
+        Returns
+        -------
+        stats : dict
+            Statistics by service name, dict of **hits**, **misses**,
+            **entries**, **bytes**, **evictions** (removed by limits) and
+            **expired** (removed by ttl).
+
+         )pbdoc");
+
+    m.def(
+        "tpcallflight_config",
+        [](const std::string &svc, bool enable)
+        {
+            std::lock_guard<std::mutex> lock(M_flight_mutex);
+
+            if (enable)
+            {
+                M_flight_svcs.insert(svc);
+            }
+            else
+            {
+                M_flight_svcs.erase(svc);
+            }
+
+            M_flight_used = !M_flight_svcs.empty();
+        },
+        R"pbdoc(
+        Enable coalescing of identical concurrent :func:`.tpcall` calls to the
+        service (single-flight). When threads of the process call the service
+        with the same request buffer image and flags while such call is in
+        progress, they do not call the service, but wait for the reply of the
+        call in progress. Each caller receives its own copy of the reply, converted
+        to Python. Errors of the call are raised to all callers.
+
+        Calls in global transaction are not coalesced.
+
+        .. code-block:: python
+            :caption: tpcallflight_config example
+            :name: tpcallflight_config-example
+
+                import endurox as e
+
+                e.tpcallflight_config("GETCCY")
+                tperrno, tpurcode, retbuf = e.tpcall("GETCCY", {"data":{"T_STRING_FLD":"EUR"}})
+
+        Parameters
+        ----------
+        svc : str
+            Service name.
+        enable : bool
+            **True** to coalesce calls, **False** to disable.
+
+         )pbdoc",
+        py::arg("svc"), py::arg("enable")=true);
+
+    m.def(
+        "tpcallflight_stats",
+        [](void)
+        {
+            py::dict ret;
+            std::lock_guard<std::mutex> lock(M_flight_mutex);
+
+            ret["leaders"] = M_flight_leaders;
+            ret["followers"] = M_flight_followers;
+            ret["inflight"] = M_flights.size();
+
+            return ret;
+        },
+        R"pbdoc(
+        Return call coalescing statistics.
+
+        Returns
+        -------
+        stats : dict
+            | **leaders** - calls performed.
+            | **followers** - calls which received reply of the leader.
+            | **inflight** - calls in progress now.
+
+         )pbdoc");
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
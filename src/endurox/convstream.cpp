@@ -0,0 +1,462 @@
+/**
+ * @brief Chunked streaming over conversational ATMI sessions
+ *
+ * @file convstream.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <atmi.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_CONVSTREAM_CHUNK     65536   /**< default chunk size */
+
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief File-like stream over conversation descriptor.
+ *  Data is moved in CARRAY chunks of fixed size. Outgoing chunk and incoming
+ *  chunk buffers are allocated once and reused for whole stream life time.
+ */
+class ndrxpy_convstream
+{
+public:
+
+    int cd;             /**< conversation descriptor               */
+    long chunk;         /**< chunk size                            */
+    long eofflags;      /**< flags for last chunk sent by close()  */
+    long revent;        /**< last event received                   */
+    long urcode;        /**< tpurcode at the event                 */
+    bool eof;           /**< incoming stream finished              */
+    bool closed;        /**< stream closed                         */
+
+    ndrxpy_convstream(int cd, long chunk, long eofflags)
+        : cd(cd), chunk(chunk), eofflags(eofflags), revent(0), urcode(0),
+          eof(false), closed(false), olen(0), ioff(0), ilen(0)
+    {
+        if (chunk <= 0)
+        {
+            throw std::invalid_argument("chunk_size must be positive");
+        }
+    }
+
+    /**
+     * @brief Write data to the stream. Full chunks are sent immediately,
+     *  the tail is kept in the outgoing chunk until next write(), flush()
+     *  or close().
+     * @param data buffer protocol object
+     * @return number of bytes accepted
+     */
+    long write(py::object data)
+    {
+        pybufview in(data);
+        char *src = in.buf();
+        long left = in.len();
+
+        chkopen();
+        obuf_init();
+
+        py::gil_scoped_release release;
+
+        while (left > 0)
+        {
+            long n = std::min(left, chunk - olen);
+
+            memcpy(*obuf.pp + olen, src, n);
+            olen+=n;
+            src+=n;
+            left-=n;
+
+            if (olen==chunk)
+            {
+                send(0);
+            }
+        }
+
+        return in.len();
+    }
+
+    /**
+     * @brief Send buffered tail, if any
+     */
+    void flush(void)
+    {
+        chkopen();
+
+        if (olen > 0)
+        {
+            py::gil_scoped_release release;
+            send(0);
+        }
+    }
+
+    /**
+     * @brief Read data into the given writable buffer.
+     * @param data writable buffer protocol object
+     * @return number of bytes read, 0 at the end of stream
+     */
+    long readinto(py::object data)
+    {
+        pybufview out(data, true);
+
+        chkopen();
+
+        return readraw(out.buf(), out.len(), false);
+    }
+
+    /**
+     * @brief Read up to size bytes, if size is negative, read till the
+     *  end of stream.
+     * @param size number of bytes to read
+     * @return data read
+     */
+    py::bytes read(long size)
+    {
+        chkopen();
+
+        if (size < 0)
+        {
+            std::string all;
+
+            while (true)
+            {
+                if (ioff < ilen)
+                {
+                    all.append(*ibuf.pp + ioff, ilen - ioff);
+                    ioff = ilen;
+                }
+                else if (eof)
+                {
+                    break;
+                }
+                else
+                {
+                    py::gil_scoped_release release;
+                    recv();
+                }
+            }
+
+            return py::bytes(all);
+        }
+
+        PyObject *ret = PyBytes_FromStringAndSize(nullptr, size);
+
+        if (nullptr==ret)
+        {
+            throw py::error_already_set();
+        }
+
+        long got;
+
+        try
+        {
+            got = readraw(PyBytes_AS_STRING(ret), size, true);
+        }
+        catch (...)
+        {
+            Py_DECREF(ret);
+            throw;
+        }
+
+        /* on failure ret is freed and set to NULL */
+        if (got!=size && EXSUCCEED!=_PyBytes_Resize(&ret, got))
+        {
+            throw py::error_already_set();
+        }
+
+        return py::reinterpret_steal<py::bytes>(ret);
+    }
+
+    /**
+     * @brief Finish the stream. Buffered data is sent with eofflags
+     *  (by default TPRECVONLY, which gives control to the peer which sees
+     *  this as end of stream).
+     */
+    void close(void)
+    {
+        if (closed)
+        {
+            return;
+        }
+
+        closed = true;
+
+        if (nullptr!=*obuf.pp && (olen > 0 || eofflags))
+        {
+            py::gil_scoped_release release;
+            send(eofflags);
+        }
+    }
+
+private:
+
+    atmibuf obuf;       /**< outgoing chunk                        */
+    long olen;          /**< bytes filled in outgoing chunk        */
+    atmibuf ibuf;       /**< incoming chunk                        */
+    long ioff;          /**< read offset in incoming chunk         */
+    long ilen;          /**< data bytes in incoming chunk          */
+
+    void chkopen(void)
+    {
+        if (closed)
+        {
+            throw std::invalid_argument("I/O operation on closed stream");
+        }
+    }
+
+    void obuf_init(void)
+    {
+        if (nullptr==*obuf.pp)
+        {
+            obuf.reinit("CARRAY", nullptr, chunk);
+        }
+    }
+
+    /**
+     * @brief Send current outgoing chunk (GIL released)
+     * @param flags ATMI flags
+     */
+    void send(long flags)
+    {
+        long ev = 0;
+
+        if (EXFAIL==tpsend(cd, *obuf.pp, olen, flags, &ev))
+        {
+            int err = tperrno;
+
+            if (TPEEVENT==err)
+            {
+                revent = ev;
+                urcode = tpurcode;
+                eof = true;
+            }
+
+            NDRX_LOG(log_error, "Stream cd=%d send failed: %s", cd, tpstrerror(err));
+            throw atmi_exception(err);
+        }
+
+        olen = 0;
+    }
+
+    /**
+     * @brief Receive next chunk (GIL released). Any event finishes
+     *  the incoming stream, data delivered with the event is still readable.
+     */
+    void recv(void)
+    {
+        char type[8]={EXEOS};
+        char subtype[16]={EXEOS};
+        long ev = 0;
+        long len = 0;
+
+        if (nullptr==*ibuf.pp)
+        {
+            ibuf.reinit("CARRAY", nullptr, chunk);
+        }
+
+        ioff = 0;
+        ilen = 0;
+
+        if (EXFAIL==tprecv(cd, ibuf.pp, &len, 0, &ev))
+        {
+            int err = tperrno;
+
+            if (TPEEVENT!=err)
+            {
+                throw atmi_exception(err);
+            }
+
+            revent = ev;
+            urcode = tpurcode;
+            eof = true;
+
+            if (TPEV_SENDONLY!=ev && TPEV_SVCSUCC!=ev && TPEV_SVCFAIL!=ev)
+            {
+                return;
+            }
+        }
+
+        if (nullptr==*ibuf.pp || EXFAIL==tptypes(*ibuf.pp, type, subtype) ||
+                0==strcmp(type, "NULL"))
+        {
+            return;
+        }
+
+        if (0!=strcmp(type, "CARRAY") && 0!=strcmp(type, "X_OCTET"))
+        {
+            NDRX_LOG(log_error, "Stream cd=%d expected CARRAY chunk, got [%s]", cd, type);
+            throw std::invalid_argument("Stream expects CARRAY chunks");
+        }
+
+        ilen = len;
+    }
+
+    /**
+     * @brief Copy received data into memory block
+     * @param dst output memory
+     * @param want bytes wanted
+     * @param fill_all wait for all bytes (or end of stream)
+     * @return bytes copied
+     */
+    long readraw(char *dst, long want, bool fill_all)
+    {
+        long got = 0;
+
+        py::gil_scoped_release release;
+
+        while (got < want)
+        {
+            if (ioff < ilen)
+            {
+                long n = std::min(want - got, ilen - ioff);
+                memcpy(dst + got, *ibuf.pp + ioff, n);
+                ioff+=n;
+                got+=n;
+            }
+            else if (eof || (got > 0 && !fill_all))
+            {
+                break;
+            }
+            else
+            {
+                recv();
+            }
+        }
+
+        return got;
+    }
+};
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+/*---------------------------Prototypes---------------------------------*/
+
+/**
+ * @brief Register conversational stream class
+ *
+ * @param m Pybind11 module
+ */
+expublic void ndrxpy_register_convstream(py::module &m)
+{
+    py::class_<ndrxpy_convstream>(m, "ConvStream", R"pbdoc(
+        File-like byte stream over conversation descriptor returned by
+        :func:`.tpconnect` (or received in service call *cd* field).
+        Data is transferred in fixed size **CARRAY** chunks, the chunk buffers
+        are allocated once, thus memory usage is bounded by chunk size regardless
+        of the total amount of data streamed. Python dictionaries are not
+        built for the chunks.
+
+        Incoming stream ends when any conversational event is received (e.g.
+        :data:`.TPEV_SENDONLY` or :data:`.TPEV_SVCSUCC`). Event code is available in
+        :attr:`revent` and return code of the service in :attr:`tpurcode`.
+
+        .. code-block:: python
+            :caption: ConvStream example
+            :name: ConvStream-example
+
+                import shutil
+                import endurox as e
+
+                cd = e.tpconnect("EXPORTSV", {}, e.TPSENDONLY)
+                with e.ConvStream(cd) as conv, open("/tmp/data.bin", "rb") as f:
+                    shutil.copyfileobj(f, conv, 65536)
+
+                # server side, receive stream
+                def EXPORTSV(self, args):
+                    with open("/tmp/copy.bin", "wb") as f:
+                        shutil.copyfileobj(e.ConvStream(args.cd), f)
+                    return e.tpreturn(e.TPSUCCESS, 0, {})
+
+        :raise AtmiException:
+            | Errors of :func:`.tpsend` and :func:`.tprecv`, in case if peer
+            | sends event while writing, :data:`.TPEEVENT` is raised.
+
+        Parameters
+        ----------
+        cd : int
+            Conversation descriptor.
+        chunk_size : int
+            Size of the data chunk in bytes.
+        eofflags : int
+            Flags used by :meth:`close` for the last chunk. Default :data:`.TPRECVONLY`
+            passes control to the peer (which reads it as end of stream). Server which
+            finishes the stream with :func:`.tpreturn` shall use **0**.
+        )pbdoc")
+        .def(py::init([](int cd, long chunk_size, long eofflags)
+            {
+                return std::unique_ptr<ndrxpy_convstream>(
+                    new ndrxpy_convstream(cd, chunk_size, eofflags));
+            }),
+            py::arg("cd"), py::arg("chunk_size") = NDRXPY_CONVSTREAM_CHUNK,
+            py::arg("eofflags") = TPRECVONLY)
+        .def("write", &ndrxpy_convstream::write,
+            "Write bytes-like object, returns number of bytes written",
+            py::arg("data"))
+        .def("readinto", &ndrxpy_convstream::readinto,
+            "Read into writable bytes-like object, returns bytes read (0 at end of stream)",
+            py::arg("data"))
+        .def("read", &ndrxpy_convstream::read,
+            "Read up to size bytes, or till end of stream if size is negative",
+            py::arg("size") = -1)
+        .def("flush", &ndrxpy_convstream::flush, "Send buffered data")
+        .def("close", &ndrxpy_convstream::close, "Flush and finish the stream")
+        .def("readable", [](ndrxpy_convstream &s) { return true; })
+        .def("writable", [](ndrxpy_convstream &s) { return true; })
+        .def("seekable", [](ndrxpy_convstream &s) { return false; })
+        .def("__enter__", [](py::object self) { return self; })
+        .def("__exit__", [](ndrxpy_convstream &s, py::object exc_type,
+                py::object exc_value, py::object traceback) { s.close(); })
+        .def_readonly("cd", &ndrxpy_convstream::cd)
+        .def_readonly("chunk_size", &ndrxpy_convstream::chunk)
+        .def_readonly("revent", &ndrxpy_convstream::revent)
+        .def_readonly("tpurcode", &ndrxpy_convstream::urcode)
+        .def_readonly("eof", &ndrxpy_convstream::eof)
+        .def_readonly("closed", &ndrxpy_convstream::closed);
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
@@ -0,0 +1,456 @@
+/**
+ * @brief Pool of ATMI contexts for multi-threaded clients
+ *
+ * @file ctxpool.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <string.h>
+
+#include <atmi.h>
+#include <userlog.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Pre-initialized ATMI contexts, leased to threads
+ */
+class ndrxpy_ctxpool
+{
+public:
+
+    long size;      /**< contexts in pool               */
+    long waits;     /**< leases waited for the context  */
+    long leases;    /**< leases done                    */
+
+    /**
+     * @brief Create contexts and join them to application.
+     *  Context of the current thread is not changed. GIL not held.
+     * @param size number of contexts
+     * @param flags tpinit() flags
+     */
+    ndrxpy_ctxpool(long size, long flags) : size(0), waits(0), leases(0), closed(false)
+    {
+        TPCONTEXT_T prev;
+        int prevret;
+
+        if (size <= 0)
+        {
+            throw std::invalid_argument("Invalid pool size: " + std::to_string(size));
+        }
+
+        /* keep thread context */
+        if (EXFAIL==(prevret=tpgetctxt(&prev, 0)))
+        {
+            throw atmi_exception(tperrno);
+        }
+
+        try
+        {
+            for (long i=0; i<size; i++)
+            {
+                TPCONTEXT_T ctxt = tpnewctxt(false, true);
+                TPINIT init;
+
+                if (nullptr==ctxt)
+                {
+                    throw atmi_exception(TPESYSTEM);
+                }
+
+                /* context owned by the pool from here */
+                free.push_back(ctxt);
+                this->size++;
+
+                memset(&init, 0, sizeof(init));
+                init.flags = flags;
+
+                if (EXFAIL==tpinit(&init))
+                {
+                    throw atmi_exception(tperrno);
+                }
+
+                if (EXFAIL==tpgetctxt(&ctxt, 0))
+                {
+                    throw atmi_exception(tperrno);
+                }
+            }
+        }
+        catch (...)
+        {
+            tpsetctxt(TPNULLCONTEXT, 0);
+            release_all();
+            restore(prev, prevret);
+            throw;
+        }
+
+        restore(prev, prevret);
+    }
+
+    ~ndrxpy_ctxpool()
+    {
+        if (!closed)
+        {
+            py::gil_scoped_release release;
+            close_nogil();
+        }
+    }
+
+    /**
+     * @brief Bind pooled context to current thread
+     * @param timeout max wait in seconds, negative - wait forever
+     * @param prev [out] previous context of the thread
+     * @param prevret [out] tpgetctxt() result of previous context
+     * @return leased context
+     */
+    TPCONTEXT_T lease(double timeout, TPCONTEXT_T *prev, int *prevret)
+    {
+        TPCONTEXT_T ctxt;
+        py::gil_scoped_release release;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto ready = [this]{ return closed || !free.empty(); };
+
+            if (!ready())
+            {
+                waits++;
+
+                if (timeout < 0)
+                {
+                    cv.wait(lock, ready);
+                }
+                else if (!cv.wait_for(lock, std::chrono::duration<double>(timeout), ready))
+                {
+                    throw atmi_exception(TPETIME);
+                }
+            }
+
+            if (closed)
+            {
+                throw std::invalid_argument("Context pool is closed");
+            }
+
+            ctxt = free.back();
+            free.pop_back();
+            leases++;
+        }
+
+        /* module logger state follows the context */
+        if (EXFAIL==(*prevret=ndrxpy_tpgetctxt(prev, 0)) || EXSUCCEED!=ndrxpy_tpsetctxt(ctxt, 0))
+        {
+            int err = tperrno;
+
+            if (TPMULTICONTEXTS==*prevret)
+            {
+                ndrxpy_tpsetctxt(*prev, 0);
+            }
+
+            giveback(ctxt);
+            throw atmi_exception(err);
+        }
+
+        return ctxt;
+    }
+
+    /**
+     * @brief Unbind pooled context from current thread and restore
+     *  the previous one. Open transaction is aborted, so that next
+     *  user of the context starts clean.
+     * @param ctxt leased context
+     * @param prev previous context of the thread
+     * @param prevret tpgetctxt() result of previous context
+     */
+    void unlease(TPCONTEXT_T ctxt, TPCONTEXT_T prev, int prevret)
+    {
+        py::gil_scoped_release release;
+
+        if (tpgetlev() > 0)
+        {
+            NDRX_LOG(log_warn, "Pooled context released in transaction - aborting");
+            userlog(const_cast<char *>("Pooled context released in transaction - aborting"));
+            tpabort(0);
+        }
+
+        ndrxpy_tpgetctxt(&ctxt, 0);
+
+        if (TPMULTICONTEXTS==prevret)
+        {
+            ndrxpy_tpsetctxt(prev, 0);
+        }
+
+        giveback(ctxt);
+    }
+
+    /**
+     * @brief Terminate and free all contexts, GIL held
+     */
+    void close(void)
+    {
+        py::gil_scoped_release release;
+        close_nogil();
+    }
+
+    /**
+     * @return contexts available for lease
+     */
+    long available(void)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return free.size();
+    }
+
+private:
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<TPCONTEXT_T> free;  /**< contexts available        */
+    bool closed;                    /**< pool is closed            */
+
+    /**
+     * @brief Return context to pool
+     * @param ctxt context
+     */
+    void giveback(TPCONTEXT_T ctxt)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!closed)
+            {
+                free.push_back(ctxt);
+                ctxt = nullptr;
+            }
+        }
+
+        if (nullptr!=ctxt)
+        {
+            /* pool closed while leased */
+            free_ctx(ctxt);
+        }
+
+        cv.notify_one();
+    }
+
+    /**
+     * @brief Restore thread context saved by tpgetctxt()
+     */
+    void restore(TPCONTEXT_T prev, int prevret)
+    {
+        if (TPMULTICONTEXTS==prevret)
+        {
+            tpsetctxt(prev, 0);
+        }
+    }
+
+    /**
+     * @brief Terminate and free single context, thread context is kept
+     * @param ctxt context
+     */
+    void free_ctx(TPCONTEXT_T ctxt)
+    {
+        TPCONTEXT_T prev;
+        int prevret = tpgetctxt(&prev, 0);
+
+        if (EXSUCCEED==tpsetctxt(ctxt, 0))
+        {
+            tpterm();
+            tpgetctxt(&ctxt, 0);
+        }
+
+        tpfreectxt(ctxt);
+        ndrxpy_tplog_ctxfree(ctxt);
+        restore(prev, prevret);
+    }
+
+    /**
+     * @brief Free contexts available in pool
+     */
+    void release_all(void)
+    {
+        for (auto ctxt : free)
+        {
+            free_ctx(ctxt);
+        }
+
+        free.clear();
+    }
+
+    /**
+     * @brief Close the pool, leased contexts are freed when returned
+     */
+    void close_nogil(void)
+    {
+        std::vector<TPCONTEXT_T> tofree;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (closed)
+            {
+                return;
+            }
+
+            closed = true;
+            tofree.swap(free);
+        }
+
+        cv.notify_all();
+
+        for (auto ctxt : tofree)
+        {
+            free_ctx(ctxt);
+        }
+    }
+};
+
+/**
+ * @brief Context lease, bound to thread by "with" block
+ */
+struct ndrxpy_ctxlease
+{
+    ndrxpy_ctxpool *pool;   /**< owner pool                         */
+    double timeout;         /**< max wait for the context           */
+    TPCONTEXT_T ctxt;       /**< leased context, nullptr - none     */
+    TPCONTEXT_T prev;       /**< previous thread context            */
+    int prevret;            /**< previous context tpgetctxt() result*/
+};
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+/*---------------------------Prototypes---------------------------------*/
+
+/**
+ * @brief Register context pool api
+ *
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_ctxpool(py::module &m)
+{
+    py::class_<ndrxpy_ctxlease>(m, "TpCtxLease", R"pbdoc(
+        Lease of the context from :class:`.TpCtxPool`, returned by
+        :meth:`TpCtxPool.bind`. Context is bound to the current thread
+        in the **with** block.
+        )pbdoc")
+        .def("__enter__", [](ndrxpy_ctxlease &l)
+            {
+                if (nullptr!=l.ctxt)
+                {
+                    throw std::invalid_argument("Context already bound");
+                }
+
+                l.ctxt = l.pool->lease(l.timeout, &l.prev, &l.prevret);
+            })
+        .def("__exit__", [](ndrxpy_ctxlease &l, py::object exc_type,
+                py::object exc_value, py::object traceback)
+            {
+                if (nullptr!=l.ctxt)
+                {
+                    l.pool->unlease(l.ctxt, l.prev, l.prevret);
+                    l.ctxt = nullptr;
+                }
+            });
+
+    py::class_<ndrxpy_ctxpool>(m, "TpCtxPool", R"pbdoc(
+        Pool of ATMI contexts for multi-threaded clients. Contexts are created
+        by :func:`.tpnewctxt` and joined to application by :func:`.tpinit`
+        once, when pool is created. Context is bound to the thread for the
+        duration of the **with** block of :meth:`bind`, after which thread
+        returns to its previous context. Context handles are kept in native
+        format. If global transaction is left open in the block, it is aborted.
+
+        .. code-block:: python
+            :caption: TpCtxPool example
+            :name: TpCtxPool-example
+
+                import endurox as e
+
+                pool = e.TpCtxPool(8)
+
+                def handle_request(req):
+                    with pool.bind():
+                        return e.tpcall("TESTSV", {"data":{"T_STRING_FLD":req}})
+
+        :raise AtmiException:
+            | Context creation or :func:`.tpinit` failed.
+        :raise ValueError:
+            | Invalid pool size.
+
+        Parameters
+        ----------
+        size : int
+            Number of contexts.
+        flags : int
+            :func:`.tpinit` flags, e.g. **TPU_IGN**.
+        )pbdoc")
+        .def(py::init([](long size, long flags)
+            {
+                py::gil_scoped_release release;
+                return std::unique_ptr<ndrxpy_ctxpool>(new ndrxpy_ctxpool(size, flags));
+            }), py::arg("size"), py::arg("flags")=0)
+        .def("bind", [](ndrxpy_ctxpool &p, double timeout)
+            {
+                return ndrxpy_ctxlease{&p, timeout, nullptr, nullptr, TPNULLCONTEXT};
+            },
+            R"pbdoc(
+            Return lease for the **with** block, which binds free context to
+            the current thread. If all contexts are in use, waits up to *timeout*
+            seconds (negative - forever), then :data:`.TPETIME` is raised.
+            )pbdoc",
+            py::arg("timeout")=-1.0, py::keep_alive<0, 1>())
+        .def("close", &ndrxpy_ctxpool::close,
+            "Terminate and free contexts, leased contexts are freed when released")
+        .def_readonly("size", &ndrxpy_ctxpool::size)
+        .def_readonly("waits", &ndrxpy_ctxpool::waits)
+        .def_readonly("leases", &ndrxpy_ctxpool::leases)
+        .def_property_readonly("available", &ndrxpy_ctxpool::available);
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
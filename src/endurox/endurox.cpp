@@ -202,6 +202,14 @@ PYBIND11_MODULE(endurox, m)
     ndrxpy_register_srv(m);
     ndrxpy_register_tpext(m);
     ndrxpy_register_tplog(m);
+    ndrxpy_register_convstream(m);
+    ndrxpy_register_atmibuf(m);
+    ndrxpy_register_bufsnap(m);
+    ndrxpy_register_tplogasync(m);
+    ndrxpy_register_srvaio(m);
+    ndrxpy_register_srvpool(m);
+    ndrxpy_register_callcache(m);
+    ndrxpy_register_ctxpool(m);
 
     m.attr("TPEV_DISCONIMM") = py::int_(TPEV_DISCONIMM);
     m.attr("TPEV_SVCERR") = py::int_(TPEV_SVCERR);
@@ -408,6 +416,11 @@ PYBIND11_MODULE(endurox, m)
     m.attr("log_debug") = py::int_(log_debug);
     m.attr("log_dump") = py::int_(log_dump);
 
+    //Async log policies:
+    m.attr("TPLOGASYNC_BLOCK") = py::int_(NDRXPY_LOGASYNC_BLOCK);
+    m.attr("TPLOGASYNC_DROP") = py::int_(NDRXPY_LOGASYNC_DROP);
+    m.attr("TPLOGASYNC_COUNT") = py::int_(NDRXPY_LOGASYNC_COUNT);
+
     m.attr("EXSUCCEED") = py::int_(EXSUCCEED);
     m.attr("EXFAIL") = py::int_(EXFAIL);
 
@@ -441,12 +454,19 @@ Python3 bindings for writing Enduro/X clients and servers
         tploggetbufreqfile
         tplogdelbufreqfile
         tplogclosethread
+        tplogreqcache_config
+        tplogreqcache_sweep
+        tplogreqcache_stats
         tplogdump
         tplogdumpdiff
         tplogfplock
         tplogfpget
         tplogfpunlock
         tplogprintubf
+        LogState
+        tplogasync_start
+        tplogasync_stop
+        tplogasync_stats
         Bfldtype
         Bfldno
         Bmkfldid
@@ -458,6 +478,8 @@ Python3 bindings for writing Enduro/X clients and servers
         Bfprint
         Bprint
         Bextread
+        set_strenc
+        get_strenc
         tpinit
         tptoutset
         tptoutget
@@ -469,17 +491,26 @@ Python3 bindings for writing Enduro/X clients and servers
         tpnewctxt
         tpsetctxt
         tpfreectxt
+        TpCtxPool
+        TpCtxLease
         tuxgetenv
         tpsblktime
         tpgblktime
         tpcall
+        tpcallcache_config
+        tpcallcache_invalidate
+        tpcallcache_stats
+        tpcallflight_config
+        tpcallflight_stats
         tpacall
         tpgetrply
         tpcancel
+        tprplyhintstats
         tpconnect
         tpsend
         tprecv
         tpdiscon
+        ConvStream
         tpnotify
         tpbroadcast
         tpsetunsol
@@ -495,6 +526,8 @@ Python3 bindings for writing Enduro/X clients and servers
         tpclose
         tpexport
         tpimport
+        tpexport_many
+        tpimport_many
         tpenqueue
         tpdequeue
         tpscmt
@@ -505,8 +538,13 @@ Python3 bindings for writing Enduro/X clients and servers
         tpsubscribe
         tpunsubscribe
         tpreturn
+        tpreturn_inplace
+        AtmiBuf
+        BufSnapWriter
+        BufSnapReader
         tpforward
         tpadvertise
+        tpext_advertiseroute
         tpunadvertise
         tpsrvgetctxdata
         tpsrvsetctxdata
@@ -517,6 +555,18 @@ Python3 bindings for writing Enduro/X clients and servers
         tpext_delperiodcb
         tpext_addpollerfd
         tpext_delpollerfd
+        tpext_addpollbatchcb
+        tpext_delpollbatchcb
+        tpext_addtimer
+        tpext_deltimer
+        tpext_defer
+        tpext_deferbatch
+        tpext_deferbudget
+        tpext_deferstats
+        tpext_asyncio
+        tpext_workerpool
+        tpext_pooladvertise
+        tpext_workerpoolstats
 
 How to read this documentation
 ==============================
@@ -1731,6 +1781,28 @@ Log levels
     
     6 - Unofficial log level, dump.
 
+.. data:: log
+
+    :class:`.LogState` instance with cached level flags of the current
+    thread, e.g. ``endurox.log.debug_enabled``.
+
+Asynchronous log policies
+-------------------------
+
+Full ring policies for :func:`.tplogasync_start`.
+
+.. data:: TPLOGASYNC_BLOCK
+
+    Log call waits for free slot in the ring.
+
+.. data:: TPLOGASYNC_DROP
+
+    Message is dropped.
+
+.. data:: TPLOGASYNC_COUNT
+
+    Message is dropped, writer logs number of dropped messages.
+
 Logging topics aka facilities
 -----------------------------
 
@@ -51,8 +51,11 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
+#include <vector>
 
 /*---------------------------Externs------------------------------------*/
 /*---------------------------Macros-------------------------------------*/
@@ -71,11 +74,109 @@ typedef struct
     
 } ndrx_ora_tpgetconn_t;
 
+/**
+ * Expected reply buffer, passed by caller of tpcall(), tpgetrply(), tprecv()
+ */
+typedef struct
+{
+    std::string type;       /**< hinted buffer type, empty if no hint     */
+    std::string subtype;    /**< hinted sub-type                          */
+    long size;              /**< hinted buffer size                       */
+    char *prep;             /**< buffer given to ATMI (to detect realloc) */
+} ndrxpy_rplyhint_t;
+
+/**
+ * Reply buffer kept for the next call with the same hint
+ */
+typedef struct
+{
+    char type[8];           /**< buffer type                              */
+    char subtype[16];       /**< buffer sub-type                          */
+    atmibuf buf;            /**< buffer, allocated with hinted size       */
+} ndrxpy_rplykeep_t;
+
 /*---------------------------Globals------------------------------------*/
 /*---------------------------Statics------------------------------------*/
 
+static std::atomic<long> M_rplyhint_calls(0);   /**< calls with reply hint        */
+static std::atomic<long> M_rplyhint_typemiss(0);/**< reply type was different     */
+static std::atomic<long> M_rplyhint_sizemiss(0);/**< reply did not fit in buffer  */
+
+/**
+ * Reply buffers kept by the thread for the next call with the same hint,
+ * freed by tpterm()
+ */
+static thread_local std::vector<ndrxpy_rplykeep_t> M_rplybufs;
+
 namespace py = pybind11;
 
+/**
+ * @brief Allocate export output object, data is written directly to it
+ * @param [in] size output capacity
+ * @param [in] flags export flags
+ * @param [out] data object data
+ * @return new reference to bytes or str (TPEX_STRING) object
+ */
+exprivate PyObject *export_alloc(long size, long flags, char **data)
+{
+    PyObject *ret;
+
+    if (flags & TPEX_STRING)
+    {
+        /* base64 output is ascii */
+        ret = PyUnicode_New(size, 127);
+        if (nullptr!=ret)
+        {
+            *data = reinterpret_cast<char *>(PyUnicode_1BYTE_DATA(ret));
+        }
+    }
+    else
+    {
+        ret = PyBytes_FromStringAndSize(nullptr, size);
+        if (nullptr!=ret)
+        {
+            *data = PyBytes_AS_STRING(ret);
+        }
+    }
+
+    if (nullptr==ret)
+    {
+        throw py::error_already_set();
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Trim export output object to the exported length
+ * @param [in] obj object allocated by export_alloc() (reference is stolen)
+ * @param [in] data object data
+ * @param [in] olen length returned by tpexport()
+ * @param [in] flags export flags
+ * @return exported buffer
+ */
+exprivate py::object export_finish(PyObject *obj, char *data, long olen, long flags)
+{
+    int rc;
+
+    if (flags & TPEX_STRING)
+    {
+        rc = PyUnicode_Resize(&obj, strnlen(data, olen));
+    }
+    else
+    {
+        rc = _PyBytes_Resize(&obj, olen-1);
+    }
+
+    /* on failure obj is released */
+    if (EXSUCCEED!=rc)
+    {
+        throw py::error_already_set();
+    }
+
+    return py::reinterpret_steal<py::object>(obj);
+}
+
 /**
  * @brief export ATMI buffer
  * @param [in] idata ATMI buffer to export
@@ -85,36 +186,119 @@ namespace py = pybind11;
 expublic py::object ndrxpy_pytpexport(py::object idata, long flags)
 {
     auto in = ndrx_from_py(idata);
-    std::vector<char> ostr;
-    ostr.resize(512 + in.len * 2);
+    char *data;
+    long olen = 512 + in.len * 2;
+    PyObject *out = export_alloc(olen, flags, &data);
 
-    long olen = ostr.capacity();
-    int rc = tpexport(in.p, in.len, &ostr[0], &olen, flags);
-    if (rc == -1)
+    if (EXFAIL==tpexport(*in.pp, in.len, data, &olen, flags))
     {
+        Py_DECREF(out);
         throw atmi_exception(tperrno);
     }
 
-    if (flags == 0)
+    return export_finish(out, data, olen, flags);
+}
+
+/**
+ * @brief Export list of ATMI buffers, ATMI part runs with GIL released
+ * @param [in] idata list of ATMI buffers
+ * @param [in] flags flags
+ * @return list of exported buffers
+ */
+expublic py::list ndrxpy_pytpexport_many(py::list idata, long flags)
+{
+    std::vector<atmibuf> in;
+    std::vector<py::object> hold;
+    std::vector<char *> data;
+    std::vector<long> olen;
+    int err = 0;
+    py::list ret;
+
+    in.reserve(idata.size());
+
+    for (auto d : idata)
+    {
+        char *p;
+        in.push_back(ndrx_from_py(py::reinterpret_borrow<py::object>(d)));
+        olen.push_back(512 + in.back().len * 2);
+        hold.push_back(py::reinterpret_steal<py::object>(
+            export_alloc(olen.back(), flags, &p)));
+        data.push_back(p);
+    }
+
+    {
+        py::gil_scoped_release release;
+
+        for (size_t i=0; i<in.size(); i++)
+        {
+            if (EXFAIL==tpexport(*in[i].pp, in[i].len, data[i], &olen[i], flags))
+            {
+                err = tperrno;
+                break;
+            }
+        }
+    }
+
+    if (0!=err)
     {
-        return py::bytes(&ostr[0], olen-1);
+        throw atmi_exception(err);
     }
-    return py::str(&ostr[0]);
+
+    for (size_t i=0; i<in.size(); i++)
+    {
+        ret.append(export_finish(hold[i].release().ptr(), data[i], olen[i], flags));
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Import input view to ATMI buffer
+ * @param [in] istr input object, str or bytes-like
+ * @param [out] ilen input length
+ * @param [out] view buffer view holder
+ * @return input data
+ */
+exprivate const char *import_input(py::handle istr, long *ilen, 
+    std::unique_ptr<pybufview> &view)
+{
+    const char *ret;
+
+    if (py::isinstance<py::str>(istr))
+    {
+        Py_ssize_t len;
+
+        if (nullptr==(ret=PyUnicode_AsUTF8AndSize(istr.ptr(), &len)))
+        {
+            throw py::error_already_set();
+        }
+        *ilen = len;
+    }
+    else
+    {
+        view.reset(new pybufview(istr));
+        ret = view->buf();
+        *ilen = view->len();
+    }
+
+    return ret;
 }
 
 /**
  * @brief import ATMI buffer
- * @param [in] istr input buffer / string
- * @param [in] flags
+ * @param [in] istr exported buffer, str or bytes-like object (not copied)
+ * @param [in] flags flags
  * @return ATMI buffer
  */
-expublic py::object ndrxpy_pytpimport(const std::string istr, long flags)
+expublic py::object ndrxpy_pytpimport(py::object istr, long flags)
 {
-    atmibuf obuf("UBF", istr.size());
+    std::unique_ptr<pybufview> view;
+    long ilen;
+    const char *idata = import_input(istr, &ilen, view);
+    atmibuf obuf("UBF", ilen);
 
     long olen = 0;
-    int rc = tpimport(const_cast<char *>(istr.c_str()), istr.size(), obuf.pp,
-                      &olen, flags);
+    int rc = tpimport(const_cast<char *>(idata), ilen, obuf.pp, &olen, flags);
     if (rc == -1)
     {
         throw atmi_exception(tperrno);
@@ -123,6 +307,59 @@ expublic py::object ndrxpy_pytpimport(const std::string istr, long flags)
     return ndrx_to_py(obuf);
 }
 
+/**
+ * @brief Import list of exported buffers, ATMI part runs with GIL released
+ * @param [in] istrs list of exported buffers (str or bytes-like)
+ * @param [in] flags flags
+ * @return list of ATMI buffers
+ */
+expublic py::list ndrxpy_pytpimport_many(py::list istrs, long flags)
+{
+    std::vector<std::unique_ptr<pybufview>> views(istrs.size());
+    std::vector<const char *> idata;
+    std::vector<long> ilen;
+    std::vector<atmibuf> out;
+    int err = 0;
+    size_t i = 0;
+    py::list ret;
+
+    out.reserve(istrs.size());
+
+    for (auto s : istrs)
+    {
+        long len;
+        idata.push_back(import_input(s, &len, views[i++]));
+        ilen.push_back(len);
+        out.push_back(atmibuf("UBF", len));
+    }
+
+    {
+        py::gil_scoped_release release;
+
+        for (i=0; i<out.size(); i++)
+        {
+            long olen = 0;
+            if (EXFAIL==tpimport(const_cast<char *>(idata[i]), ilen[i], out[i].pp, &olen, flags))
+            {
+                err = tperrno;
+                break;
+            }
+        }
+    }
+
+    if (0!=err)
+    {
+        throw atmi_exception(err);
+    }
+
+    for (auto &b : out)
+    {
+        ret.append(ndrx_to_py(b));
+    }
+
+    return ret;
+}
+
 /**
  * @brief post event 
  * @param [in] eventname name of the event
@@ -147,25 +384,198 @@ expublic int ndrxpy_pytppost(const std::string eventname, py::object data, long
     return rc;
 }
 
+/**
+ * @brief Find reply buffer kept for the hint
+ * @param hint reply hint
+ * @return kept buffer or M_rplybufs.end()
+ */
+exprivate std::vector<ndrxpy_rplykeep_t>::iterator rplyhint_find(ndrxpy_rplyhint_t &hint)
+{
+    for (auto it=M_rplybufs.begin(); it!=M_rplybufs.end(); it++)
+    {
+        if (0==strcmp(it->type, hint.type.c_str()) && 0==strcmp(it->subtype, hint.subtype.c_str()))
+        {
+            return it;
+        }
+    }
+
+    return M_rplybufs.end();
+}
+
+/**
+ * @brief Free reply buffers kept by the thread, called before tpterm()
+ */
+exprivate void rplyhint_free(void)
+{
+    M_rplybufs.clear();
+}
+
+/**
+ * @brief Prepare output buffer according to the reply hint.
+ *  Buffer kept from previous call with the same hint is re-used,
+ *  if it is large enough.
+ * @param out output buffer (not allocated)
+ * @param hint reply hint
+ * @return EXTRUE if hint is used, EXFALSE if not
+ */
+exprivate int rplyhint_prep(atmibuf &out, ndrxpy_rplyhint_t &hint)
+{
+    if (hint.type.empty())
+    {
+        return EXFALSE;
+    }
+
+    auto it = rplyhint_find(hint);
+
+    if (it!=M_rplybufs.end() && tptypes(*it->buf.pp, nullptr, nullptr) >= hint.size)
+    {
+        out = std::move(it->buf);
+        M_rplybufs.erase(it);
+    }
+    else
+    {
+        out.reinit(hint.type.c_str(), hint.subtype.empty()?nullptr:hint.subtype.c_str(),
+            hint.size > 0 ? hint.size : 1024);
+    }
+
+    hint.prep = *out.pp;
+
+    return EXTRUE;
+}
+
+/**
+ * @brief Account the hint statistics and keep the reply buffer for the next
+ *  call, if the reply was of hinted type and fits in hinted size (buffers
+ *  grown by ATMI are not kept). Called after reply is converted to Python.
+ * @param out reply buffer
+ * @param hint reply hint
+ */
+exprivate void rplyhint_keep(atmibuf &out, ndrxpy_rplyhint_t &hint)
+{
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+
+    if (hint.type.empty())
+    {
+        return;
+    }
+
+    M_rplyhint_calls++;
+
+    if (nullptr==*out.pp || EXFAIL==tptypes(*out.pp, type, subtype) 
+            || hint.type!=type || hint.subtype!=subtype)
+    {
+        NDRX_LOG(log_debug, "Reply hint [%s]/[%s] missed type, got [%s]/[%s]",
+            hint.type.c_str(), hint.subtype.c_str(), type, subtype);
+        M_rplyhint_typemiss++;
+        return;
+    }
+
+    if (*out.pp!=hint.prep)
+    {
+        NDRX_LOG(log_debug, "Reply hint [%s]/[%s] size %ld too small",
+            hint.type.c_str(), hint.subtype.c_str(), hint.size);
+        M_rplyhint_sizemiss++;
+        return;
+    }
+
+    auto it = rplyhint_find(hint);
+
+    if (it==M_rplybufs.end())
+    {
+        ndrxpy_rplykeep_t keep;
+
+        NDRX_STRCPY_SAFE(keep.type, type);
+        NDRX_STRCPY_SAFE(keep.subtype, subtype);
+        keep.buf = std::move(out);
+        M_rplybufs.push_back(std::move(keep));
+    }
+    else
+    {
+        it->buf = std::move(out);
+    }
+}
+
 /**
  * @brief Synchronous service call
  * 
  * @param svc service name
  * @param idata dictionary encoded atmi buffer
  * @param flags any flags
+ * @param rtype expected reply buffer type (optional)
+ * @param rsubtype expected reply sub-type (optional)
+ * @param rsize expected reply size
  * @return pytpreply return tuple loaded with tperrno, tpurcode, return buffer
  */
-expublic pytpreply ndrxpy_pytpcall(const char *svc, py::object idata, long flags)
+expublic pytpreply ndrxpy_pytpcall(const char *svc, py::object idata, long flags,
+        const std::string &rtype, const std::string &rsubtype, long rsize,
+        const std::string &strenc)
 {
 
     auto in = ndrx_from_py(idata);
     int tperrno_saved=0;
-    atmibuf out("NULL", (long)0);
+    long urcode;
+    ndrxpy_rplyhint_t hint = {rtype, rsubtype, rsize, nullptr};
+    atmibuf out;
+    ndrxpy_bufdec dec;
+    std::string cachekey;
+
+    /* reply cached, see tpcallcache_config() */
+    if (ndrxpy_callcache_get(svc, in, cachekey, out, &urcode))
+    {
+        ndrxpy_strenc_guard enc(strenc);
+        return pytpreply(0, urcode, ndrx_to_py(out));
+    }
+
+    /* identical call in progress, see tpcallflight_config() */
+    bool leader = false;
+    auto flight = ndrxpy_callflight_begin(svc, flags, in, &leader);
+
+    if (nullptr!=flight && !leader)
+    {
+        {
+            py::gil_scoped_release release;
+            tperrno_saved = ndrxpy_callflight_wait(flight, out, &urcode);
+        }
+
+        if (0!=tperrno_saved && TPESVCFAIL!=tperrno_saved)
+        {
+            throw atmi_exception(tperrno_saved);
+        }
+
+        ndrxpy_strenc_guard enc(strenc);
+        return pytpreply(tperrno_saved, urcode, ndrx_to_py(out));
+    }
+
+    try
+    {
+        if (!rplyhint_prep(out, hint))
+        {
+            out.reinit("NULL", nullptr, 0);
+        }
+    }
+    catch (atmi_exception &e)
+    {
+        if (nullptr!=flight)
+        {
+            ndrxpy_callflight_end(flight, e.code(), nullptr, 0);
+        }
+        throw;
+    }
+
     {
         py::gil_scoped_release release;
         int rc = tpcall(const_cast<char *>(svc), *in.pp, in.len, out.pp, &out.len,
                         flags);
         tperrno_saved=tperrno;
+        urcode=tpurcode;
+
+        if (nullptr!=flight)
+        {
+            ndrxpy_callflight_end(flight, EXFAIL==rc?tperrno_saved:0,
+                EXFAIL==rc && TPESVCFAIL!=tperrno_saved?nullptr:&out, urcode);
+        }
+
         if (rc == -1)
         {
             if (tperrno_saved != TPESVCFAIL)
@@ -173,8 +583,21 @@ expublic pytpreply ndrxpy_pytpcall(const char *svc, py::object idata, long flags
                 throw atmi_exception(tperrno_saved);
             }
         }
+
+        /* reply fields are located without GIL */
+        ndrxpy_predecode(out, dec);
     }
-    return pytpreply(tperrno_saved, tpurcode, ndrx_to_py(out));
+
+    if (!cachekey.empty() && 0==tperrno_saved)
+    {
+        ndrxpy_callcache_put(svc, cachekey, out, urcode);
+    }
+
+    ndrxpy_strenc_guard enc(strenc);
+    auto data = ndrx_to_py(out, dec);
+    rplyhint_keep(out, hint);
+
+    return pytpreply(tperrno_saved, urcode, data);
 }
 
 /**
@@ -432,16 +855,26 @@ expublic pytpsendret ndrxpy_pytpsend(int cd, py::object idata, long flags)
  * @param flags flags
  * @return tperrno, revent, tpurcode, ATMI buffer
  */
-expublic pytprecvret ndrxpy_pytprecv(int cd, long flags)
+expublic pytprecvret ndrxpy_pytprecv(int cd, long flags,
+        const std::string &rtype, const std::string &rsubtype, long rsize,
+        const std::string &strenc)
 {
     long revent;
     int tperrno_saved;
+    long urcode;
+    ndrxpy_rplyhint_t hint = {rtype, rsubtype, rsize, nullptr};
+    atmibuf out;
+
+    if (!rplyhint_prep(out, hint))
+    {
+        out.reinit("NULL", nullptr, 0);
+    }
 
-    atmibuf out("NULL", 0L);
     {
         py::gil_scoped_release release;
         int rc = tprecv(cd, out.pp, &out.len, flags, &revent);
         tperrno_saved = tperrno;
+        urcode = tpurcode;
 
         if (rc == -1)
         {
@@ -452,7 +885,11 @@ expublic pytprecvret ndrxpy_pytprecv(int cd, long flags)
         }
     }
 
-    return pytprecvret(tperrno_saved, tpurcode, revent, ndrx_to_py(out));
+    ndrxpy_strenc_guard enc(strenc);
+    auto data = ndrx_to_py(out);
+    rplyhint_keep(out, hint);
+
+    return pytprecvret(tperrno_saved, urcode, revent, data);
 }
 
 /**
@@ -461,15 +898,27 @@ expublic pytprecvret ndrxpy_pytprecv(int cd, long flags)
  * @param [in] flags flags
  * @return call reply
  */
-expublic pytpreplycd ndrxpy_pytpgetrply(int cd, long flags)
+expublic pytpreplycd ndrxpy_pytpgetrply(int cd, long flags,
+        const std::string &rtype, const std::string &rsubtype, long rsize,
+        const std::string &strenc)
 {
     int tperrno_saved=0;
-    atmibuf out("UBF", 1024);
+    long urcode;
+    ndrxpy_rplyhint_t hint = {rtype, rsubtype, rsize, nullptr};
+    atmibuf out;
+    ndrxpy_bufdec dec;
+
+    if (!rplyhint_prep(out, hint))
+    {
+        out.reinit("UBF", nullptr, 1024);
+    }
+
     {
         py::gil_scoped_release release;
         int rc = tpgetrply(&cd, out.pp, &out.len, flags);
 
         tperrno_saved = tperrno;
+        urcode = tpurcode;
         if (rc == -1)
         {
             if (tperrno_saved != TPESVCFAIL)
@@ -477,8 +926,15 @@ expublic pytpreplycd ndrxpy_pytpgetrply(int cd, long flags)
                 throw atmi_exception(tperrno_saved);
             }
         }
+
+        ndrxpy_predecode(out, dec);
     }
-    return pytpreplycd(tperrno_saved, tpurcode, ndrx_to_py(out), cd);
+
+    ndrxpy_strenc_guard enc(strenc);
+    auto data = ndrx_to_py(out, dec);
+    rplyhint_keep(out, hint);
+
+    return pytpreplycd(tperrno_saved, urcode, data, cd);
 }
 
 
@@ -850,6 +1306,20 @@ expublic void ndrxpy_register_atmi(py::module &m)
         flags : int
             Or'd bit flags: :data:`.TPNOTRAN`, :data:`.TPSIGRSTRT`, :data:`.TPNOTIME`, 
             :data:`.TPNOCHANGE`, :data:`.TPTRANSUSPEND`, :data:`.TPNOBLOCK`, :data:`.TPNOABORT`.
+        rtype : str
+            Expected reply buffer type (e.g. **UBF**, **STRING**). If set, reply is received
+            in preallocated buffer of this type, which is kept by the calling thread
+            (if reply fits in the hinted size) and re-used by the next call with the
+            same hint, until :func:`.tpterm`. See :func:`.tprplyhintstats`.
+            Default is no hint.
+        rsubtype : str
+            Expected reply sub-type (**VIEW** name).
+        rsize : int
+            Expected reply buffer size in bytes. Default (**0**) is 1024.
+        strenc : str
+            STRING field encoding for the reply: *utf-8*, *locale* or *bytes*
+            (STRING fields returned as bytes, not decoded). Default (empty) is
+            set by :func:`.set_strenc`.
 
         Returns
         -------
@@ -861,7 +1331,8 @@ expublic void ndrxpy_register_atmi(py::module &m)
             ATMI buffer returned from the server.
 
      )pbdoc",
-          py::arg("svc"), py::arg("idata"), py::arg("flags") = 0);
+          py::arg("svc"), py::arg("idata"), py::arg("flags") = 0,
+          py::arg("rtype") = "", py::arg("rsubtype") = "", py::arg("rsize") = 0, py::arg("strenc") = "");
 
     m.def("tpacall", &ndrxpy_pytpacall,           
         R"pbdoc(
@@ -944,6 +1415,21 @@ expublic void ndrxpy_register_atmi(py::module &m)
         flags : int
             Or'd bit flags: :data:`.TPGETANY`, :data:`.TPNOBLOCK`, :data:`.TPSIGRSTRT`, 
             :data:`.TPNOTIME`, :data:`.TPNOCHANGE`, :data:`.TPNOABORT`. Default value is **0**.
+        rtype : str
+            Expected reply buffer type (e.g. **UBF**, **STRING**). If set, reply is received
+            in preallocated buffer of this type, which is kept by the calling thread
+            (if reply fits in the hinted size) and re-used by the next call with the
+            same hint, until :func:`.tpterm`. See :func:`.tprplyhintstats`.
+            Default is no hint
+            (**UBF** buffer of 1024 bytes is given to ATMI).
+        rsubtype : str
+            Expected reply sub-type (**VIEW** name).
+        rsize : int
+            Expected reply buffer size in bytes. Default (**0**) is 1024.
+        strenc : str
+            STRING field encoding for the reply: *utf-8*, *locale* or *bytes*
+            (STRING fields returned as bytes, not decoded). Default (empty) is
+            set by :func:`.set_strenc`.
 
         Returns
         -------
@@ -954,7 +1440,8 @@ expublic void ndrxpy_register_atmi(py::module &m)
         dict
             ATMI buffer returned from the server.
          )pbdoc", 
-         py::arg("cd"), py::arg("flags") = 0);
+         py::arg("cd"), py::arg("flags") = 0,
+         py::arg("rtype") = "", py::arg("rsubtype") = "", py::arg("rsize") = 0, py::arg("strenc") = "");
 
     m.def(
     "tpcancel",
@@ -1107,6 +1594,20 @@ expublic void ndrxpy_register_atmi(py::module &m)
             ATMI buffer to send.
         flags : int
             Bitwise or'd :data:`.TPNOBLOCK`, :data:`.TPSIGRSTRT`, :data:`.TPNOTIME`.
+        rtype : str
+            Expected reply buffer type (e.g. **UBF**, **STRING**). If set, reply is received
+            in preallocated buffer of this type, which is kept by the calling thread
+            (if reply fits in the hinted size) and re-used by the next call with the
+            same hint, until :func:`.tpterm`. See :func:`.tprplyhintstats`.
+            Default is no hint.
+        rsubtype : str
+            Expected reply sub-type (**VIEW** name).
+        rsize : int
+            Expected reply buffer size in bytes. Default (**0**) is 1024.
+        strenc : str
+            STRING field encoding for the reply: *utf-8*, *locale* or *bytes*
+            (STRING fields returned as bytes, not decoded). Default (empty) is
+            set by :func:`.set_strenc`.
 
         Returns
         -------
@@ -1124,7 +1625,58 @@ expublic void ndrxpy_register_atmi(py::module &m)
         dict
             ATMI buffer send by peer.
          )pbdoc",
-          py::arg("cd"), py::arg("flags") = 0);
+          py::arg("cd"), py::arg("flags") = 0,
+          py::arg("rtype") = "", py::arg("rsubtype") = "", py::arg("rsize") = 0, py::arg("strenc") = "");
+
+    m.def(
+    "tprplyhintstats",
+    [](bool reset)
+    {
+        py::dict ret;
+
+        ret["calls"] = M_rplyhint_calls.load();
+        ret["typemiss"] = M_rplyhint_typemiss.load();
+        ret["sizemiss"] = M_rplyhint_sizemiss.load();
+
+        if (reset)
+        {
+            M_rplyhint_calls = 0;
+            M_rplyhint_typemiss = 0;
+            M_rplyhint_sizemiss = 0;
+        }
+
+        return ret;
+    },
+    R"pbdoc(
+        Return statistics of the reply buffer hints passed to :func:`.tpcall`,
+        :func:`.tpgetrply` and :func:`.tprecv` (*rtype* argument). Counters are
+        process wide.
+
+        .. code-block:: python
+            :caption: tprplyhintstats example
+            :name: tprplyhintstats-example
+                import endurox as e
+
+                for i in range(1000):
+                    e.tpcall("EXBENCH", {"data":{"T_STRING_FLD":"Hi"}}, rtype="UBF", rsize=4096)
+                stats = e.tprplyhintstats()
+                if stats["typemiss"] + stats["sizemiss"] > stats["calls"] / 10:
+                    e.tplog_warn("Reply hint is not accurate: %s" % str(stats))
+
+        Parameters
+        ----------
+        reset : bool
+            Reset counters after reading. Default is **False**.
+
+        Returns
+        -------
+        dict
+            *calls* - number of calls made with the hint, *typemiss* - number of
+            replies with different buffer type than hinted, *sizemiss* - number
+            of replies which did not fit in the hinted buffer size (buffer was
+            reallocated by ATMI).
+         )pbdoc",
+        py::arg("reset") = false);
 
     m.def(
     "tpdiscon",
@@ -1392,7 +1944,8 @@ expublic void ndrxpy_register_atmi(py::module &m)
         Parameters
         ----------
         istr : str
-            Serialized buffer with :func:`.tpexport`
+            Serialized buffer with :func:`.tpexport`. Bytes-like objects (bytes,
+            bytearray, memoryview, mmap) are accepted too and are not copied.
         flags : int
             Bitwise flags, may contain :data:`.TPEX_STRING`, :data:`.TPEX_NOCHANGE`. Default is **0**.
 
@@ -1403,6 +1956,65 @@ expublic void ndrxpy_register_atmi(py::module &m)
             )pbdoc"
           , py::arg("istr"), py::arg("flags") = 0);
 
+    m.def("tpexport_many", &ndrxpy_pytpexport_many,
+                 R"pbdoc(
+        Export list of ATMI buffers. Buffers are converted to ATMI format first,
+        then all of them are exported with GIL released. Output is written
+        directly to the returned objects.
+
+        .. code-block:: python
+            :caption: tpexport_many example
+            :name: tpexport_many-example
+
+            import endurox as e
+            bufs = e.tpexport_many([{"data":"HELLO"}, {"data":{"T_STRING_FLD":"WORLD"}}])
+            orgs = e.tpimport_many(bufs)
+
+        For more details see **tpexport(3)** C API call.
+
+        :raise AtmiException: 
+            | Errors of :func:`.tpexport`, first failure stops the processing.
+
+        Parameters
+        ----------
+        ibufs : list
+            List of ATMI buffers (dict or :class:`.AtmiBuf`).
+        flags : int
+            Bitwise flags, may contain **TPEX_STRING**. Default is **0**.
+
+        Returns
+        -------
+        bufs_serial : list
+            List of exported buffers, bytes, or strings if *flags* contained **TPEX_STRING**.
+
+            )pbdoc"
+          , py::arg("ibufs"), py::arg("flags") = 0);
+
+    m.def("tpimport_many", &ndrxpy_pytpimport_many,
+                 R"pbdoc(
+        Import list of buffers exported by :func:`.tpexport` or :func:`.tpexport_many`.
+        Input objects are not copied, all buffers are imported with GIL released,
+        afterwards converted to Python.
+
+        For more details see **tpimport(3)** C API call.
+
+        :raise AtmiException: 
+            | Errors of :func:`.tpimport`, first failure stops the processing.
+
+        Parameters
+        ----------
+        istrs : list
+            List of serialized buffers (str or bytes-like).
+        flags : int
+            Bitwise flags, may contain :data:`.TPEX_STRING`, :data:`.TPEX_NOCHANGE`. Default is **0**.
+
+        Returns
+        -------
+        bufs : list
+            List of restored ATMI buffers.
+            )pbdoc"
+          , py::arg("istrs"), py::arg("flags") = 0);
+
     m.def("tppost", &ndrxpy_pytppost,
                  R"pbdoc(
         Post event to the event broker.
@@ -1548,6 +2160,8 @@ expublic void ndrxpy_register_atmi(py::module &m)
         {
             py::gil_scoped_release release;
 
+            rplyhint_free();
+
             if (tpterm() == -1)
             {
                 throw atmi_exception(tperrno);
@@ -2106,7 +2720,7 @@ expublic void ndrxpy_register_atmi(py::module &m)
         {
             TPCONTEXT_T ctxt;
             int ret;
-            if (EXFAIL==(ret=tpgetctxt(&ctxt, flags)))
+            if (EXFAIL==(ret=ndrxpy_tpgetctxt(&ctxt, flags)))
             {
                 throw atmi_exception(tperrno);
             }
@@ -2142,7 +2756,7 @@ expublic void ndrxpy_register_atmi(py::module &m)
         {
             TPCONTEXT_T ctxt;
             context->getCtxt(&ctxt);
-            if (EXSUCCEED!=tpsetctxt(ctxt, flags))
+            if (EXSUCCEED!=ndrxpy_tpsetctxt(ctxt, flags))
             {
                 throw atmi_exception(tperrno);
             }
@@ -2172,7 +2786,7 @@ expublic void ndrxpy_register_atmi(py::module &m)
         "tpsetctxt",
         [](py::none none, long flags)
         {
-            if (EXSUCCEED!=tpsetctxt(TPNULLCONTEXT, flags))
+            if (EXSUCCEED!=ndrxpy_tpsetctxt(TPNULLCONTEXT, flags))
             {
                 throw atmi_exception(tperrno);
             }
@@ -2204,6 +2818,7 @@ expublic void ndrxpy_register_atmi(py::module &m)
             context->getCtxt(&ctxt);
 
             tpfreectxt(ctxt);
+            ndrxpy_tplog_ctxfree(ctxt);
         },
         R"pbdoc(
         Free ATMI context.
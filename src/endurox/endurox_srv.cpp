@@ -49,6 +49,9 @@
 
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace py = pybind11;
 
@@ -58,6 +61,56 @@ static py::object server;
 //Mapping of advertised functions
 std::map<std::string, py::object> M_dispmap {};
 
+/**
+ * @brief Content based routing rule
+ */
+typedef struct
+{
+    std::string expr;   /**< boolean expression         */
+    char *tree;         /**< compiled by Bboolco()      */
+    py::object func;    /**< handler                    */
+} ndrxpy_route_t;
+
+/**
+ * @brief Routing table of the function. Dispatch threads hold a reference
+ *  while the rules are evaluated, so the table is freed by the last user.
+ */
+struct ndrxpy_routes_t
+{
+    std::vector<ndrxpy_route_t> rules;  /**< evaluated in order         */
+    py::object dflt;                    /**< no match handler or None   */
+    long rcode;                         /**< no match TPFAIL user code  */
+
+    ~ndrxpy_routes_t()
+    {
+        /* last reference may be dropped by dispatch thread without GIL */
+        py::gil_scoped_acquire acquire;
+
+        for (auto &r : rules)
+        {
+            Btreefree(r.tree);
+        }
+
+        rules.clear();
+        dflt = py::object();
+    }
+};
+
+/** protects M_routes, dispatch threads look up the table without GIL */
+exprivate std::mutex M_routes_mutex;
+
+/** routed services, by service name */
+std::map<std::string, std::shared_ptr<ndrxpy_routes_t>> M_routes {};
+
+exprivate void ndrxpy_routes_set(const std::string &svcname,
+        std::shared_ptr<ndrxpy_routes_t> routes);
+
+/** server main thread, the one which runs the poller */
+exprivate std::thread::id M_srvmain;
+
+/** server main thread is known, i.e. tpsvrinit() was called */
+exprivate bool M_srvmain_set = false;
+
 struct svcresult
 {
     int rval;
@@ -67,6 +120,8 @@ struct svcresult
     char name[XATMI_SERVICE_NAME_LENGTH];
     bool forward;
     bool clean;
+    pytpsvcinfo *info;  /**< current service call, for its request buffer */
+    bool replied;   /**< tpreturn/tpforward called by the service */
 };
 static thread_local svcresult tsvcresult;
 
@@ -79,13 +134,74 @@ expublic void ndrxpy_pytpreturn(int rval, long rcode, py::object data, long flag
     }
     tsvcresult.clean = false;
     */
+    /* reply in worker process goes to the server */
+    if (ndrxpy_pool_reply(rval, rcode, nullptr, data))
+    {
+        return;
+    }
+
+    /* reply from coroutine: switch to its request */
+    ndrxpy_aio_reply_ctx();
+
     tsvcresult.rval = rval;
     tsvcresult.rcode = rcode;
+    tsvcresult.replied = true;
     auto &&odata = ndrx_from_py(data);
-    tpreturn(tsvcresult.rval, tsvcresult.rcode, odata.p, odata.len, 0);
+    tpreturn(tsvcresult.rval, tsvcresult.rcode, *odata.pp, odata.len, 0);
     //Normal destructors apply... as running in nojump mode
 
 }
+
+/**
+ * @brief Return from service by updating request buffer in place with
+ *  the fields which differ from the reply dict. If request buffer is not UBF
+ *  or reply is not UBF (or is not updatable in place), standard tpreturn
+ *  is performed.
+ * 
+ * @param rval return value
+ * @param rcode user return code
+ * @param data reply buffer dict
+ * @param flags flags
+ */
+expublic void ndrxpy_pytpreturn_inplace(int rval, long rcode, py::object data, long flags)
+{
+    atmibuf *ibuf = nullptr!=tsvcresult.info?tsvcresult.info->reqbuf():nullptr;
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+
+    if (ndrxpy_pool_reply(rval, rcode, nullptr, data))
+    {
+        return;
+    }
+
+    if (nullptr!=ibuf && nullptr!=*ibuf->pp && py::isinstance<py::dict>(data)
+        && EXFAIL!=tptypes(*ibuf->pp, type, subtype) && 0==strcmp(type, "UBF"))
+    {
+        auto dict = static_cast<py::dict>(data);
+
+        if (!dict.contains(NDRXPY_DATA_CALLINFO) && dict.contains(NDRXPY_DATA_DATA)
+            && py::isinstance<py::dict>(dict[NDRXPY_DATA_DATA])
+            && (!dict.contains(NDRXPY_DATA_BUFTYPE) 
+                || "UBF"==std::string(py::str(dict[NDRXPY_DATA_BUFTYPE]))))
+        {
+            /* grow from the allocated size */
+            ibuf->len = Bsizeof(*ibuf->fbfr());
+
+            if (EXSUCCEED==ndrxpy_from_py_ubf_delta(
+                static_cast<py::dict>(dict[NDRXPY_DATA_DATA]), *ibuf))
+            {
+                tsvcresult.rval = rval;
+                tsvcresult.rcode = rcode;
+                tsvcresult.replied = true;
+                tpreturn(tsvcresult.rval, tsvcresult.rcode, *ibuf->pp, 0, 0);
+                return;
+            }
+        }
+    }
+
+    NDRX_LOG(log_debug, "Request buffer not updatable in place, converting reply");
+    ndrxpy_pytpreturn(rval, rcode, data, flags);
+}
 expublic void ndrxpy_pytpforward(const std::string &svc, py::object data, long flags)
 {
     /*
@@ -95,15 +211,32 @@ expublic void ndrxpy_pytpforward(const std::string &svc, py::object data, long f
     }
     tsvcresult.clean = false;
     */
+    if (ndrxpy_pool_reply(0, 0, svc.c_str(), data))
+    {
+        return;
+    }
+
+    ndrxpy_aio_reply_ctx();
+
     strncpy(tsvcresult.name, svc.c_str(), sizeof(tsvcresult.name));
+    tsvcresult.replied = true;
     auto &&odata = ndrx_from_py(data);
-    tpforward(tsvcresult.name, odata.p, odata.len, 0);
+    tpforward(tsvcresult.name, *odata.pp, odata.len, 0);
 
     //Normal destructors apply... as running in nojump mode.
 }
 
 extern "C" long G_libatmisrv_flags;
 
+/**
+ * @brief Is current thread the server main thread, which runs the poller
+ * @return true main thread, false other thread or server is not started
+ */
+expublic bool ndrxpy_srvmain(void)
+{
+    return M_srvmain_set && M_srvmain==std::this_thread::get_id();
+}
+
 int tpsvrinit(int argc, char *argv[])
 {
     py::gil_scoped_acquire acquire;
@@ -111,6 +244,13 @@ int tpsvrinit(int argc, char *argv[])
     /* set no jump, so that we can process recrusive buffer freeups.. */
     G_libatmisrv_flags|=ATMI_SRVLIB_NOLONGJUMP;
 
+    /* idle request file of the main thread is closed by the timer */
+    ndrxpy_tplog_reqcache_mode(NDRXPY_REQCACHE_POLLER);
+
+    /* poller callbacks (asyncio loop, deferred work) run in this thread */
+    M_srvmain = std::this_thread::get_id();
+    M_srvmain_set = true;
+
     if (hasattr(server, __func__))
     {
         std::vector<std::string> args;
@@ -125,12 +265,21 @@ int tpsvrinit(int argc, char *argv[])
 
 void tpsvrdone()
 {
+    /* finish requests queued to workers */
+    ndrxpy_pool_stop();
+
     py::gil_scoped_acquire acquire;
     if (hasattr(server, __func__))
     {
         server.attr(__func__)();
     }
     M_dispmap.clear();
+
+    std::map<std::string, std::shared_ptr<ndrxpy_routes_t>> routes;
+    {
+        std::lock_guard<std::mutex> lock(M_routes_mutex);
+        routes.swap(M_routes);
+    }
 }
 
 int tpsvrthrinit(int argc, char *argv[])
@@ -142,6 +291,9 @@ int tpsvrthrinit(int argc, char *argv[])
     auto const &internals = pybind11::detail::get_internals();
     PyThreadState_New(internals.istate);
 
+    /* no poller in dispatch thread to close idle request file */
+    ndrxpy_tplog_reqcache_mode(NDRXPY_REQCACHE_EAGER);
+
     py::gil_scoped_acquire acquire;
     if (hasattr(server, __func__))
     {
@@ -163,37 +315,154 @@ void tpsvrthrdone()
     }
 }
 /**
- * @brief Server dispatch function
+ * @brief Call python service function
  * 
  * @param svcinfo standard ATMI call descriptor
  */
-void PY(TPSVCINFO *svcinfo)
+expublic void ndrxpy_svc_dispatch(TPSVCINFO *svcinfo)
 {
+    tsvcresult.replied = false;
+
+    /* expired request file is not used by the next request */
+    ndrxpy_tplog_reqcache_sweep(false);
 
     try
     {
+        atmibuf ibuf(svcinfo);
+        ndrxpy_bufdec dec;
+        py::object *handler = nullptr;
+        std::shared_ptr<ndrxpy_routes_t> routes;
+
+        {
+            std::lock_guard<std::mutex> lock(M_routes_mutex);
+            auto rt = M_routes.find(svcinfo->name);
+
+            if (M_routes.end()!=rt)
+            {
+                routes = rt->second;
+            }
+        }
+
+        if (nullptr!=routes)
+        {
+            char type[8]={EXEOS};
+
+            /* rules are evaluated on the raw buffer, without GIL and
+             * before the buffer is walked for conversion */
+            if (nullptr!=svcinfo->data && EXFAIL!=tptypes(svcinfo->data, type, nullptr)
+                && 0==strcmp(type, "UBF"))
+            {
+                for (auto &r : routes->rules)
+                {
+                    int ret = Bboolev(*ibuf.fbfr(), r.tree);
+
+                    if (EXFAIL==ret)
+                    {
+                        throw ubf_exception(Berror);
+                    }
+                    else if (EXTRUE==ret)
+                    {
+                        handler = &r.func;
+                        break;
+                    }
+                }
+            }
+
+            if (nullptr==handler)
+            {
+                if (routes->dflt.is_none())
+                {
+                    NDRX_LOG(log_info, "Service [%s] request not matched by routing rules, rejecting",
+                            svcinfo->name);
+                    tsvcresult.replied = true;
+                    tpreturn(TPFAIL, routes->rcode, nullptr, 0, 0);
+                    return;
+                }
+
+                handler = &routes->dflt;
+            }
+        }
+
+        /* walk the request buffer before taking GIL, so that other
+         * dispatch threads are not blocked by the buffer scan */
+        ndrxpy_predecode(ibuf, dec);
+
         py::gil_scoped_acquire acquire;
-        auto ibuf=atmibuf(svcinfo);
-        auto idata = ndrx_to_py(ibuf);
 
-        pytpsvcinfo info(svcinfo);
+        /* dispatch map is modified by tpadvertise() under GIL */
+        if (nullptr==handler)
+        {
+            auto it = M_dispmap.find(svcinfo->fname);
+
+            if (M_dispmap.end()==it)
+            {
+                throw std::invalid_argument(std::string("Function not found: ") + svcinfo->fname);
+            }
+
+            handler = &it->second;
+        }
+
+        auto idata = ndrx_to_py(ibuf, dec);
+
+        /* owned by python, as async def handler uses the arguments
+         * after the dispatch has returned */
+        pytpsvcinfo *info = new pytpsvcinfo(svcinfo);
+        py::object infoobj = py::cast(info, py::return_value_policy::take_ownership);
+
+        info->data = idata;
 
-        info.data = idata;
+        /* request buffer stays with the dispatch, AtmiBuf handle is
+         * created on args.buf access and is emptied when call completes */
+        info->ibuf = &ibuf;
+        struct reqbuf_guard
+        {
+            pytpsvcinfo *info;
+            ~reqbuf_guard() { info->detach(); tsvcresult.info = nullptr; }
+        } guard {info};
 
-        auto && func = M_dispmap[svcinfo->fname];
+        /* request buffer may be used for reply by tpreturn_inplace() */
+        tsvcresult.info = info;
 
-        func(&info);
+        py::object ret = (*handler)(infoobj);
+        tsvcresult.info = nullptr;
+
+        /* async def handler, served by asyncio loop */
+        if (py::hasattr(ret, "__await__"))
+        {
+            /* request buffer lives with the task */
+            info->own();
+            ndrxpy_aio_dispatch(svcinfo->name, ret);
+            return;
+        }
 
     }
     catch (const std::exception &e)
     {
+        tsvcresult.info = nullptr;
         NDRX_LOG(log_error, "Got exception at tpreturn: %s", e.what());
         userlog(const_cast<char *>("%s"), e.what());
         /* return service error, soft-err*/
+        tsvcresult.replied = true;
         tpreturn(TPFAIL, TPESVCERR, nullptr, 0, TPSOFTERR);
     }
 }
 
+/**
+ * @brief Server dispatch function
+ * 
+ * @param svcinfo standard ATMI call descriptor
+ */
+void PY(TPSVCINFO *svcinfo)
+{
+    /* CPU bound services are served by the worker pool */
+    if (ndrxpy_pool_submit(svcinfo))
+    {
+        return;
+    }
+
+    ndrxpy_svc_dispatch(svcinfo);
+}
+
 /**
  * Standard tpadvertise()
  * @param [in] svcname service name
@@ -215,6 +484,8 @@ expublic void pytpadvertise(std::string svcname, std::string funcname, const py:
         M_dispmap[funcname] = func;
     }
 
+    /* service is no longer routed */
+    ndrxpy_routes_set(svcname, nullptr);
 }
 
 /**
@@ -233,6 +504,87 @@ expublic void ndrxpy_pytpunadvertise(const char *svcname)
         M_dispmap.erase(it);
     }
 
+    ndrxpy_routes_set(svcname, nullptr);
+}
+
+/**
+ * @brief Set or remove routing table of the service. Dispatch threads in
+ *  progress keep the old table till they are done with it.
+ * @param svcname service name
+ * @param routes routing table, nullptr - service is not routed
+ */
+exprivate void ndrxpy_routes_set(const std::string &svcname,
+        std::shared_ptr<ndrxpy_routes_t> routes)
+{
+    std::shared_ptr<ndrxpy_routes_t> old;
+
+    std::lock_guard<std::mutex> lock(M_routes_mutex);
+    auto it = M_routes.find(svcname);
+
+    if (M_routes.end()!=it)
+    {
+        /* freed after the lock is released */
+        old = std::move(it->second);
+        M_routes.erase(it);
+    }
+
+    if (nullptr!=routes)
+    {
+        M_routes[svcname] = routes;
+    }
+}
+
+/**
+ * @brief Advertise service with content based routing. Rules are compiled
+ *  before the service is advertised.
+ * @param svcname service name
+ * @param funcname function name
+ * @param rules list of (expression, handler) tuples
+ * @param dflt handler when no rule matches, None - reject
+ * @param rcode user return code for rejected requests
+ */
+exprivate void ndrxpy_tpadvertise_route(std::string svcname, std::string funcname,
+        py::list rules, py::object dflt, long rcode)
+{
+    /* compiled rules are freed by the table on failure */
+    auto routes = std::make_shared<ndrxpy_routes_t>();
+
+    routes->dflt = dflt;
+    routes->rcode = rcode;
+
+    for (auto item : rules)
+    {
+        auto rule = item.cast<py::tuple>();
+
+        if (2!=rule.size())
+        {
+            throw std::invalid_argument("Routing rule must be (expression, handler) tuple");
+        }
+
+        ndrxpy_route_t r;
+        r.expr = rule[0].cast<std::string>();
+        r.func = rule[1];
+
+        if (NULL==(r.tree=Bboolco(const_cast<char *>(r.expr.c_str()))))
+        {
+            NDRX_LOG(log_error, "Failed to compile [%s]: %s",
+                    r.expr.c_str(), Bstrerror(Berror));
+            throw ubf_exception(Berror);
+        }
+
+        routes->rules.push_back(r);
+    }
+
+    /* handlers are kept by the routing table, function name is not
+     * added to the dispatch map */
+    if (tpadvertise_full(const_cast<char *>(svcname.c_str()), PY,
+        const_cast<char *>(funcname.c_str())) == -1)
+    {
+        throw atmi_exception(tperrno);
+    }
+
+    /* re-advertise replaces the rules */
+    ndrxpy_routes_set(svcname, routes);
 }
 
 /**
@@ -403,7 +755,8 @@ expublic void ndrxpy_register_srv(py::module &m)
         .def_readonly("appkey", &pytpsvcinfo::appkey)
         .def_readonly("cd", &pytpsvcinfo::cd)
         .def_readonly("cltid", &pytpsvcinfo::cltid)
-        .def_readonly("data", &pytpsvcinfo::data);
+        .def_readonly("data", &pytpsvcinfo::data)
+        .def_property_readonly("buf", &pytpsvcinfo::getbuf);
 
     m.def(
         "tpadvertise", [](const char *svcname, const char *funcname, const py::object &func)
@@ -434,6 +787,80 @@ expublic void ndrxpy_register_srv(py::module &m)
         )pbdoc"
         , py::arg("svcname"), py::arg("funcname"), py::arg("func"));
 
+    m.def(
+        "tpext_advertiseroute", &ndrxpy_tpadvertise_route,
+        R"pbdoc(
+        Advertise service with content based routing. Request is matched against
+        the boolean expressions (see **Bboolco(3)**) in the given order, before the
+        request is converted to Python and before GIL is taken. Handler of the
+        first matching rule is called as a service function. If no rule matches,
+        *default* handler is called, or if *default* is **None**, request is
+        rejected with **TPFAIL** and user code *rcode*, without calling Python code.
+
+        Rules apply to **UBF** requests. For other buffer types only *default*
+        handler is used.
+
+        Rules belong to the service *svcname*, other services advertised with
+        the same *funcname* are not routed. Advertising the service again
+        replaces the rules, :func:`.tpadvertise` of the service or
+        :func:`.tpunadvertise` removes them.
+
+        This function applies to ATMI servers only.
+
+        .. code-block:: python
+            :caption: tpext_advertiseroute example
+            :name: tpext_advertiseroute-example
+
+            import sys
+            import endurox as e
+
+            class Server:
+
+                def tpsvrinit(self, args):
+                    e.tpext_advertiseroute("ACCOUNT", "ACCOUNT",
+                        [("T_STRING_FLD=='OPEN'", self.OPEN),
+                         ("T_STRING_FLD=='CLOSE'", self.CLOSE)], rcode=1)
+                    return 0
+
+                def OPEN(self, args):
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+                def CLOSE(self, args):
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+            if __name__ == '__main__':
+                e.run(Server(), sys.argv)
+
+        :raise UbfException:
+            | Following error codes may be present:
+            | :data:`.BSYNTAX` - Invalid expression.
+            | :data:`.BBADNAME` - Field name not found.
+        :raise AtmiException:
+            | Following error codes may be present:
+            | :data:`.TPEINVAL` - Service name empty or too long (longer than **MAXTIDENT**)
+            | :data:`.TPELIMIT` - More than 48 services attempted to advertise by the script.
+            | :data:`.TPEMATCH` - Service already advertised.
+            | :data:`.TPEOS` - System error.
+        :raise ValueError:
+            | Invalid rule.
+
+        Parameters
+        ----------
+        svcname : str
+            Service name to advertise
+        funcname : str
+            Function name of the service
+        routes : list
+            List of **(expression, handler)** tuples. Handler receives **TPSVCINFO**
+            argument, as service function for :func:`.tpadvertise`.
+        default : object
+            Handler for requests not matched by any rule. **None** - reject.
+        rcode : int
+            User return code of rejected requests.
+        )pbdoc"
+        , py::arg("svcname"), py::arg("funcname"), py::arg("routes"),
+        py::arg("default")=py::none(), py::arg("rcode")=0);
+
     m.def("tpsubscribe", &ndrxpy_pytpsubscribe,
         R"pbdoc(
         Subscribe to event. Once event is published by the **tppost(3)**, it is
@@ -691,6 +1118,48 @@ expublic void ndrxpy_register_srv(py::module &m)
         )pbdoc",
           py::arg("rval"), py::arg("rcode"), py::arg("data"),
           py::arg("flags") = 0);
+    m.def("tpreturn_inplace", &ndrxpy_pytpreturn_inplace, 
+        R"pbdoc(
+        Return from ATMI service call by re-using the request buffer received
+        by the service. Only the fields which differ between the request buffer
+        and *data* are changed (added, updated or deleted), thus services which
+        return modified request do not rebuild the whole reply buffer.
+
+        Request buffer is updated in place if both request and reply are **UBF**
+        buffers, the reply has no *callinfo* and request has no **BFLD_PTR** fields.
+        In other cases function works as :func:`.tpreturn`.
+
+        This function applies to ATMI servers only and shall be called from the
+        service dispatch thread.
+
+        .. code-block:: python
+            :caption: tpreturn_inplace example
+            :name: tpreturn_inplace-example
+
+                def ECHOSV(self, args):
+                    args.data["data"]["T_STRING_2_FLD"] = "Changed"
+                    del args.data["data"]["T_LONG_FLD"]
+                    return e.tpreturn_inplace(e.TPSUCCESS, 0, args.data)
+        
+        For more details see **tpreturn(3)** C API call.
+
+        :raise UbfException: 
+            | Errors from updating request buffer fields.
+
+        Parameters
+        ----------
+        rval : int
+            Return value :data:`.TPSUCCESS` for success, :data:`.TPFAIL` for returning error
+            :data:`.TPEXIT` for returning error and restarting the ATMI server process.
+        rcode : int
+            User return code. If not used, use value **0**.
+        data : dict
+            ATMI buffer returned from the service
+        flags : int
+            RFU, shall be set to **0**.
+        )pbdoc",
+          py::arg("rval"), py::arg("rcode"), py::arg("data"),
+          py::arg("flags") = 0);
     m.def("tpforward", &ndrxpy_pytpforward,
           R"pbdoc(
         Forward control to other service. This shall be last ATMI call
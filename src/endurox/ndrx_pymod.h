@@ -45,6 +45,10 @@
 #include <ndebug.h>
 #undef _
 
+#include <map>
+#include <memory>
+#include <vector>
+
 /*---------------------------Externs------------------------------------*/
 /*---------------------------Macros-------------------------------------*/
 #define NDRXPY_DATA_DATA        "data"      /**< Actual data field          */
@@ -57,6 +61,18 @@
 #define NDRXPY_DO_FREE          1           /**< free up buffer recursive   */
 #define NDRXPY_DO_NEVERFREE     2           /**< never free up buffer , recu*/
 
+#define NDRXPY_STRENC_UTF8      0           /**< STRING fields in UTF-8     */
+#define NDRXPY_STRENC_LOCALE    1           /**< use locale encoding        */
+#define NDRXPY_STRENC_BYTES     2           /**< STRING fields as bytes     */
+
+#define NDRXPY_LOGASYNC_BLOCK   0           /**< full log ring: wait        */
+#define NDRXPY_LOGASYNC_DROP    1           /**< full log ring: drop        */
+#define NDRXPY_LOGASYNC_COUNT   2           /**< drop and log drop count    */
+
+#define NDRXPY_REQCACHE_USER    0           /**< idle file swept by user    */
+#define NDRXPY_REQCACHE_POLLER  1           /**< swept by the server timer  */
+#define NDRXPY_REQCACHE_EAGER   2           /**< request file not cached    */
+
 /*---------------------------Enums--------------------------------------*/
 /*---------------------------Typedefs-----------------------------------*/
 
@@ -91,6 +107,8 @@ struct pytptranid
 };
 
 
+class atmibuf;
+
 /**
  * @brief Extend the ATMI C struct with python specific fields
  */
@@ -110,6 +128,13 @@ struct pytpsvcinfo: TPSVCINFO
         cltid.pycltid = py::bytes(reinterpret_cast<char *>(&inf->cltid), sizeof(inf->cltid));
     }
     py::object data;
+    atmibuf *ibuf = nullptr;    /**< request buffer, owned by dispatch      */
+    py::object buf;             /**< request buffer handle (AtmiBuf)        */
+
+    py::object getbuf(void);
+    atmibuf *reqbuf(void);
+    void own(void);
+    void detach(void);
 };
 
 /**
@@ -148,6 +173,120 @@ private:
     void swap(atmibuf &other) noexcept;
 };
 
+/**
+ * @brief Native ATMI buffer handle, exposed to Python as AtmiBuf.
+ *  Buffer is kept in ATMI format and UBF fields are changed in place.
+ */
+class pyatmibuf
+{
+public:
+
+    atmibuf buf;
+    bool isubf;     /**< UBF buffer */
+
+    pyatmibuf(atmibuf &&b) : buf(std::move(b)), isubf(false)
+    {
+        char type[8]={EXEOS};
+        char subtype[16]={EXEOS};
+
+        if (nullptr!=*buf.pp && EXFAIL!=tptypes(*buf.pp, type, subtype)
+            && 0==strcmp(type, "UBF"))
+        {
+            isubf = true;
+            /* grow from allocated size */
+            buf.len = Bsizeof(*buf.fbfr());
+        }
+    }
+
+    /**
+     * @brief Get UBF buffer
+     * @return UBF handle
+     */
+    UBFH *ubf(void)
+    {
+        if (nullptr==*buf.pp)
+        {
+            throw std::invalid_argument("AtmiBuf is released, service call is completed");
+        }
+
+        if (!isubf)
+        {
+            throw std::invalid_argument("AtmiBuf is not UBF buffer");
+        }
+        return *buf.fbfr();
+    }
+};
+
+/**
+ * @brief Request buffer handle, created on first access. Handle of the
+ *  synchronous service is valid during the service call only.
+ * @return AtmiBuf handle or None if service call is completed
+ */
+inline py::object pytpsvcinfo::getbuf(void)
+{
+    if (nullptr==buf.ptr())
+    {
+        if (nullptr==ibuf)
+        {
+            return py::none();
+        }
+
+        buf = py::cast(new pyatmibuf(std::move(*ibuf)), py::return_value_policy::take_ownership);
+    }
+
+    return buf;
+}
+
+/**
+ * @return current holder of the request buffer, nullptr if not available
+ */
+inline atmibuf *pytpsvcinfo::reqbuf(void)
+{
+    if (nullptr==ibuf)
+    {
+        return nullptr;
+    }
+
+    if (nullptr!=buf.ptr())
+    {
+        return &buf.cast<pyatmibuf *>()->buf;
+    }
+
+    return ibuf;
+}
+
+/**
+ * @brief Request buffer ownership goes to the handle, for requests which
+ *  are served after the dispatch returns (coroutines)
+ */
+inline void pytpsvcinfo::own(void)
+{
+    getbuf();
+    ibuf = nullptr;
+}
+
+/**
+ * @brief Service call completed: request buffer goes back to the dispatch,
+ *  handle kept by user code is emptied.
+ */
+inline void pytpsvcinfo::detach(void)
+{
+    if (nullptr==ibuf)
+    {
+        return;
+    }
+
+    if (nullptr!=buf.ptr())
+    {
+        auto h = buf.cast<pyatmibuf *>();
+
+        *ibuf = std::move(h->buf);
+        h->isubf = false;
+    }
+
+    ibuf = nullptr;
+}
+
 /**
  * Temporary buffer allocator
  */
@@ -175,6 +314,131 @@ public:
     }
 };
 
+/**
+ * Contiguous view of Python object supporting buffer protocol
+ * (bytes, bytearray, memoryview, mmap, etc.). Data is not copied,
+ * view is released when object goes out of scope (GIL must be held).
+ */
+class pybufview
+{
+
+public:
+
+    Py_buffer view;
+
+    pybufview(py::handle obj, bool writable=false)
+    {
+        if (EXSUCCEED!=PyObject_GetBuffer(obj.ptr(), &view,
+            writable?PyBUF_WRITABLE:PyBUF_SIMPLE))
+        {
+            throw py::error_already_set();
+        }
+    }
+
+    pybufview(const pybufview &) = delete;
+    pybufview &operator=(const pybufview &) = delete;
+
+    ~pybufview()
+    {
+        PyBuffer_Release(&view);
+    }
+
+    char *buf() {return reinterpret_cast<char *>(view.buf);}
+    long len() {return static_cast<long>(view.len);}
+};
+
+/**
+ * Per call override of STRING field encoding (see NDRXPY_STRENC_*),
+ * previous setting is restored when leaving the scope.
+ * Empty encoding name keeps the current setting.
+ */
+class ndrxpy_strenc_guard
+{
+
+public:
+
+    ndrxpy_strenc_guard(const std::string &enc);
+    ndrxpy_strenc_guard(const ndrxpy_strenc_guard &) = delete;
+    ndrxpy_strenc_guard &operator=(const ndrxpy_strenc_guard &) = delete;
+    ~ndrxpy_strenc_guard();
+
+private:
+
+    int prev;
+};
+
+/**
+ * Per conversion memo of BFLD_PTR buffers, so that buffers referenced
+ * from several fields are converted once and identity is preserved
+ * (in both directions). Installed by the outermost conversion call,
+ * nested calls share it.
+ */
+class ndrxpy_ptrmemo
+{
+
+public:
+
+    std::map<char *, py::object> topy;      /**< ATMI buffer -> python     */
+    std::map<PyObject *, char *> frompy;    /**< python dict -> ATMI buffer*/
+
+    ndrxpy_ptrmemo() : top(nullptr==current)
+    {
+        if (top)
+        {
+            current = this;
+        }
+    }
+
+    ndrxpy_ptrmemo(const ndrxpy_ptrmemo &) = delete;
+    ndrxpy_ptrmemo &operator=(const ndrxpy_ptrmemo &) = delete;
+
+    ~ndrxpy_ptrmemo()
+    {
+        if (top)
+        {
+            current = nullptr;
+        }
+    }
+
+    /**
+     * @return active memo of current conversion
+     */
+    static ndrxpy_ptrmemo *get(void) {return current;}
+
+private:
+
+    bool top;
+    static thread_local ndrxpy_ptrmemo *current;
+};
+
+/**
+ * UBF field occurrence located in the buffer, without python objects.
+ * Pointers are valid while the buffer is not changed.
+ */
+struct ndrxpy_ubffld
+{
+    BFLDID fldid;   /**< field id                   */
+    BFLDOCC occ;    /**< occurrence                 */
+    char *d_ptr;    /**< data in the buffer         */
+    BFLDLEN len;    /**< data length                */
+    char *name;     /**< field name or nullptr      */
+};
+
+/**
+ * Buffer decoded in the first phase of conversion, which does not
+ * need GIL (buffer type, UBF field walk, call info).
+ * See ndrxpy_predecode() and ndrx_to_py().
+ */
+struct ndrxpy_bufdec
+{
+    char type[8]={EXEOS};
+    char subtype[16]={EXEOS};
+    long size = 0;
+    std::vector<ndrxpy_ubffld> flds;        /**< UBF fields             */
+    atmibuf cibuf;                          /**< call info buffer       */
+    bool has_ci = false;                    /**< call info present      */
+    std::vector<ndrxpy_ubffld> ciflds;      /**< call info fields       */
+};
 
 typedef void *(xao_svc_ctx)(void *);
 
@@ -353,9 +617,13 @@ struct pytpcontext
      */
     void getCtxt(TPCONTEXT_T *ctxt)
     {
-        std::string val(PyBytes_AsString(ctx_bytes.ptr()), PyBytes_Size(ctx_bytes.ptr()));
-        memcpy(reinterpret_cast<char *>(ctxt), 
-            const_cast<char *>(val.data()), val.size());
+        if (sizeof(TPCONTEXT_T)!=PyBytes_Size(ctx_bytes.ptr()))
+        {
+            throw std::invalid_argument("Invalid context handle");
+        }
+
+        memcpy(reinterpret_cast<char *>(ctxt), PyBytes_AsString(ctx_bytes.ptr()),
+            sizeof(TPCONTEXT_T));
     }
     py::bytes ctx_bytes;
 };
@@ -378,20 +646,34 @@ struct pytpgetctxtret
 
 extern xao_svc_ctx *xao_svc_ctx_ptr;
 
+extern int G_ndrxpy_strenc;
+
 extern atmibuf ndrx_from_py(py::object obj);
 extern py::object ndrx_to_py(atmibuf &buf);
+extern void ndrxpy_predecode(atmibuf &buf, ndrxpy_bufdec &dec);
+extern py::object ndrx_to_py(atmibuf &buf, ndrxpy_bufdec &dec);
+extern int ndrxpy_strenc_parse(const std::string &enc);
+extern const char *ndrxpy_str_enc(py::handle obj, Py_ssize_t *len, py::object &tmp);
+extern py::object ndrxpy_str_dec(const char *str, Py_ssize_t len);
 
 //Buffer conversion support:
 extern void ndrxpy_from_py_view(py::dict obj, atmibuf &b, const char *view);
 extern py::object ndrxpy_to_py_view(char *cstruct, char *vname, long size);
 
 extern py::object ndrxpy_to_py_ubf(UBFH *fbfr, BFLDLEN buflen);
+extern void ndrxpy_ubf_scan(UBFH *fbfr, std::vector<ndrxpy_ubffld> &flds);
+extern py::object ndrxpy_ubf_build(std::vector<ndrxpy_ubffld> &flds);
 extern void ndrxpy_from_py_ubf(py::dict obj, atmibuf &b);
+extern int ndrxpy_from_py_ubf_delta(py::dict obj, atmibuf &b);
+extern BFLDID ndrxpy_fldid(py::handle key);
+extern void ndrxpy_ubf_set(atmibuf &b, BFLDID fieldid, BFLDOCC oc, py::handle obj);
+extern py::object ndrxpy_ubf_get(UBFH *fbfr, BFLDID fieldid, BFLDOCC oc);
 
 extern void pytpadvertise(std::string svcname, std::string funcname, const py::object &func);
 extern void ndrxpy_pyrun(py::object svr, std::vector<std::string> args);
 
 extern void ndrxpy_pytpreturn(int rval, long rcode, py::object data, long flags);
+extern void ndrxpy_pytpreturn_inplace(int rval, long rcode, py::object data, long flags);
 extern void ndrxpy_pytpforward(const std::string &svc, py::object data, long flags);
 
 extern void ndrxpy_pytpunadvertise(const char * svcname);
@@ -401,21 +683,68 @@ extern NDRXPY_TPQCTL ndrxpy_pytpenqueue(const char *qspace, const char *qname, N
 extern std::pair<NDRXPY_TPQCTL, py::object> ndrx_pytpdequeue(const char *qspace,
                                                  const char *qname, NDRXPY_TPQCTL *ctl,
                                                  long flags);
-extern pytpreply ndrxpy_pytpcall(const char *svc, py::object idata, long flags);
+extern pytpreply ndrxpy_pytpcall(const char *svc, py::object idata, long flags,
+        const std::string &rtype, const std::string &rsubtype, long rsize,
+        const std::string &strenc);
 extern int ndrxpy_pytpacall(const char *svc, py::object idata, long flags);
 
 extern py::object ndrxpy_pytpexport(py::object idata, long flags);
-extern py::object ndrxpy_pytpimport(const std::string istr, long flags);
+extern py::list ndrxpy_pytpexport_many(py::list idata, long flags);
+extern py::object ndrxpy_pytpimport(py::object istr, long flags);
+extern py::list ndrxpy_pytpimport_many(py::list istrs, long flags);
 
-extern pytpreplycd ndrxpy_pytpgetrply(int cd, long flags);
+extern pytpreplycd ndrxpy_pytpgetrply(int cd, long flags,
+        const std::string &rtype, const std::string &rsubtype, long rsize,
+        const std::string &strenc);
 extern int ndrxpy_pytppost(const std::string eventname, py::object data, long flags);
 extern long ndrxpy_pytpsubscribe(char *eventexpr, char *filter, TPEVCTL *ctl, long flags);
 
+extern void ndrxpy_tplog_invalidate(void);
+extern int ndrxpy_tplog_level(void);
+extern int ndrxpy_tplog_reqcache_sweep(bool force);
+extern void ndrxpy_tplog_reqcache_mode(int mode);
+extern bool ndrxpy_tplog_async(int lev, const char *msg, Py_ssize_t len);
+extern int ndrxpy_tpgetctxt(TPCONTEXT_T *ctxt, long flags);
+extern int ndrxpy_tpsetctxt(TPCONTEXT_T ctxt, long flags);
+extern void ndrxpy_tplog_ctxfree(TPCONTEXT_T ctxt);
+
+extern long ndrxpy_tpext_addtimer(long msec, const py::object &func,
+        bool periodic, const py::object &ptr1);
+extern bool ndrxpy_tpext_deltimer(long tid);
+extern void ndrxpy_tpext_b4poll_pin(void);
+extern int ndrxpy_aio_b4poll(void);
+extern void ndrxpy_aio_dispatch(const char *svc, py::object coro);
+extern void ndrxpy_aio_reply_ctx(void);
+extern void ndrxpy_svc_dispatch(TPSVCINFO *svcinfo);
+extern bool ndrxpy_srvmain(void);
+extern bool ndrxpy_pool_submit(TPSVCINFO *svcinfo);
+extern bool ndrxpy_pool_reply(int rval, long rcode, const char *svc, py::object data);
+extern int ndrxpy_pool_b4poll(void);
+extern void ndrxpy_pool_stop(void);
+extern bool ndrxpy_callcache_get(const char *svc, atmibuf &in, std::string &key,
+        atmibuf &out, long *urcode);
+extern void ndrxpy_callcache_put(const char *svc, std::string &key, atmibuf &out, long urcode);
+struct ndrxpy_flight;
+extern std::shared_ptr<ndrxpy_flight> ndrxpy_callflight_begin(const char *svc,
+        long flags, atmibuf &in, bool *leader);
+extern void ndrxpy_callflight_end(std::shared_ptr<ndrxpy_flight> &f, int err,
+        atmibuf *out, long urcode);
+extern int ndrxpy_callflight_wait(std::shared_ptr<ndrxpy_flight> &f, atmibuf &out,
+        long *urcode);
+
 extern void ndrxpy_register_atmi(py::module &m);
 extern void ndrxpy_register_ubf(py::module &m);
 extern void ndrxpy_register_srv(py::module &m);
 extern void ndrxpy_register_tpext(py::module &m);
 extern void ndrxpy_register_tplog(py::module &m);
+extern void ndrxpy_register_convstream(py::module &m);
+extern void ndrxpy_register_atmibuf(py::module &m);
+extern void ndrxpy_register_bufsnap(py::module &m);
+extern void ndrxpy_register_tplogasync(py::module &m);
+extern void ndrxpy_register_srvaio(py::module &m);
+extern void ndrxpy_register_srvpool(py::module &m);
+extern void ndrxpy_register_callcache(py::module &m);
+extern void ndrxpy_register_ctxpool(py::module &m);
 #endif /* NDRX_PYMOD.H */
 
 /* vim: set ts=4 sw=4 et smartindent: */
@@ -0,0 +1,488 @@
+/**
+ * @brief asyncio service handlers for ATMI server
+ *
+ * @file srvaio.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <poll.h>
+
+#include <atmi.h>
+#include <userlog.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Detached service request, served by coroutine
+ */
+struct ndrxpy_aioreq
+{
+    std::string ctx;        /**< tpsrvgetctxdata() image        */
+    std::string svc;        /**< service name, for logging      */
+    bool replied = false;   /**< tpreturn/tpforward done        */
+};
+
+/**
+ * @brief asyncio loop driven by the server poller
+ */
+typedef struct
+{
+    py::object loop;        /**< event loop                     */
+    py::object ctxvar;      /**< ContextVar with current request*/
+    py::object timer;       /**< loop timer callback            */
+    int fd;                 /**< selector fd                    */
+    bool polled;            /**< fd is added to the poller      */
+    bool running;           /**< loop iteration in progress     */
+    long timer_id;          /**< timer id, 0 - not active       */
+    double timer_when;      /**< loop time the timer is set to  */
+    long inflight;          /**< requests served by coroutines  */
+} ndrxpy_aio_t;
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+
+/** asyncio state, not freed, as py objects live till the process exit */
+exprivate ndrxpy_aio_t *M_aio = nullptr;
+
+/*---------------------------Prototypes---------------------------------*/
+
+exprivate void aio_timer_update(void);
+
+/**
+ * @brief Run one iteration of the event loop (ready callbacks and I/O
+ *  events which are ready) and set the timer for the next scheduled
+ *  callback, GIL must be held.
+ */
+exprivate void aio_step(void)
+{
+    if (M_aio->running)
+    {
+        return;
+    }
+
+    M_aio->running = true;
+
+    try
+    {
+        M_aio->loop.attr("call_soon")(M_aio->loop.attr("stop"));
+        M_aio->loop.attr("run_forever")();
+        aio_timer_update();
+    }
+    catch (std::exception &e)
+    {
+        NDRX_LOG(log_error, "asyncio loop iteration failed: %s", e.what());
+        userlog(const_cast<char *>("asyncio loop iteration failed: %s"), e.what());
+    }
+
+    M_aio->running = false;
+}
+
+/**
+ * @brief Selector fd has events
+ * @param fd selector fd
+ * @param events poll events
+ * @param ptr1 not used
+ * @return 0
+ */
+exprivate int aio_fd_cb(int fd, uint32_t events, void *ptr1)
+{
+    py::gil_scoped_acquire acquire;
+    aio_step();
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Set one-shot timer to the earliest scheduled handle of the loop
+ *  (asyncio.sleep, timeouts), or remove it if nothing is scheduled.
+ *  Timer is kept, if the head of the schedule did not change.
+ */
+exprivate void aio_timer_update(void)
+{
+    py::object sched = M_aio->loop.attr("_scheduled");
+
+    if (0==py::len(sched))
+    {
+        if (0!=M_aio->timer_id)
+        {
+            ndrxpy_tpext_deltimer(M_aio->timer_id);
+            M_aio->timer_id = 0;
+        }
+        return;
+    }
+
+    double when = sched[py::int_(0)].attr("when")().cast<double>();
+
+    if (0!=M_aio->timer_id)
+    {
+        if (when==M_aio->timer_when)
+        {
+            return;
+        }
+
+        ndrxpy_tpext_deltimer(M_aio->timer_id);
+        M_aio->timer_id = 0;
+    }
+
+    double delay = when - M_aio->loop.attr("time")().cast<double>();
+    long msec = delay > 0 ? static_cast<long>(std::ceil(delay*1000)) : 0;
+
+    M_aio->timer_id = ndrxpy_tpext_addtimer(msec, M_aio->timer, false, py::none());
+    M_aio->timer_when = when;
+}
+
+/**
+ * @brief Check that called by the server main thread
+ * @param what operation, for the error message
+ */
+exprivate void aio_thread_check(const char *what)
+{
+    if (!ndrxpy_srvmain())
+    {
+        throw std::invalid_argument(std::string(what) +
+                " is supported by server main thread only");
+    }
+}
+
+/**
+ * @brief Create event loop, GIL must be held
+ */
+exprivate void aio_init(void)
+{
+    aio_thread_check("asyncio");
+
+    if (nullptr!=M_aio)
+    {
+        return;
+    }
+
+    auto asyncio = py::module::import("asyncio");
+    auto selectors = py::module::import("selectors");
+    auto contextvars = py::module::import("contextvars");
+
+    py::object sel = selectors.attr("DefaultSelector")();
+
+    if (!py::hasattr(sel, "fileno"))
+    {
+        throw std::invalid_argument("Selector without file descriptor is not supported");
+    }
+
+    std::unique_ptr<ndrxpy_aio_t> aio(new ndrxpy_aio_t());
+
+    aio->loop = asyncio.attr("SelectorEventLoop")(sel);
+    aio->ctxvar = contextvars.attr("ContextVar")("endurox_aioreq", py::arg("default")=py::none());
+    aio->timer = py::cpp_function([](long tid, py::object ptr1)
+        {
+            /* one-shot timer is removed when fired */
+            M_aio->timer_id = 0;
+            aio_step();
+            return EXSUCCEED;
+        });
+    aio->fd = sel.attr("fileno")().cast<int>();
+    aio->polled = false;
+    aio->running = false;
+    aio->timer_id = 0;
+    aio->timer_when = 0;
+    aio->inflight = 0;
+
+    asyncio.attr("set_event_loop")(aio->loop);
+
+    /* selector fd is added to the poller before poll */
+    ndrxpy_tpext_b4poll_pin();
+
+    M_aio = aio.release();
+
+    NDRX_LOG(log_info, "asyncio loop initialized, selector fd=%d", M_aio->fd);
+}
+
+/**
+ * @brief Before server poll: add selector fd to the poller and run
+ *  first steps of the coroutines started by the services.
+ * @return 0 ok, -1 failure
+ */
+expublic int ndrxpy_aio_b4poll(void)
+{
+    if (nullptr==M_aio)
+    {
+        return EXSUCCEED;
+    }
+
+    if (!M_aio->polled)
+    {
+        if (EXSUCCEED!=tpext_addpollerfd(M_aio->fd, POLLIN, NULL, aio_fd_cb))
+        {
+            NDRX_LOG(log_error, "Failed to add asyncio selector fd %d to poller: %s",
+                    M_aio->fd, tpstrerror(tperrno));
+            return EXFAIL;
+        }
+        M_aio->polled = true;
+    }
+
+    if (M_aio->inflight > 0)
+    {
+        py::gil_scoped_acquire acquire;
+        aio_step();
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Coroutine of the request is completed. If service did not
+ *  reply, TPESVCERR is returned to the caller.
+ * @param reqobj request object
+ * @param task completed task
+ */
+exprivate void aio_done(py::object reqobj, py::object task)
+{
+    auto req = reqobj.cast<ndrxpy_aioreq *>();
+    std::string err;
+
+    M_aio->inflight--;
+
+    if (task.attr("cancelled")().cast<bool>())
+    {
+        err = "cancelled";
+    }
+    else
+    {
+        py::object exc = task.attr("exception")();
+
+        if (!exc.is_none())
+        {
+            err = py::str(exc);
+        }
+    }
+
+    if (req->replied)
+    {
+        if (!err.empty())
+        {
+            NDRX_LOG(log_error, "Service [%s] coroutine failed after reply: %s",
+                    req->svc.c_str(), err.c_str());
+        }
+        return;
+    }
+
+    NDRX_LOG(log_error, "Service [%s] coroutine completed without reply: %s",
+            req->svc.c_str(), err.c_str());
+    userlog(const_cast<char *>("Service [%s] coroutine completed without reply: %s"),
+            req->svc.c_str(), err.c_str());
+
+    req->replied = true;
+
+    if (EXSUCCEED!=tpsrvsetctxdata(const_cast<char *>(req->ctx.data()), 0))
+    {
+        NDRX_LOG(log_error, "Failed to restore [%s] context: %s",
+                req->svc.c_str(), tpstrerror(tperrno));
+        return;
+    }
+
+    tpreturn(TPFAIL, TPESVCERR, nullptr, 0, TPSOFTERR);
+}
+
+/**
+ * @brief Serve request by coroutine returned by the service function.
+ *  Request context is captured and server continues with the next
+ *  request. Called from the service dispatch, GIL held.
+ * @param svc service name
+ * @param coro coroutine
+ */
+expublic void ndrxpy_aio_dispatch(const char *svc, py::object coro)
+{
+    char *buf;
+    long len = 0;
+
+    try
+    {
+        /* loop and request contexts belong to the poller thread */
+        aio_thread_check("async def service");
+        aio_init();
+
+        if (NULL==(buf=tpsrvgetctxdata2(NULL, &len)))
+        {
+            throw atmi_exception(tperrno);
+        }
+    }
+    catch (...)
+    {
+        coro.attr("close")();
+        throw;
+    }
+
+    ndrxpy_aioreq *req = new ndrxpy_aioreq();
+    py::object reqobj = py::cast(req, py::return_value_policy::take_ownership);
+
+    req->ctx.assign(buf, len);
+    req->svc = svc;
+    tpsrvfreectxdata(buf);
+
+    /* task copies current context, i.e. the request */
+    py::object token = M_aio->ctxvar.attr("set")(reqobj);
+    py::object task = M_aio->loop.attr("create_task")(coro);
+    M_aio->ctxvar.attr("reset")(token);
+
+    task.attr("add_done_callback")(py::cpp_function([reqobj](py::object t)
+        {
+            aio_done(reqobj, t);
+        }));
+
+    M_aio->inflight++;
+
+    tpcontinue();
+}
+
+/**
+ * @brief Restore request context before reply, if called from the
+ *  coroutine serving the request.
+ */
+expublic void ndrxpy_aio_reply_ctx(void)
+{
+    if (nullptr==M_aio)
+    {
+        return;
+    }
+
+    py::object reqobj = M_aio->ctxvar.attr("get")();
+
+    if (reqobj.is_none())
+    {
+        return;
+    }
+
+    auto req = reqobj.cast<ndrxpy_aioreq *>();
+
+    if (req->replied)
+    {
+        throw std::runtime_error("tpreturn already called");
+    }
+
+    if (EXSUCCEED!=tpsrvsetctxdata(const_cast<char *>(req->ctx.data()), 0))
+    {
+        throw atmi_exception(tperrno);
+    }
+
+    req->replied = true;
+}
+
+/**
+ * @brief Register asyncio server api
+ *
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_srvaio(py::module &m)
+{
+    py::class_<ndrxpy_aioreq>(m, "_AioRequest")
+        .def_readonly("svc", &ndrxpy_aioreq::svc)
+        .def_readonly("replied", &ndrxpy_aioreq::replied);
+
+    m.def(
+        "tpext_asyncio",
+        []()
+        {
+            aio_init();
+            return M_aio->loop;
+        },
+        R"pbdoc(
+        Enable asyncio service handlers. Event loop is created and set as
+        current loop of the server main thread. Loop runs from the server
+        poller: selector file descriptor is added by :func:`.tpext_addpollerfd`
+        logic, ready callbacks are run before the server goes to poll, and the
+        earliest scheduled callback of the loop (e.g. **asyncio.sleep()**
+        wake-up) is served by one-shot :func:`.tpext_addtimer` timer, which is
+        re-set after each loop step.
+
+        Service function defined with **async def** returns coroutine. In such
+        case the request context is captured by :func:`.tpsrvgetctxdata`, server
+        performs :func:`.tpcontinue` and takes the next request. When the
+        coroutine calls :func:`.tpreturn` or :func:`.tpforward`, context of
+        its request is restored (:func:`.tpsrvsetctxdata`) and reply is sent.
+        If coroutine completes without reply (or raises exception), caller
+        receives :data:`.TPESVCERR`.
+
+        Function is called automatically by the first asyncio handler. Loop
+        and coroutine handlers are served by the server main thread only, i.e.
+        single threaded ATMI servers. In other threads (multi-threaded server
+        dispatch threads) and in :func:`.tpext_workerpool` workers, **async
+        def** service fails with :data:`.TPESVCERR`.
+
+        .. code-block:: python
+            :caption: tpext_asyncio example
+            :name: tpext_asyncio-example
+
+            import sys, asyncio
+            import endurox as e
+
+            class Server:
+
+                def tpsvrinit(self, args):
+                    e.tpext_asyncio()
+                    e.tpadvertise('ASYNCSV', 'ASYNCSV', self.ASYNCSV)
+                    return 0
+
+                async def ASYNCSV(self, args):
+                    await asyncio.sleep(0.1)
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+            if __name__ == '__main__':
+                e.run(Server(), sys.argv)
+
+        :raise ValueError:
+            | Not called by the server main thread.
+
+        Returns
+        -------
+        loop : asyncio.AbstractEventLoop
+            Server event loop.
+
+         )pbdoc");
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
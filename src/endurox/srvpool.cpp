@@ -0,0 +1,1188 @@
+/**
+ * @brief Worker process pool for CPU bound ATMI services
+ *
+ * @file srvpool.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atmi.h>
+#include <userlog.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_POOL_REPLY       "R"     /**< tpreturn() by the worker   */
+#define NDRXPY_POOL_FORWARD     "F"     /**< tpforward() by the worker  */
+#define NDRXPY_POOL_ERROR       "E"     /**< no reply, exception        */
+
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Request handed over to the worker process
+ */
+typedef struct
+{
+    std::string ctx;        /**< tpsrvgetctxdata() image                  */
+    std::string req;        /**< pickled request                          */
+    std::string svc;        /**< service name, for logging                */
+} ndrxpy_pooljob_t;
+
+/**
+ * @brief Worker process, server side
+ */
+typedef struct
+{
+    pid_t pid;              /**< worker process, 0 - not running          */
+    int reqfd;              /**< request pipe, write end                  */
+    int rspfd;              /**< reply pipe, read end, non-blocking       */
+    bool polled;            /**< rspfd is added to the server poller      */
+    std::string rbuf;       /**< reply bytes received so far              */
+    ndrxpy_pooljob_t *job;  /**< request served, nullptr - idle           */
+} ndrxpy_poolwrk_t;
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+
+/* Pool state is used by the server main thread, under GIL */
+
+/** worker processes */
+exprivate std::vector<ndrxpy_poolwrk_t*> M_pool_workers {};
+
+/** jobs waiting for the worker */
+exprivate std::deque<ndrxpy_pooljob_t*> M_pool_jobs {};
+
+/** functions served by the pool, cleared at pool stop */
+exprivate std::map<std::string, py::object> M_pool_funcs {};
+
+/** max jobs queued, 0 - unlimited */
+exprivate long M_pool_maxqueue = 0;
+
+/** pool is stopping, workers are not restarted */
+exprivate bool M_pool_stop = false;
+
+/** running in the worker process */
+exprivate bool M_pool_child = false;
+
+/** reply of the current request, worker process */
+exprivate py::object *M_pool_result = nullptr;
+
+exprivate long M_pool_queued = 0;   /**< jobs submitted                 */
+exprivate long M_pool_done = 0;     /**< jobs completed                 */
+exprivate long M_pool_waits = 0;    /**< dispatcher waited for the space*/
+exprivate long M_pool_restarts = 0; /**< worker processes restarted     */
+
+/*---------------------------Prototypes---------------------------------*/
+
+exprivate void pool_next(ndrxpy_poolwrk_t *w);
+
+/**
+ * @brief Write all bytes to the pipe
+ * @param fd file descriptor
+ * @param buf data
+ * @param len data length
+ * @return 0 ok, -1 failure (errno set)
+ */
+exprivate int pool_writen(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0)
+        {
+            if (EINTR==errno)
+            {
+                continue;
+            }
+            return EXFAIL;
+        }
+
+        buf+=n;
+        len-=n;
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Read exactly len bytes from the pipe (blocking)
+ * @param fd file descriptor
+ * @param buf output
+ * @param len bytes to read
+ * @return 0 ok, -1 failure or EOF
+ */
+exprivate int pool_readn(int fd, char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read(fd, buf, len);
+
+        if (n < 0 && EINTR==errno)
+        {
+            continue;
+        }
+        else if (n <= 0)
+        {
+            return EXFAIL;
+        }
+
+        buf+=n;
+        len-=n;
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Send length prefixed message
+ * @param fd file descriptor
+ * @param msg message
+ * @return 0 ok, -1 failure (errno set)
+ */
+exprivate int pool_send_msg(int fd, const std::string &msg)
+{
+    uint32_t len = static_cast<uint32_t>(msg.size());
+
+    if (EXSUCCEED!=pool_writen(fd, reinterpret_cast<char *>(&len), sizeof(len)))
+    {
+        return EXFAIL;
+    }
+
+    return pool_writen(fd, msg.data(), msg.size());
+}
+
+/**
+ * @brief Worker process: serve requests till the server closes the pipe.
+ *  Worker is not attached to ATMI, reply is captured by tpreturn() and
+ *  tpforward() (see ndrxpy_pool_reply()) and sent back to the server.
+ *  GIL is held, as worker process runs single thread.
+ * @param reqfd request pipe, read end
+ * @param rspfd reply pipe, write end
+ */
+exprivate void pool_child_run(int reqfd, int rspfd)
+{
+    auto pickle = py::module::import("pickle");
+    py::object result;
+
+    M_pool_result = &result;
+
+    /* ready */
+    if (EXSUCCEED!=pool_send_msg(rspfd, std::string()))
+    {
+        return;
+    }
+
+    while (true)
+    {
+        uint32_t len;
+        std::string msg;
+
+        if (EXSUCCEED!=pool_readn(reqfd, reinterpret_cast<char *>(&len), sizeof(len)))
+        {
+            /* server closed the pipe */
+            break;
+        }
+
+        msg.resize(len);
+
+        if (EXSUCCEED!=pool_readn(reqfd, &msg[0], len))
+        {
+            break;
+        }
+
+        result = py::none();
+
+        try
+        {
+            py::tuple req = pickle.attr("loads")(py::bytes(msg)).cast<py::tuple>();
+            std::string fname = req[0].cast<std::string>();
+            std::string cltid = req[5].cast<std::string>();
+            TPSVCINFO svcinfo;
+
+            auto it = M_pool_funcs.find(fname);
+
+            if (M_pool_funcs.end()==it)
+            {
+                throw std::invalid_argument("Function not found: " + fname);
+            }
+
+            memset(&svcinfo, 0, sizeof(svcinfo));
+            NDRX_STRCPY_SAFE(svcinfo.fname, fname.c_str());
+            NDRX_STRCPY_SAFE(svcinfo.name, req[1].cast<std::string>().c_str());
+            svcinfo.flags = req[2].cast<long>();
+            svcinfo.cd = req[3].cast<int>();
+            svcinfo.appkey = req[4].cast<long>();
+            memcpy(&svcinfo.cltid, cltid.data(), std::min(cltid.size(), sizeof(svcinfo.cltid)));
+
+            pytpsvcinfo *info = new pytpsvcinfo(&svcinfo);
+            py::object infoobj = py::cast(info, py::return_value_policy::take_ownership);
+
+            info->data = req[6];
+
+            py::object ret = it->second(infoobj);
+
+            if (py::hasattr(ret, "__await__"))
+            {
+                if (py::hasattr(ret, "close"))
+                {
+                    ret.attr("close")();
+                }
+                throw std::invalid_argument("async def service is not supported by worker pool");
+            }
+
+            if (result.is_none())
+            {
+                throw std::runtime_error("Service returned without reply");
+            }
+        }
+        catch (std::exception &e)
+        {
+            result = py::make_tuple(NDRXPY_POOL_ERROR, TPFAIL, 0, "", e.what());
+        }
+
+        try
+        {
+            msg = pickle.attr("dumps")(result, pickle.attr("HIGHEST_PROTOCOL")).cast<std::string>();
+        }
+        catch (std::exception &e)
+        {
+            msg = pickle.attr("dumps")(py::make_tuple(NDRXPY_POOL_ERROR, TPFAIL, 0, "",
+                std::string("Failed to send reply: ") + e.what())).cast<std::string>();
+        }
+
+        if (EXSUCCEED!=pool_send_msg(rspfd, msg))
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Start worker process. GIL is held.
+ * @param w worker, pid, reqfd and rspfd are set
+ */
+exprivate void pool_spawn(ndrxpy_poolwrk_t *w)
+{
+    int req[2];
+    int rsp[2];
+    int pid;
+    uint32_t len;
+
+    if (EXSUCCEED!=pipe(req))
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        throw py::error_already_set();
+    }
+
+    if (EXSUCCEED!=pipe(rsp))
+    {
+        close(req[0]);
+        close(req[1]);
+        PyErr_SetFromErrno(PyExc_OSError);
+        throw py::error_already_set();
+    }
+
+    /* server ends are not passed to the programs started by exec */
+    fcntl(req[1], F_SETFD, FD_CLOEXEC);
+    fcntl(rsp[0], F_SETFD, FD_CLOEXEC);
+
+    try
+    {
+        /* interpreter state is prepared for the child by os.fork() */
+        pid = py::module::import("os").attr("fork")().cast<int>();
+    }
+    catch (...)
+    {
+        close(req[0]);
+        close(req[1]);
+        close(rsp[0]);
+        close(rsp[1]);
+        throw;
+    }
+
+    if (0==pid)
+    {
+        /* worker process, must not return to the server code */
+        M_pool_child = true;
+
+        for (auto other : M_pool_workers)
+        {
+            if (other->pid > 0)
+            {
+                close(other->reqfd);
+                close(other->rspfd);
+            }
+        }
+
+        close(req[1]);
+        close(rsp[0]);
+
+        try
+        {
+            pool_child_run(req[0], rsp[1]);
+        }
+        catch (std::exception &e)
+        {
+            NDRX_LOG(log_error, "Worker process failed: %s", e.what());
+        }
+
+        /* no atexit handlers, these belong to the server */
+        _exit(0);
+    }
+
+    close(req[0]);
+    close(rsp[1]);
+
+    /* wait for the worker to start */
+    int ret;
+    {
+        py::gil_scoped_release release;
+        ret = pool_readn(rsp[0], reinterpret_cast<char *>(&len), sizeof(len));
+    }
+
+    if (EXSUCCEED!=ret || 0!=len)
+    {
+        NDRX_LOG(log_error, "Worker process %d failed to start", pid);
+        userlog(const_cast<char *>("Worker process %d failed to start"), pid);
+        close(req[1]);
+        close(rsp[0]);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        throw std::runtime_error("Worker process failed to start");
+    }
+
+    fcntl(rsp[0], F_SETFL, fcntl(rsp[0], F_GETFL) | O_NONBLOCK);
+
+    w->pid = pid;
+    w->reqfd = req[1];
+    w->rspfd = rsp[0];
+    w->polled = false;
+    w->rbuf.clear();
+
+    NDRX_LOG(log_info, "Worker process %d started", pid);
+}
+
+/**
+ * @brief Fail the request with TPESVCERR. GIL is held.
+ * @param job request, freed
+ * @param msg reason
+ */
+exprivate void pool_fail(ndrxpy_pooljob_t *job, const char *msg)
+{
+    NDRX_LOG(log_error, "Service [%s] failed in worker pool: %s", job->svc.c_str(), msg);
+    userlog(const_cast<char *>("Service [%s] failed in worker pool: %s"), job->svc.c_str(), msg);
+
+    if (EXSUCCEED!=tpsrvsetctxdata(const_cast<char *>(job->ctx.data()), 0))
+    {
+        NDRX_LOG(log_error, "Failed to restore [%s] context: %s",
+                job->svc.c_str(), tpstrerror(tperrno));
+    }
+    else
+    {
+        tpreturn(TPFAIL, TPESVCERR, nullptr, 0, TPSOFTERR);
+    }
+
+    M_pool_done++;
+    delete job;
+}
+
+/**
+ * @brief Reply of the worker: restore the request context and send
+ *  the reply. GIL is held.
+ * @param w worker
+ * @param msg pickled reply
+ */
+exprivate void pool_reply(ndrxpy_poolwrk_t *w, const std::string &msg)
+{
+    ndrxpy_pooljob_t *job = w->job;
+
+    w->job = nullptr;
+
+    if (nullptr==job)
+    {
+        NDRX_LOG(log_error, "Worker process %d sent reply without request", w->pid);
+        return;
+    }
+
+    try
+    {
+        py::tuple res = py::module::import("pickle").attr("loads")(py::bytes(msg)).cast<py::tuple>();
+        std::string kind = res[0].cast<std::string>();
+
+        if (NDRXPY_POOL_ERROR==kind)
+        {
+            std::string err = res[4].cast<std::string>();
+            pool_fail(job, err.c_str());
+            return;
+        }
+
+        auto &&odata = ndrx_from_py(res[4]);
+
+        if (EXSUCCEED!=tpsrvsetctxdata(const_cast<char *>(job->ctx.data()), 0))
+        {
+            NDRX_LOG(log_error, "Failed to restore [%s] context: %s",
+                    job->svc.c_str(), tpstrerror(tperrno));
+        }
+        else if (NDRXPY_POOL_FORWARD==kind)
+        {
+            char svc[XATMI_SERVICE_NAME_LENGTH+1];
+
+            NDRX_STRCPY_SAFE(svc, res[3].cast<std::string>().c_str());
+            tpforward(svc, *odata.pp, odata.len, 0);
+        }
+        else
+        {
+            tpreturn(res[1].cast<int>(), res[2].cast<long>(), *odata.pp, odata.len, 0);
+        }
+
+        M_pool_done++;
+        delete job;
+    }
+    catch (std::exception &e)
+    {
+        pool_fail(job, e.what());
+    }
+}
+
+/**
+ * @brief Worker process has exited: fail its request and start new one,
+ *  unless pool is stopping. GIL is held.
+ * @param w worker
+ */
+exprivate void pool_died(ndrxpy_poolwrk_t *w)
+{
+    int status = 0;
+
+    NDRX_LOG(log_error, "Worker process %d exited", w->pid);
+    userlog(const_cast<char *>("Worker process %d exited"), w->pid);
+
+    if (w->polled && EXSUCCEED!=tpext_delpollerfd(w->rspfd))
+    {
+        NDRX_LOG(log_error, "Failed to remove worker fd %d from poller: %s",
+                w->rspfd, tpstrerror(tperrno));
+    }
+
+    close(w->reqfd);
+    close(w->rspfd);
+    waitpid(w->pid, &status, 0);
+    w->pid = 0;
+    w->polled = false;
+
+    if (nullptr!=w->job)
+    {
+        ndrxpy_pooljob_t *job = w->job;
+        w->job = nullptr;
+        pool_fail(job, "worker process exited");
+    }
+
+    if (M_pool_stop)
+    {
+        return;
+    }
+
+    try
+    {
+        pool_spawn(w);
+        M_pool_restarts++;
+    }
+    catch (std::exception &e)
+    {
+        NDRX_LOG(log_error, "Failed to restart worker process: %s", e.what());
+        userlog(const_cast<char *>("Failed to restart worker process: %s"), e.what());
+        return;
+    }
+
+    pool_next(w);
+}
+
+/**
+ * @brief Read replies available from the worker. GIL is held.
+ * @param w worker
+ */
+exprivate void pool_rsp_read(ndrxpy_poolwrk_t *w)
+{
+    char tmp[8192];
+    bool eof = false;
+
+    while (true)
+    {
+        ssize_t n = read(w->rspfd, tmp, sizeof(tmp));
+
+        if (n > 0)
+        {
+            w->rbuf.append(tmp, n);
+        }
+        else if (n < 0 && EINTR==errno)
+        {
+            continue;
+        }
+        else
+        {
+            eof = (0==n || EAGAIN!=errno);
+            break;
+        }
+    }
+
+    while (w->rbuf.size() >= sizeof(uint32_t))
+    {
+        uint32_t len;
+
+        memcpy(&len, w->rbuf.data(), sizeof(len));
+
+        if (w->rbuf.size() < sizeof(len) + len)
+        {
+            break;
+        }
+
+        std::string msg = w->rbuf.substr(sizeof(len), len);
+        w->rbuf.erase(0, sizeof(len) + len);
+
+        pool_reply(w, msg);
+        pool_next(w);
+    }
+
+    if (eof)
+    {
+        pool_died(w);
+    }
+}
+
+/**
+ * @brief Reply pipe of the worker has events
+ * @param fd reply pipe
+ * @param events poll events
+ * @param ptr1 worker
+ * @return 0
+ */
+exprivate int pool_rsp_cb(int fd, uint32_t events, void *ptr1)
+{
+    py::gil_scoped_acquire acquire;
+
+    pool_rsp_read(static_cast<ndrxpy_poolwrk_t *>(ptr1));
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Send the request to the worker. GIL is held.
+ * @param w idle worker
+ * @param job request
+ */
+exprivate void pool_send(ndrxpy_poolwrk_t *w, ndrxpy_pooljob_t *job)
+{
+    int ret;
+
+    w->job = job;
+
+    {
+        py::gil_scoped_release release;
+        ret = pool_send_msg(w->reqfd, job->req);
+    }
+
+    /* request is failed when exit of the worker is noticed */
+    if (EXSUCCEED!=ret)
+    {
+        NDRX_LOG(log_error, "Failed to send request to worker process %d: %s",
+                w->pid, strerror(errno));
+        kill(w->pid, SIGKILL);
+    }
+}
+
+/**
+ * @brief Worker is idle: send next queued request
+ * @param w worker
+ */
+exprivate void pool_next(ndrxpy_poolwrk_t *w)
+{
+    if (w->pid > 0 && nullptr==w->job && !M_pool_jobs.empty())
+    {
+        ndrxpy_pooljob_t *job = M_pool_jobs.front();
+        M_pool_jobs.pop_front();
+        pool_send(w, job);
+    }
+}
+
+/**
+ * @brief Wait for the replies of the workers, outside of the server
+ *  poller. GIL is held.
+ * @return 0 replies processed, -1 no requests in progress
+ */
+exprivate int pool_wait(void)
+{
+    std::vector<struct pollfd> fds;
+    std::vector<ndrxpy_poolwrk_t*> ws;
+    int ret;
+
+    for (auto w : M_pool_workers)
+    {
+        if (w->pid > 0 && nullptr!=w->job)
+        {
+            struct pollfd p;
+
+            p.fd = w->rspfd;
+            p.events = POLLIN;
+            p.revents = 0;
+            fds.push_back(p);
+            ws.push_back(w);
+        }
+    }
+
+    if (fds.empty())
+    {
+        return EXFAIL;
+    }
+
+    {
+        py::gil_scoped_release release;
+
+        do
+        {
+            ret = poll(&fds[0], fds.size(), -1);
+        } while (ret < 0 && EINTR==errno);
+    }
+
+    for (size_t i=0; i<fds.size(); i++)
+    {
+        if (0!=fds[i].revents)
+        {
+            pool_rsp_read(ws[i]);
+        }
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Idle worker which is running
+ * @param alive set to true if any worker is running
+ * @return worker or nullptr
+ */
+exprivate ndrxpy_poolwrk_t *pool_idle(bool *alive)
+{
+    *alive = false;
+
+    for (auto w : M_pool_workers)
+    {
+        if (w->pid > 0)
+        {
+            *alive = true;
+
+            if (nullptr==w->job)
+            {
+                return w;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Reply captured in the worker process. Called by tpreturn() and
+ *  tpforward() of the service function.
+ * @param rval return value
+ * @param rcode user return code
+ * @param svc forward service, nullptr for tpreturn()
+ * @param data reply data
+ * @return true if running in worker process (reply is captured), false
+ *  standard ATMI reply shall be done
+ */
+expublic bool ndrxpy_pool_reply(int rval, long rcode, const char *svc, py::object data)
+{
+    if (!M_pool_child)
+    {
+        return false;
+    }
+
+    if (!M_pool_result->is_none())
+    {
+        throw std::runtime_error("tpreturn already called");
+    }
+
+    *M_pool_result = py::make_tuple(nullptr==svc?NDRXPY_POOL_REPLY:NDRXPY_POOL_FORWARD,
+        rval, rcode, nullptr==svc?"":svc, data);
+
+    return true;
+}
+
+/**
+ * @brief Add reply pipes of the workers to the poller (not allowed in
+ *  tpsvrinit()), called before poll. GIL is not held.
+ * @return 0 ok, -1 failure
+ */
+expublic int ndrxpy_pool_b4poll(void)
+{
+    for (auto w : M_pool_workers)
+    {
+        if (w->pid > 0 && !w->polled)
+        {
+            if (EXSUCCEED!=tpext_addpollerfd(w->rspfd, POLLIN, w, pool_rsp_cb))
+            {
+                NDRX_LOG(log_error, "Failed to add worker fd %d to poller: %s",
+                        w->rspfd, tpstrerror(tperrno));
+                return EXFAIL;
+            }
+            w->polled = true;
+        }
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Hand over the request to the worker pool, if service function is
+ *  served by the pool. Request is converted and the context is captured,
+ *  server continues with the next request, reply is sent when worker
+ *  completes. Called by the dispatcher, GIL not held.
+ * @param svcinfo call descriptor
+ * @return true if request is submitted (or failed), false if function is
+ *  not served by the pool
+ */
+expublic bool ndrxpy_pool_submit(TPSVCINFO *svcinfo)
+{
+    char *buf;
+    long len = 0;
+    bool alive;
+    ndrxpy_poolwrk_t *w;
+
+    /* replies are delivered by the poller of the main thread */
+    if (!ndrxpy_srvmain())
+    {
+        return false;
+    }
+
+    py::gil_scoped_acquire acquire;
+
+    w = pool_idle(&alive);
+
+    if (!alive || M_pool_funcs.end()==M_pool_funcs.find(svcinfo->fname))
+    {
+        return false;
+    }
+
+    if (NULL==(buf=tpsrvgetctxdata2(NULL, &len)))
+    {
+        NDRX_LOG(log_error, "Failed to get [%s] context: %s",
+                svcinfo->name, tpstrerror(tperrno));
+        userlog(const_cast<char *>("Failed to get [%s] context: %s"),
+                svcinfo->name, tpstrerror(tperrno));
+        tpreturn(TPFAIL, TPESVCERR, nullptr, 0, TPSOFTERR);
+        return true;
+    }
+
+    ndrxpy_pooljob_t *job = new ndrxpy_pooljob_t();
+    job->ctx.assign(buf, len);
+    job->svc = svcinfo->name;
+    tpsrvfreectxdata(buf);
+
+    try
+    {
+        /* request buffer is freed here, worker gets the python data */
+        atmibuf ibuf(svcinfo);
+        py::object data = ndrx_to_py(ibuf);
+        auto pickle = py::module::import("pickle");
+
+        job->req = pickle.attr("dumps")(py::make_tuple(svcinfo->fname, svcinfo->name,
+            svcinfo->flags, svcinfo->cd, svcinfo->appkey,
+            py::bytes(reinterpret_cast<char *>(&svcinfo->cltid), sizeof(svcinfo->cltid)),
+            data), pickle.attr("HIGHEST_PROTOCOL")).cast<std::string>();
+    }
+    catch (std::exception &e)
+    {
+        NDRX_LOG(log_error, "Failed to submit [%s] to worker pool: %s",
+                svcinfo->name, e.what());
+        userlog(const_cast<char *>("Failed to submit [%s] to worker pool: %s"),
+                svcinfo->name, e.what());
+        delete job;
+        tpreturn(TPFAIL, TPESVCERR, nullptr, 0, TPSOFTERR);
+        return true;
+    }
+
+    /* next request may be taken, this one is replied from job->ctx */
+    tpcontinue();
+    M_pool_queued++;
+
+    if (M_pool_stop)
+    {
+        pool_fail(job, "worker pool is stopping");
+        return true;
+    }
+
+    if (nullptr!=w)
+    {
+        pool_send(w, job);
+        return true;
+    }
+
+    /* replies are served here, till the queue has space */
+    if (M_pool_maxqueue > 0 && static_cast<long>(M_pool_jobs.size()) >= M_pool_maxqueue)
+    {
+        M_pool_waits++;
+
+        while (static_cast<long>(M_pool_jobs.size()) >= M_pool_maxqueue)
+        {
+            if (EXSUCCEED!=pool_wait())
+            {
+                break;
+            }
+        }
+    }
+
+    M_pool_jobs.push_back(job);
+
+    /* worker may got free while waiting */
+    w = pool_idle(&alive);
+
+    if (!alive)
+    {
+        while (!M_pool_jobs.empty())
+        {
+            ndrxpy_pooljob_t *j = M_pool_jobs.front();
+            M_pool_jobs.pop_front();
+            pool_fail(j, "no worker processes");
+        }
+    }
+    else if (nullptr!=w)
+    {
+        pool_next(w);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Stop the pool, queued requests are completed first.
+ *  GIL must not be held.
+ */
+expublic void ndrxpy_pool_stop(void)
+{
+    py::gil_scoped_acquire acquire;
+
+    if (M_pool_workers.empty())
+    {
+        M_pool_funcs.clear();
+        return;
+    }
+
+    M_pool_stop = true;
+
+    /* serve queued requests */
+    while (EXSUCCEED==pool_wait())
+    {
+    }
+
+    while (!M_pool_jobs.empty())
+    {
+        ndrxpy_pooljob_t *job = M_pool_jobs.front();
+        M_pool_jobs.pop_front();
+        pool_fail(job, "no worker processes");
+    }
+
+    for (auto w : M_pool_workers)
+    {
+        if (w->pid > 0)
+        {
+            if (w->polled && EXSUCCEED!=tpext_delpollerfd(w->rspfd))
+            {
+                NDRX_LOG(log_error, "Failed to remove worker fd %d from poller: %s",
+                        w->rspfd, tpstrerror(tperrno));
+            }
+
+            /* worker exits on end of file */
+            close(w->reqfd);
+            close(w->rspfd);
+
+            {
+                py::gil_scoped_release release;
+                waitpid(w->pid, nullptr, 0);
+            }
+        }
+
+        delete w;
+    }
+
+    M_pool_workers.clear();
+    M_pool_funcs.clear();
+    M_pool_stop = false;
+}
+
+/**
+ * @brief Register worker pool api
+ *
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_srvpool(py::module &m)
+{
+    m.def(
+        "tpext_workerpool",
+        [](int workers, long maxqueue)
+        {
+            if (workers <= 0)
+            {
+                throw std::invalid_argument("Invalid number of workers: " + std::to_string(workers));
+            }
+
+            if (maxqueue < 0)
+            {
+                throw std::invalid_argument("Invalid queue size: " + std::to_string(maxqueue));
+            }
+
+            if (!M_pool_workers.empty())
+            {
+                throw std::invalid_argument("Worker pool already started");
+            }
+
+            if (M_pool_funcs.empty())
+            {
+                throw std::invalid_argument("No services advertised by tpext_pooladvertise()");
+            }
+
+            M_pool_maxqueue = maxqueue;
+
+            try
+            {
+                for (int i=0; i<workers; i++)
+                {
+                    ndrxpy_poolwrk_t *w = new ndrxpy_poolwrk_t();
+
+                    w->pid = 0;
+                    w->job = nullptr;
+                    M_pool_workers.push_back(w);
+                    pool_spawn(w);
+                }
+            }
+            catch (...)
+            {
+                /* started workers exit on end of file */
+                for (auto w : M_pool_workers)
+                {
+                    if (w->pid > 0)
+                    {
+                        close(w->reqfd);
+                        close(w->rspfd);
+                        waitpid(w->pid, nullptr, 0);
+                    }
+                    delete w;
+                }
+
+                M_pool_workers.clear();
+                throw;
+            }
+
+            /* reply pipes are added to the poller before poll */
+            ndrxpy_tpext_b4poll_pin();
+        },
+        R"pbdoc(
+        Start worker processes for services advertised by :func:`.tpext_pooladvertise`.
+        Workers are forked from the server, thus service functions and server
+        state are inherited. Dispatcher captures request context with
+        :func:`.tpsrvgetctxdata`, converts the request buffer, sends the
+        request data (pickled) to the idle worker and continues with the next
+        request (:func:`.tpcontinue`). Worker calls the service function,
+        reply given by :func:`.tpreturn` or :func:`.tpforward` is sent back
+        over the pipe, which is served by the server poller: request context
+        is restored (:func:`.tpsrvsetctxdata`) and reply is sent. If service
+        function does not reply, raises exception or worker process exits,
+        caller receives :data:`.TPESVCERR`. Exited worker is started again.
+
+        As each worker runs own interpreter, pool scales on CPU cores for pure
+        Python code. Worker process is not attached to ATMI: service function
+        shall not perform other ATMI calls, and shall not rely on
+        *args.buf* (it is **None**). **async def** services are not supported.
+
+        When all workers are busy, requests wait in the queue. When queue is
+        full, dispatcher waits for the worker replies. Pool is stopped after
+        **tpsvrdone()**, queued requests are completed.
+
+        Function shall be called from **tpsvrinit()**, after the services are
+        advertised. Function returns when workers are started. Pool is used
+        by the single threaded servers; in multi-threaded server, requests
+        are served by the dispatch threads. This function applies to ATMI
+        servers only.
+
+        .. code-block:: python
+            :caption: tpext_workerpool example
+            :name: tpext_workerpool-example
+
+            import sys
+            import endurox as e
+
+            class Server:
+
+                def tpsvrinit(self, args):
+                    e.tpext_pooladvertise('CALC', 'CALC', self.CALC)
+                    e.tpext_workerpool(4, 100)
+                    return 0
+
+                def CALC(self, args):
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+            if __name__ == '__main__':
+                e.run(Server(), sys.argv)
+
+        :raise ValueError:
+            | Invalid number of workers or queue size, pool already started,
+            | or no services advertised.
+        :raise OSError:
+            | Failed to create pipe or worker process.
+        :raise RuntimeError:
+            | Worker process failed to start.
+
+        Parameters
+        ----------
+        workers : int
+            Number of worker processes.
+        maxqueue : int
+            Max number of requests waiting for the worker. **0** - unlimited.
+
+         )pbdoc",
+        py::arg("workers"), py::arg("maxqueue")=0);
+
+    m.def(
+        "tpext_pooladvertise",
+        [](std::string svcname, std::string funcname, const py::object &func)
+        {
+            /* workers have copy of the function table */
+            if (!M_pool_workers.empty())
+            {
+                throw std::invalid_argument("Worker pool already started");
+            }
+
+            pytpadvertise(svcname, funcname, func);
+            M_pool_funcs[funcname] = func;
+        },
+        R"pbdoc(
+        Advertise service served by the worker pool, see :func:`.tpext_workerpool`.
+        Function is served by the pool for all services which are advertised
+        with the given *funcname*. Services shall be advertised before the
+        pool is started. If pool is not started, requests are served by the
+        dispatcher as for :func:`.tpadvertise`.
+
+        This function applies to ATMI servers only.
+
+        :raise ValueError:
+            | Worker pool already started.
+        :raise AtmiException:
+            | Following error codes may be present:
+            | :data:`.TPEINVAL` - Service name empty or too long.
+            | :data:`.TPELIMIT` - Max number of services reached.
+            | :data:`.TPEMATCH` - Service already advertised with different function.
+
+        Parameters
+        ----------
+        svcname : str
+            Service name to advertise.
+        funcname : str
+            Function name.
+        func : callable
+            Service function.
+
+         )pbdoc",
+        py::arg("svcname"), py::arg("funcname"), py::arg("func"));
+
+    m.def(
+        "tpext_workerpoolstats",
+        [](void)
+        {
+            py::dict ret;
+            long workers = 0;
+            long busy = 0;
+
+            for (auto w : M_pool_workers)
+            {
+                if (w->pid > 0)
+                {
+                    workers++;
+                }
+
+                if (nullptr!=w->job)
+                {
+                    busy++;
+                }
+            }
+
+            ret["workers"] = workers;
+            ret["queued"] = M_pool_queued;
+            ret["done"] = M_pool_done;
+            ret["busy"] = busy;
+            ret["pending"] = M_pool_jobs.size();
+            ret["waits"] = M_pool_waits;
+            ret["restarts"] = M_pool_restarts;
+
+            return ret;
+        },
+        R"pbdoc(
+        Return worker pool statistics.
+
+        Returns
+        -------
+        stats : dict
+            | **workers** - number of running worker processes.
+            | **queued** - requests submitted to the pool.
+            | **done** - requests completed (replied or failed).
+            | **busy** - requests being served now.
+            | **pending** - requests waiting for the worker.
+            | **waits** - times dispatcher waited for the queue space.
+            | **restarts** - worker processes started again after exit.
+
+         )pbdoc");
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
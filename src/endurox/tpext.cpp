@@ -35,6 +35,12 @@
 /*---------------------------Includes-----------------------------------*/
 
 #include <dlfcn.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
 
 #include <atmi.h>
 #include <tpadm.h>
@@ -50,14 +56,36 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <map>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 /*---------------------------Externs------------------------------------*/
 /*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_DEFER_BUDGET_DFLT    50  /**< default drain budget, ms   */
+
 /*---------------------------Enums--------------------------------------*/
 /*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Server timer
+ */
+typedef struct
+{
+    py::object func;                        /**< callback               */
+    py::object ptr1;                        /**< custom object          */
+    long long interval;                     /**< period, ns, 0 one-shot */
+    std::multimap<long long, long>::iterator due;  /**< queue entry    */
+} ndrxpy_timer_t;
+
 /*---------------------------Globals------------------------------------*/
 /*---------------------------Statics------------------------------------*/
 
@@ -67,18 +95,160 @@ ndrxpy_object_t * M_b4pollcb_handler = nullptr;
 /** periodic server callback handler */
 ndrxpy_object_t * M_addperiodcb_handler = nullptr;
 
-/** filedescriptor map to py callbacks */
-std::map<int, ndrxpy_object_t*> M_fdmap {};
+/** filedescriptor table to py callbacks, indexed by fd */
+std::vector<ndrxpy_object_t*> M_fdmap {};
+
+/** batched poll events handler */
+ndrxpy_object_t * M_pollbatch_handler = nullptr;
+
+/** events of the poll cycle, waiting for the batch handler */
+std::vector<std::pair<int, uint32_t>> M_pollbatch {};
+
+/** our b4poll callback is registered in Enduro/X */
+bool M_b4poll_installed = false;
+
+/** timer subsystem, timers by id */
+std::map<long, ndrxpy_timer_t*> M_timers {};
+
+/** timer ids ordered by due time */
+std::multimap<long long, long> M_timerq {};
+
+/** last timer id */
+long M_timer_seq = 0;
+
+/** timer file descriptor */
+int M_timerfd = EXFAIL;
+
+/** timer fd is added to the server poller */
+bool M_timerfd_polled = false;
+
+/** wake up the poller as soon as possible (deferred work pending) */
+bool M_timer_kick = false;
+
+/** protects M_timer_kick and timer fd setting, as other threads kick
+ * the poller */
+std::mutex M_timer_mutex;
+
+/** deferred work queue, obj - callback, obj2 - args tuple or items list */
+std::deque<ndrxpy_object_t*> M_defer {};
+
+/** items lists of the queued batches, by callback. Keyed by python
+ * equality, as each access of bound method gives new object. Not freed,
+ * as python objects live till the process exit. */
+py::dict *M_deferbatch = nullptr;
+
+/** protects M_defer and M_deferbatch, work is queued by dispatch threads
+ * too. Lock holder may wait for GIL (batch lookup), thus
+ * taken by ndrxpy_defer_lock() when GIL is held. */
+std::mutex M_defer_mutex;
+
+/** drain time budget in milliseconds, 0 - unlimited */
+std::atomic<long> M_defer_budget {NDRXPY_DEFER_BUDGET_DFLT};
+
+/** deferred work used, keep b4poll callback */
+bool M_defer_used = false;
+
+std::atomic<long> M_defer_queued {0};   /**< entries queued         */
+std::atomic<long> M_defer_run {0};      /**< entries executed           */
+std::atomic<long> M_defer_failed {0};   /**< entries raised exception   */
+std::atomic<long> M_defer_overruns {0}; /**< drains stopped by budget   */
 
 /*---------------------------Prototypes---------------------------------*/
 
-namespace py = pybind11;
+exprivate int ndrxpy_timer_poll_add(void);
+exprivate void ndrxpy_defer_drain(void);
 
 /**
- * @brief Dispatch b4 poll callback
+ * @brief Lock deferred work queue, GIL must be held. If queue is locked by
+ *  other thread, GIL is released while waiting, as the lock holder may
+ *  need GIL.
+ * @return lock
+ */
+exprivate std::unique_lock<std::mutex> ndrxpy_defer_lock(void)
+{
+    std::unique_lock<std::mutex> lock(M_defer_mutex, std::try_to_lock);
+
+    if (!lock.owns_lock())
+    {
+        py::gil_scoped_release release;
+        lock.lock();
+    }
+
+    return lock;
+}
+
+/**
+ * @brief Deliver batched poll events of the last poll cycle
+ * @return 0 ok, -1 failure
+ */
+exprivate int ndrxpy_pollbatch_flush(void)
+{
+    py::gil_scoped_acquire acquire;
+    py::list events;
+
+    for (auto &ev : M_pollbatch)
+    {
+        /* fd may be removed by previous handler of the cycle */
+        if (ev.first < static_cast<int>(M_fdmap.size()) && nullptr!=M_fdmap[ev.first])
+        {
+            events.append(py::make_tuple(ev.first, ev.second, M_fdmap[ev.first]->obj2));
+        }
+    }
+
+    M_pollbatch.clear();
+
+    if (0==events.size() || nullptr==M_pollbatch_handler)
+    {
+        return EXSUCCEED;
+    }
+
+    py::object ret = M_pollbatch_handler->obj(events);
+    return ret.cast<int>();
+}
+
+/**
+ * @brief Dispatch b4 poll callback. Batched poll events are delivered
+ *  first, then user callback is invoked.
  */
 exprivate int ndrxpy_b4pollcb_callback(void)
 {
+    if (EXFAIL!=M_timerfd && !M_timerfd_polled && EXSUCCEED!=ndrxpy_timer_poll_add())
+    {
+        return EXFAIL;
+    }
+
+    if (!M_pollbatch.empty() && EXSUCCEED!=ndrxpy_pollbatch_flush())
+    {
+        return EXFAIL;
+    }
+
+    bool pending;
+    {
+        /* GIL is not held here */
+        std::lock_guard<std::mutex> lock(M_defer_mutex);
+        pending = !M_defer.empty();
+    }
+
+    if (pending)
+    {
+        ndrxpy_defer_drain();
+    }
+
+    if (EXSUCCEED!=ndrxpy_aio_b4poll())
+    {
+        return EXFAIL;
+    }
+
+    if (EXSUCCEED!=ndrxpy_pool_b4poll())
+    {
+        return EXFAIL;
+    }
+
+    if (nullptr==M_b4pollcb_handler)
+    {
+        return EXSUCCEED;
+    }
+
     //Get the gil...
     py::gil_scoped_acquire acquire;
 
@@ -87,6 +257,45 @@ exprivate int ndrxpy_b4pollcb_callback(void)
 
 }
 
+/**
+ * @brief Install b4 poll callback in Enduro/X, if not done already
+ */
+exprivate void ndrxpy_b4pollcb_install(void)
+{
+    if (M_b4poll_installed)
+    {
+        return;
+    }
+
+    if (EXSUCCEED!=tpext_addb4pollcb(ndrxpy_b4pollcb_callback))
+    {
+        throw atmi_exception(tperrno);
+    }
+
+    M_b4poll_installed = true;
+}
+
+/**
+ * @brief Remove b4 poll callback from Enduro/X, if not used by
+ *  user handler or batch handler
+ */
+exprivate void ndrxpy_b4pollcb_uninstall(void)
+{
+    if (!M_b4poll_installed || nullptr!=M_b4pollcb_handler ||
+        nullptr!=M_pollbatch_handler || (EXFAIL!=M_timerfd && !M_timerfd_polled) ||
+        M_defer_used)
+    {
+        return;
+    }
+
+    if (EXSUCCEED!=tpext_delb4pollcb())
+    {
+        throw atmi_exception(tperrno);
+    }
+
+    M_b4poll_installed = false;
+}
+
 /**
  * @brief register b4 poll callback handler.
  * 
@@ -104,18 +313,17 @@ exprivate void ndrxpy_tpext_addb4pollcb (const py::object &func)
     M_b4pollcb_handler = new ndrxpy_object_t();
     M_b4pollcb_handler->obj = func;
 
-    if (EXSUCCEED!=tpext_addb4pollcb(ndrxpy_b4pollcb_callback))
-    {
-        throw atmi_exception(tperrno);
-    }
+    ndrxpy_b4pollcb_install();
 }
 
-
 /**
  * @brief Periodic callback dispatch
  */
 exprivate int ndrxpy_addperiodcb_callback(void)
 {
+    //Close idle request log file
+    ndrxpy_tplog_reqcache_sweep(false);
+
     //Get the gil...
     py::gil_scoped_acquire acquire;
     py::object ret = M_addperiodcb_handler->obj();
@@ -155,8 +363,17 @@ exprivate void ndrxpy_tpext_addperiodcb (int secs, const py::object &func)
  */
 exprivate int ndrxpy_pollevent_cb(int fd, uint32_t events, void *ptr1)
 {
+    ndrxpy_object_t *obj = M_fdmap[fd];
+
+    if (obj->obj.is_none())
+    {
+        /* delivered by b4poll, GIL not needed */
+        M_pollbatch.emplace_back(fd, events);
+        return EXSUCCEED;
+    }
+
     py::gil_scoped_acquire acquire;
-    py::object ret=M_fdmap[fd]->obj(fd, events, M_fdmap[fd]->obj2);
+    py::object ret=obj->obj(fd, events, obj->obj2);
     return ret.cast<int>();
 }
 
@@ -166,10 +383,16 @@ exprivate int ndrxpy_pollevent_cb(int fd, uint32_t events, void *ptr1)
  * @param fd file descriptor
  * @param events poll events
  * @param ptr1 object to pass back
- * @param func callback func
+ * @param func callback func, None for batched delivery
  */
 exprivate void ndrxpy_tpext_addpollerfd (int fd, uint32_t events, const py::object ptr1, const py::object &func)
 {
+    if (func.is_none() && nullptr==M_pollbatch_handler)
+    {
+        throw std::invalid_argument("func is None, but batch handler is not set "
+            "(see tpext_addpollbatchcb())");
+    }
+
     ndrxpy_object_t * obj = new ndrxpy_object_t();
 
     obj->obj = func;
@@ -177,9 +400,21 @@ exprivate void ndrxpy_tpext_addpollerfd (int fd, uint32_t events, const py::obje
 
     if (EXSUCCEED!=tpext_addpollerfd(fd, events, NULL, ndrxpy_pollevent_cb))
     {
+        delete obj;
         throw atmi_exception(tperrno);
     }
 
+    if (fd >= static_cast<int>(M_fdmap.size()))
+    {
+        M_fdmap.resize(fd+1, nullptr);
+    }
+
+    /* fd number reused without tpext_delpollerfd() */
+    if (nullptr!=M_fdmap[fd])
+    {
+        delete M_fdmap[fd];
+    }
+
     M_fdmap[fd] = obj;
 }
 
@@ -190,10 +425,10 @@ exprivate void ndrxpy_tpext_addpollerfd (int fd, uint32_t events, const py::obje
  */
 exprivate void ndrxpy_tpext_delpollerfd(int fd)
 {
-    auto it = M_fdmap.find(fd);
-    if (it != M_fdmap.end()) {
+    if (fd >= 0 && fd < static_cast<int>(M_fdmap.size()) && nullptr!=M_fdmap[fd])
+    {
         delete M_fdmap[fd];
-        M_fdmap.erase(it);
+        M_fdmap[fd] = nullptr;
     }
 
     if (EXSUCCEED!=tpext_delpollerfd(fd))
@@ -202,6 +437,392 @@ exprivate void ndrxpy_tpext_delpollerfd(int fd)
     }
 }
 
+/**
+ * @brief Current monotonic time
+ * @return time in nanoseconds
+ */
+exprivate long long ndrxpy_timer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<long long>(ts.tv_sec)*1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Arm timer fd to the earliest due timer, or disarm if no timers
+ * @return 0 ok, -1 failure (errno set)
+ */
+exprivate int ndrxpy_timer_arm(void)
+{
+    struct itimerspec its;
+    std::lock_guard<std::mutex> lock(M_timer_mutex);
+
+    memset(&its, 0, sizeof(its));
+
+    if (M_timer_kick)
+    {
+        its.it_value.tv_nsec = 1;
+    }
+    else if (!M_timerq.empty())
+    {
+        /* past time expires immediately, zero would disarm */
+        long long due = std::max(M_timerq.begin()->first, 1LL);
+
+        its.it_value.tv_sec = due / 1000000000LL;
+        its.it_value.tv_nsec = due % 1000000000LL;
+    }
+
+    if (EXSUCCEED!=timerfd_settime(M_timerfd, TFD_TIMER_ABSTIME, &its, NULL))
+    {
+        int err = errno;
+        NDRX_LOG(log_error, "timerfd_settime failed: %s", strerror(err));
+        errno = err;
+        return EXFAIL;
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Wake up the poller for deferred work, called by any thread.
+ *  Timer queue is not accessed, it belongs to the main thread.
+ * @return 0 ok, -1 failure (errno set)
+ */
+exprivate int ndrxpy_timer_kick(void)
+{
+    struct itimerspec its;
+    std::lock_guard<std::mutex> lock(M_timer_mutex);
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    M_timer_kick = true;
+
+    if (EXSUCCEED!=timerfd_settime(M_timerfd, TFD_TIMER_ABSTIME, &its, NULL))
+    {
+        int err = errno;
+        NDRX_LOG(log_error, "timerfd_settime failed: %s", strerror(err));
+        errno = err;
+        return EXFAIL;
+    }
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Re-arm timer fd after timer list changes
+ */
+exprivate void ndrxpy_timer_rearm(void)
+{
+    if (EXSUCCEED!=ndrxpy_timer_arm())
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        throw py::error_already_set();
+    }
+}
+
+/**
+ * @brief Remove timer
+ * @param it timer entry
+ */
+exprivate void ndrxpy_timer_del(std::map<long, ndrxpy_timer_t*>::iterator it)
+{
+    M_timerq.erase(it->second->due);
+    delete it->second;
+    M_timers.erase(it);
+}
+
+/**
+ * @brief Timer fd event, dispatch expired timers under single GIL
+ *  acquisition
+ * @param fd timer fd
+ * @param events poll events
+ * @param ptr1 not used
+ * @return -1 on failure, 0 ok
+ */
+exprivate int ndrxpy_timer_cb(int fd, uint32_t events, void *ptr1)
+{
+    uint64_t expirations;
+    std::vector<long> expired;
+    long long now = ndrxpy_timer_now();
+    int ret = EXSUCCEED;
+
+    /* reset readiness */
+    if (EXFAIL==read(fd, &expirations, sizeof(expirations)) && EAGAIN!=errno)
+    {
+        NDRX_LOG(log_error, "Failed to read timer fd %d: %s", fd, strerror(errno));
+        return EXFAIL;
+    }
+
+    /* deferred work continues in b4poll */
+    {
+        std::lock_guard<std::mutex> lock(M_timer_mutex);
+        M_timer_kick = false;
+    }
+
+    py::gil_scoped_acquire acquire;
+
+    for (auto it = M_timerq.begin(); it!=M_timerq.end() && it->first <= now; it++)
+    {
+        expired.push_back(it->second);
+    }
+
+    for (auto id : expired)
+    {
+        auto it = M_timers.find(id);
+
+        /* removed by previous callback */
+        if (it==M_timers.end())
+        {
+            continue;
+        }
+
+        /* func & ptr1 are kept if timer is removed in the callback */
+        py::object func = it->second->func;
+        py::object ptr1 = it->second->ptr1;
+
+        if (it->second->interval > 0)
+        {
+            long long due = it->second->due->first + it->second->interval;
+
+            /* do not catch up missed periods */
+            if (due <= now)
+            {
+                due = now + it->second->interval;
+            }
+
+            M_timerq.erase(it->second->due);
+            it->second->due = M_timerq.emplace(due, id);
+        }
+        else
+        {
+            ndrxpy_timer_del(it);
+        }
+
+        try
+        {
+            if (EXSUCCEED!=func(id, ptr1).cast<int>())
+            {
+                ret = EXFAIL;
+                break;
+            }
+        }
+        catch (std::exception &e)
+        {
+            NDRX_LOG(log_error, "Timer %ld callback failed: %s", id, e.what());
+            ret = EXFAIL;
+            break;
+        }
+    }
+
+    if (EXSUCCEED!=ndrxpy_timer_arm())
+    {
+        ret = EXFAIL;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Add timer fd to the server poller (outside of tpsvrinit()),
+ *  called from b4poll callback
+ * @return 0 ok, -1 failure
+ */
+exprivate int ndrxpy_timer_poll_add(void)
+{
+    if (EXSUCCEED!=tpext_addpollerfd(M_timerfd, POLLIN, NULL, ndrxpy_timer_cb))
+    {
+        NDRX_LOG(log_error, "Failed to add timer fd %d to poller: %s",
+                M_timerfd, tpstrerror(tperrno));
+        return EXFAIL;
+    }
+
+    M_timerfd_polled = true;
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Create timer fd, if not done already
+ */
+exprivate void ndrxpy_timerfd_init(void)
+{
+    if (EXFAIL!=M_timerfd)
+    {
+        return;
+    }
+
+    if (EXFAIL==(M_timerfd=timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)))
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        throw py::error_already_set();
+    }
+
+    /* poller add is not allowed in tpsvrinit(), do it before poll */
+    ndrxpy_b4pollcb_install();
+}
+
+/**
+ * @brief Run deferred work under single GIL hold. Only entries queued
+ *  before the drain are run, till time budget is spent. Entries queued by
+ *  the callbacks (or by other threads meanwhile) run in the next drain.
+ *  If work remains, poller is woken up by the timer fd, so that server
+ *  does not block with pending work.
+ */
+exprivate void ndrxpy_defer_drain(void)
+{
+    long long start = ndrxpy_timer_now();
+    long budget_ms = M_defer_budget.load();
+    long long budget = static_cast<long long>(budget_ms)*1000000LL;
+    std::deque<ndrxpy_object_t*> work;
+    bool more;
+
+    py::gil_scoped_acquire acquire;
+
+    {
+        auto lock = ndrxpy_defer_lock();
+        work.swap(M_defer);
+    }
+
+    while (!work.empty())
+    {
+        ndrxpy_object_t *ent = work.front();
+        work.pop_front();
+
+        /* new items for the callback go to the next batch */
+        if (py::isinstance<py::list>(ent->obj2))
+        {
+            auto lock = ndrxpy_defer_lock();
+
+            if (M_deferbatch->attr("get")(ent->obj).is(ent->obj2))
+            {
+                M_deferbatch->attr("pop")(ent->obj);
+            }
+        }
+
+        try
+        {
+            if (py::isinstance<py::tuple>(ent->obj2))
+            {
+                ent->obj(*ent->obj2);
+            }
+            else
+            {
+                ent->obj(ent->obj2);
+            }
+        }
+        catch (std::exception &e)
+        {
+            NDRX_LOG(log_error, "Deferred callback failed: %s", e.what());
+            userlog(const_cast<char *>("Deferred callback failed: %s"), e.what());
+            M_defer_failed++;
+        }
+
+        delete ent;
+        M_defer_run++;
+
+        if (budget > 0 && !work.empty() && ndrxpy_timer_now() - start >= budget)
+        {
+            NDRX_LOG(log_info, "Deferred work budget %ld ms spent, %ld entries left",
+                    budget_ms, static_cast<long>(work.size()));
+            M_defer_overruns++;
+            break;
+        }
+    }
+
+    {
+        auto lock = ndrxpy_defer_lock();
+
+        /* the rest runs first in the next drain */
+        M_defer.insert(M_defer.begin(), work.begin(), work.end());
+        more = !M_defer.empty();
+    }
+
+    if (more)
+    {
+        ndrxpy_timer_kick();
+    }
+}
+
+/**
+ * @brief Work is queued: if not by the main thread, wake up the poller,
+ *  as it may wait for the next message. Main thread drains the queue
+ *  before it goes to poll.
+ */
+exprivate void ndrxpy_defer_wakeup(void)
+{
+    if (!ndrxpy_srvmain() && EXSUCCEED!=ndrxpy_timer_kick())
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        throw py::error_already_set();
+    }
+}
+
+/**
+ * @brief Add server timer
+ * @param msec timeout in milliseconds
+ * @param func callback
+ * @param periodic repeat every msec
+ * @param ptr1 custom object passed to the callback
+ * @return timer id
+ */
+expublic long ndrxpy_tpext_addtimer(long msec, const py::object &func,
+        bool periodic, const py::object &ptr1)
+{
+    long id;
+    long long interval = static_cast<long long>(msec)*1000000LL;
+
+    if (msec < 0 || (periodic && 0==msec))
+    {
+        throw std::invalid_argument("Invalid timeout: " + std::to_string(msec));
+    }
+
+    ndrxpy_timerfd_init();
+
+    id = ++M_timer_seq;
+
+    ndrxpy_timer_t *t = new ndrxpy_timer_t();
+    t->func = func;
+    t->ptr1 = ptr1;
+    t->interval = periodic?interval:0;
+    t->due = M_timerq.emplace(ndrxpy_timer_now() + interval, id);
+    M_timers[id] = t;
+
+    ndrxpy_timer_rearm();
+
+    return id;
+}
+
+/**
+ * @brief Remove server timer
+ * @param tid timer id
+ * @return true removed, false not found
+ */
+expublic bool ndrxpy_tpext_deltimer(long tid)
+{
+    auto it = M_timers.find(tid);
+
+    if (it==M_timers.end())
+    {
+        return false;
+    }
+
+    ndrxpy_timer_del(it);
+    ndrxpy_timer_rearm();
+
+    return true;
+}
+
+/**
+ * @brief Keep b4 poll callback installed, used by asyncio loop
+ */
+expublic void ndrxpy_tpext_b4poll_pin(void)
+{
+    M_defer_used = true;
+    ndrxpy_b4pollcb_install();
+}
+
 /**
  * @brief Register ATMI server extensions
  * 
@@ -253,14 +874,12 @@ expublic void ndrxpy_register_tpext(py::module &m)
     m.def(
         "tpext_delb4pollcb", [](void)
         {   
-            if (EXSUCCEED!=tpext_delb4pollcb())
-            {
-                throw atmi_exception(tperrno);
-            }
-
             //Reset handler...
             delete M_b4pollcb_handler;
             M_b4pollcb_handler = nullptr;
+
+            //Batch handler may still use the callback
+            ndrxpy_b4pollcb_uninstall();
         },
         R"pbdoc(
         Remove current before server poll callback previously
@@ -412,10 +1031,372 @@ expublic void ndrxpy_register_tpext(py::module &m)
             Function signature must accept signature of "(fd, events, ptr1)".
             Where *fd* is file descriptor, *events* is poll() events occurred on
             *fd*, ptr1 is custom pointer passed when tpext_addpollerfd() was called.
+            If :data:`None` is passed, events are delivered to the handler
+            set by :func:`.tpext_addpollbatchcb`.
 
          )pbdoc",
         py::arg("fd"), py::arg("events"), py::arg("ptr1"), py::arg("func"));
 
+     m.def(
+        "tpext_addpollbatchcb", [](const py::object &func)
+        {
+            if (nullptr!=M_pollbatch_handler)
+            {
+                delete M_pollbatch_handler;
+                M_pollbatch_handler = nullptr;
+            }
+
+            M_pollbatch_handler = new ndrxpy_object_t();
+            M_pollbatch_handler->obj = func;
+
+            ndrxpy_b4pollcb_install();
+        },
+        R"pbdoc(
+        Register batched poll events handler. Events of file descriptors
+        registered by :func:`.tpext_addpollerfd` with *func* set to :data:`None`
+        are collected during the poll cycle and delivered to the handler in
+        one call (single GIL acquisition), before the server goes to the next
+        poll. Handler is invoked before the callback set by :func:`.tpext_addb4pollcb`.
+
+        Function is not thread safe. This function applies to ATMI servers only.
+
+        .. code-block:: python
+            :caption: tpext_addpollbatchcb example
+            :name: tpext_addpollbatchcb-example
+
+            import endurox as e
+
+            def batch(events):
+                for fd, revents, conn in events:
+                    conn.process(revents)
+                return 0
+
+            # in server init:
+            e.tpext_addpollbatchcb(batch)
+            # when main thread polls:
+            e.tpext_addpollerfd(sock.fileno(), select.POLLIN, conn, None)
+
+        :raise AtmiException: 
+            | Following error codes may be present:
+            | :data:`.TPEINVAL` - Invalid parameters.
+
+        Parameters
+        ----------
+        func : object
+            Callback function with signature "(events)", where *events* is list
+            of *(fd, events, ptr1)* tuples. Function shall return **0** on
+            success, other value terminates the server.
+
+         )pbdoc",
+        py::arg("func"));
+
+     m.def(
+        "tpext_delpollbatchcb", [](void)
+        {
+            delete M_pollbatch_handler;
+            M_pollbatch_handler = nullptr;
+            M_pollbatch.clear();
+
+            ndrxpy_b4pollcb_uninstall();
+        },
+        R"pbdoc(
+        Remove batched poll events handler set by :func:`.tpext_addpollbatchcb`.
+        Pending events of the current poll cycle are discarded.
+
+        Function is not thread safe. This function applies to ATMI servers only.
+         )pbdoc");
+
+     m.def(
+        "tpext_addtimer", [](long msec, const py::object &func, bool periodic, const py::object &ptr1)
+        { return ndrxpy_tpext_addtimer(msec, func, periodic, ptr1); },
+        R"pbdoc(
+        Add server timer with millisecond resolution. Any number of one-shot
+        and periodic timers may be registered. Timers are served by the
+        server main thread, from the **timerfd** added to the server poller.
+        Timers expired at the same time are dispatched with single GIL
+        acquisition. Timers may be added in **tpsvrinit()**, these start to
+        run when the server begins to poll.
+
+        Function is not thread safe. This function applies to ATMI servers only.
+
+        .. code-block:: python
+            :caption: tpext_addtimer example
+            :name: tpext_addtimer-example
+
+            import sys
+            import endurox as e
+
+            def flush(tid, ptr1):
+                e.tplog_info("flushing %d items" % len(ptr1))
+                ptr1.clear()
+                return 0
+
+            class Server:
+
+                def tpsvrinit(self, args):
+                    self.items = []
+                    self.tid = e.tpext_addtimer(250, flush, True, self.items)
+                    e.tpadvertise("COLLECT", "COLLECT", self.COLLECT)
+                    return 0
+
+                def COLLECT(self, args):
+                    self.items.append(args.data)
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+            if __name__ == '__main__':
+                e.run(Server(), sys.argv)
+
+        :raise ValueError:
+            | Invalid timeout.
+        :raise OSError:
+            | Failed to create timer file descriptor.
+
+        Parameters
+        ----------
+        msec : int
+            Timeout in milliseconds. For periodic timers this is the period.
+        func : object
+            Callback with signature "(tid, ptr1)", where *tid* is timer id
+            and *ptr1* is custom object. Callback shall return **0**, other
+            value terminates the server.
+        periodic : bool
+            Repeat the timer every *msec* milliseconds, until removed by
+            :func:`.tpext_deltimer`.
+        ptr1 : object
+            Custom object passed to callback.
+
+        Returns
+        -------
+        tid : int
+            Timer id.
+
+         )pbdoc",
+        py::arg("msec"), py::arg("func"), py::arg("periodic")=false, py::arg("ptr1")=py::none());
+
+     m.def(
+        "tpext_deltimer", [](long tid)
+        { return ndrxpy_tpext_deltimer(tid); },
+        R"pbdoc(
+        Remove timer added by :func:`.tpext_addtimer`. May be called from
+        the timer callback.
+
+        Function is not thread safe. This function applies to ATMI servers only.
+
+        Parameters
+        ----------
+        tid : int
+            Timer id.
+
+        Returns
+        -------
+        ret : bool
+            **True** if timer was removed, **False** if timer was not found
+            (e.g. one-shot timer has already expired).
+
+         )pbdoc",
+        py::arg("tid"));
+
+     m.def(
+        "tpext_defer", [](const py::object &func, py::args args)
+        {
+            ndrxpy_timerfd_init();
+            M_defer_used = true;
+
+            ndrxpy_object_t *ent = new ndrxpy_object_t();
+            ent->obj = func;
+            ent->obj2 = args;
+
+            {
+                auto lock = ndrxpy_defer_lock();
+                M_defer.push_back(ent);
+            }
+
+            M_defer_queued++;
+            ndrxpy_defer_wakeup();
+        },
+        R"pbdoc(
+        Defer callback till the server goes to poll for the next message.
+        Deferred callbacks are run by the main thread in the order queued,
+        under single GIL hold, before the :func:`.tpext_addb4pollcb` callback.
+        Drain time is limited by :func:`.tpext_deferbudget`, the rest of the
+        work is done in the next poll cycles (poller is woken up immediately).
+        Exceptions of the callbacks are logged and ignored.
+
+        Work may be queued by any thread of the server, e.g. by multi-threaded
+        server dispatch threads, then the main thread is woken up from the
+        poll. As the wake-up file descriptor is
+        added to the poller by the main thread, such servers shall call
+        :func:`.tpext_deferbudget` in **tpsvrinit()**. This function applies to
+        ATMI servers only.
+
+        .. code-block:: python
+            :caption: tpext_defer example
+            :name: tpext_defer-example
+
+            import endurox as e
+
+            def flush_metrics(name, value):
+                metrics.send(name, value)
+
+            class Server:
+
+                def SVC(self, args):
+                    e.tpext_defer(flush_metrics, "svc.calls", 1)
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+        :raise OSError:
+            | Failed to create timer file descriptor.
+
+        Parameters
+        ----------
+        func : object
+            Callback function.
+        *args
+            Arguments passed to *func*.
+
+         )pbdoc",
+        py::arg("func"));
+
+     m.def(
+        "tpext_deferbatch", [](const py::object &func, const py::object &item)
+        {
+            ndrxpy_timerfd_init();
+            M_defer_used = true;
+
+            {
+                /* append and batch pop by the drain are serialized */
+                auto lock = ndrxpy_defer_lock();
+
+                if (nullptr==M_deferbatch)
+                {
+                    M_deferbatch = new py::dict();
+                }
+
+                if (M_deferbatch->contains(func))
+                {
+                    (*M_deferbatch)[func].cast<py::list>().append(item);
+                    return;
+                }
+
+                ndrxpy_object_t *ent = new ndrxpy_object_t();
+                ent->obj = func;
+                ent->obj2 = py::list();
+                ent->obj2.cast<py::list>().append(item);
+                (*M_deferbatch)[func] = ent->obj2;
+                M_defer.push_back(ent);
+            }
+
+            M_defer_queued++;
+            ndrxpy_defer_wakeup();
+        },
+        R"pbdoc(
+        Defer aggregated item. Items queued for equal *func* (e.g. the same
+        bound method) till the server goes to poll are delivered in a single
+        *func(items)* call, where *items* is list in the order queued. Batch
+        is run at the position where its first item was queued, see
+        :func:`.tpext_defer`.
+
+        Function is thread safe, see :func:`.tpext_defer`. This function
+        applies to ATMI servers only.
+
+        .. code-block:: python
+            :caption: tpext_deferbatch example
+            :name: tpext_deferbatch-example
+
+            import endurox as e
+
+            def post_all(items):
+                for buf in items:
+                    e.tppost("AUDIT", buf, e.TPNOREPLY)
+
+            class Server:
+
+                def SVC(self, args):
+                    e.tpext_deferbatch(post_all, {"data":{"T_STRING_FLD":"audit"}})
+                    return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+        :raise OSError:
+            | Failed to create timer file descriptor.
+
+        Parameters
+        ----------
+        func : object
+            Callback function, receives list of items.
+        item : object
+            Item to add to the batch.
+
+         )pbdoc",
+        py::arg("func"), py::arg("item"));
+
+     m.def(
+        "tpext_deferbudget", [](long msec)
+        {
+            if (msec < 0)
+            {
+                throw std::invalid_argument("Invalid budget: " + std::to_string(msec));
+            }
+
+            /* timer fd is added to the poller before the first poll, so
+             * that work queued by other threads wakes up the poller */
+            ndrxpy_timerfd_init();
+            M_defer_used = true;
+
+            return M_defer_budget.exchange(msec);
+        },
+        R"pbdoc(
+        Set time budget for single drain of deferred work queued by
+        :func:`.tpext_defer` and :func:`.tpext_deferbatch`. Default is **50**
+        milliseconds. At least one entry is run in each poll cycle. Function
+        also prepares the poller for deferred work, see :func:`.tpext_defer`.
+
+        :raise ValueError:
+            | Invalid budget.
+
+        Parameters
+        ----------
+        msec : int
+            Budget in milliseconds, **0** - unlimited.
+
+        Returns
+        -------
+        prev : int
+            Previous budget.
+
+         )pbdoc",
+        py::arg("msec"));
+
+     m.def(
+        "tpext_deferstats", [](void)
+        {
+            py::dict ret;
+            long pending;
+
+            {
+                auto lock = ndrxpy_defer_lock();
+                pending = static_cast<long>(M_defer.size());
+            }
+
+            ret["pending"] = pending;
+            ret["queued"] = M_defer_queued.load();
+            ret["run"] = M_defer_run.load();
+            ret["failed"] = M_defer_failed.load();
+            ret["overruns"] = M_defer_overruns.load();
+
+            return ret;
+        },
+        R"pbdoc(
+        Get deferred work statistics.
+
+        Returns
+        -------
+        stats : dict
+            Dictionary with keys: **pending** - entries waiting, **queued** -
+            entries queued (batch counts once), **run** - entries run,
+            **failed** - entries raised exception, **overruns** - drains
+            stopped by the budget.
+
+         )pbdoc");
+
      m.def(
         "tpext_delpollerfd", [](int fd)
         { ndrxpy_tpext_delpollerfd(fd); },
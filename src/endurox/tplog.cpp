@@ -48,11 +48,407 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
+#include <mutex>
+#include <string>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_LOGPRIV_THREAD   0x01    /**< thread logger is set       */
+#define NDRXPY_LOGPRIV_REQUEST  0x02    /**< request logger is set      */
+
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+/**
+ * @brief Placeholder for e.log level state object
+ */
+struct pylogstate
+{
+};
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+
+/** logger config generation, changed when loggers are reconfigured */
+exprivate std::atomic<long> M_loggen{1};
+/** generation of thread's cached level */
+exprivate thread_local long M_loggen_cached = 0;
+/** cached tp topic level of the thread */
+exprivate thread_local int M_loglev = 0;
+/** thread has own logger set (NDRXPY_LOGPRIV_* bits), not async logged */
+exprivate thread_local int M_logpriv = 0;
+
+/** request file cache: idle time after close, 0 - disabled */
+exprivate std::atomic<long> M_reqcache_idle_ms{0};
+exprivate std::atomic<long> M_reqcache_hits{0};     /**< reopen avoided   */
+exprivate std::atomic<long> M_reqcache_misses{0};   /**< file (re)opened  */
+exprivate std::atomic<long> M_reqcache_evicts{0};   /**< idle closes      */
+/** request file which is open for the thread */
+exprivate thread_local std::string M_reqfile;
+/** request file closed by user, but kept open */
+exprivate thread_local bool M_reqfile_idle = false;
+/** time when request file was closed by user */
+exprivate thread_local std::chrono::steady_clock::time_point M_reqfile_closed;
+/** request file cache mode of the thread, NDRXPY_REQCACHE_* */
+exprivate thread_local int M_reqcache_mode = NDRXPY_REQCACHE_USER;
+/** sweep timer of the poller thread, 0 - not armed */
+exprivate long M_reqcache_tid = 0;
+
+/** protects M_ctxlog */
+exprivate std::mutex M_ctxlog_mutex;
+/** thread logger flag of the contexts which are not bound to thread */
+exprivate std::map<TPCONTEXT_T, int> M_ctxlog {};
+
+/*---------------------------Prototypes---------------------------------*/
 
 namespace py = pybind11;
 
+/**
+ * @brief Invalidate cached log levels (of all threads)
+ */
+expublic void ndrxpy_tplog_invalidate(void)
+{
+    M_loggen++;
+}
+
+/**
+ * @brief Get current tp topic level of the thread. Level is cached until
+ *  loggers are reconfigured by this module.
+ * @return log level
+ */
+expublic int ndrxpy_tplog_level(void)
+{
+    long gen = M_loggen.load(std::memory_order_relaxed);
+
+    if (M_loggen_cached!=gen)
+    {
+        long ret = tplogqinfo(log_dump, TPLOGQI_GET_TP|TPLOGQI_EVAL_RETURN);
+
+        if (EXFAIL==ret)
+        {
+            /* let the logger decide */
+            return log_dump;
+        }
+
+        M_loglev = (ret >> 24) & 0xff;
+        M_loggen_cached = gen;
+    }
+
+    return M_loglev;
+}
+
+/**
+ * @brief Log message if level is enabled. Message is formatted with
+ *  printf-style arguments only if level is enabled, disabled messages
+ *  do not release GIL.
+ * @param lev log level
+ * @param message message or format string, str or bytes
+ * @param args format arguments
+ */
+exprivate void tplog_lazy(int lev, py::handle message, py::args &args)
+{
+    py::object fmt;
+    Py_ssize_t len;
+    const char *msg;
+    bool isbytes = PyBytes_Check(message.ptr());
+    char *bmsg;
+
+    if (!isbytes && !PyUnicode_Check(message.ptr()))
+    {
+        throw py::type_error("message must be str or bytes");
+    }
+
+    if (lev > ndrxpy_tplog_level())
+    {
+        return;
+    }
+
+    if (args.size() > 0)
+    {
+        fmt = py::reinterpret_steal<py::object>(isbytes?
+            PyNumber_Remainder(message.ptr(), args.ptr()):
+            PyUnicode_Format(message.ptr(), args.ptr()));
+
+        if (nullptr==fmt.ptr())
+        {
+            throw py::error_already_set();
+        }
+        message = fmt;
+    }
+
+    if (isbytes)
+    {
+        if (EXSUCCEED!=PyBytes_AsStringAndSize(message.ptr(), &bmsg, &len))
+        {
+            throw py::error_already_set();
+        }
+        msg = bmsg;
+    }
+    else if (nullptr==(msg=PyUnicode_AsUTF8AndSize(message.ptr(), &len)))
+    {
+        throw py::error_already_set();
+    }
+
+    if (0==M_logpriv && ndrxpy_tplog_async(lev, msg, len))
+    {
+        return;
+    }
+
+    py::gil_scoped_release release;
+    tplog(lev, const_cast<char *>(msg));
+}
+
+/**
+ * @brief Switch request file by name. If the same file is kept open by
+ *  deferred close, logger is reused.
+ * @param filename request log file name
+ */
+exprivate void reqfile_set(const std::string &filename)
+{
+    if (M_reqfile_idle && M_reqfile==filename)
+    {
+        M_reqcache_hits++;
+    }
+    else
+    {
+        tplogsetreqfile_direct(const_cast<char *>(filename.c_str()));
+        M_reqfile = filename;
+
+        if (M_reqcache_idle_ms.load() > 0)
+        {
+            M_reqcache_misses++;
+        }
+    }
+
+    M_reqfile_idle = false;
+    M_logpriv|=NDRXPY_LOGPRIV_REQUEST;
+    ndrxpy_tplog_invalidate();
+}
+
+/**
+ * @brief Arm sweep timer of the poller thread, so that idle file is closed
+ *  while server waits for requests. Timer is removed when no file is idle.
+ */
+exprivate void reqfile_sweep_arm(void)
+{
+    py::gil_scoped_acquire acquire;
+
+    if (0!=M_reqcache_tid)
+    {
+        return;
+    }
+
+    try
+    {
+        M_reqcache_tid = ndrxpy_tpext_addtimer(M_reqcache_idle_ms.load(),
+            py::cpp_function([](long tid, py::object ptr1)
+            {
+                ndrxpy_tplog_reqcache_sweep(false);
+
+                if (!M_reqfile_idle)
+                {
+                    ndrxpy_tpext_deltimer(tid);
+                    M_reqcache_tid = 0;
+                }
+                return EXSUCCEED;
+            }), true, py::none());
+    }
+    catch (std::exception &e)
+    {
+        /* file is still closed before the next service call */
+        NDRX_LOG(log_error, "Failed to add request file sweep timer: %s", e.what());
+    }
+}
+
+/**
+ * @brief Close request file of the thread. With cache enabled, file is
+ *  kept open until idle time expires or different file is set. Server
+ *  threads which are not driven by the poller close the file at once.
+ */
+exprivate void reqfile_close(void)
+{
+    if (M_reqcache_idle_ms.load() > 0 && !M_reqfile.empty() &&
+        NDRXPY_REQCACHE_EAGER!=M_reqcache_mode)
+    {
+        if (!M_reqfile_idle)
+        {
+            M_reqfile_idle = true;
+            M_reqfile_closed = std::chrono::steady_clock::now();
+
+            if (NDRXPY_REQCACHE_POLLER==M_reqcache_mode)
+            {
+                reqfile_sweep_arm();
+            }
+        }
+        return;
+    }
+
+    tplogclosereqfile();
+    M_reqfile.clear();
+    M_reqfile_idle = false;
+    M_logpriv&=~NDRXPY_LOGPRIV_REQUEST;
+    ndrxpy_tplog_invalidate();
+}
+
+/**
+ * @brief Close idle request file of the current thread
+ * @param force close regardless of the idle time
+ * @return 1 if file was closed, 0 if not
+ */
+expublic int ndrxpy_tplog_reqcache_sweep(bool force)
+{
+    if (!M_reqfile_idle)
+    {
+        return 0;
+    }
+
+    if (!force && std::chrono::steady_clock::now() - M_reqfile_closed <
+        std::chrono::milliseconds(M_reqcache_idle_ms.load()))
+    {
+        return 0;
+    }
+
+    tplogclosereqfile();
+    M_reqfile.clear();
+    M_reqfile_idle = false;
+    M_logpriv&=~NDRXPY_LOGPRIV_REQUEST;
+    ndrxpy_tplog_invalidate();
+    M_reqcache_evicts++;
+
+    return 1;
+}
+
+/**
+ * @brief Set request file cache mode of the current thread
+ * @param mode NDRXPY_REQCACHE_USER - idle file closed by user sweep,
+ *  NDRXPY_REQCACHE_POLLER - server main thread, swept by the timer,
+ *  NDRXPY_REQCACHE_EAGER - file is closed without caching
+ */
+expublic void ndrxpy_tplog_reqcache_mode(int mode)
+{
+    M_reqcache_mode = mode;
+}
+
+/**
+ * @brief Get current context with tpgetctxt(). Logger state cached by the
+ *  module for the thread is saved with the context, and thread starts with
+ *  NULL context state. Idle request file kept open by the cache is closed,
+ *  as it belongs to the context which is left.
+ * @param ctxt [out] context handle
+ * @param flags tpgetctxt() flags
+ * @return tpgetctxt() result
+ */
+expublic int ndrxpy_tpgetctxt(TPCONTEXT_T *ctxt, long flags)
+{
+    int ret;
+
+    ndrxpy_tplog_reqcache_sweep(true);
+
+    if (EXFAIL==(ret=tpgetctxt(ctxt, flags)))
+    {
+        return EXFAIL;
+    }
+
+    if (TPMULTICONTEXTS==ret)
+    {
+        std::lock_guard<std::mutex> lock(M_ctxlog_mutex);
+
+        if (M_logpriv & NDRXPY_LOGPRIV_THREAD)
+        {
+            M_ctxlog[*ctxt] = NDRXPY_LOGPRIV_THREAD;
+        }
+        else
+        {
+            M_ctxlog.erase(*ctxt);
+        }
+    }
+
+    M_logpriv = 0;
+    M_reqfile.clear();
+    M_reqfile_idle = false;
+    ndrxpy_tplog_invalidate();
+
+    return ret;
+}
+
+/**
+ * @brief Set current context with tpsetctxt(). Logger state of the
+ *  context left is saved, state of the new context is restored: thread
+ *  logger flag as saved by ndrxpy_tpgetctxt(), request file as reported
+ *  by the logger.
+ * @param ctxt context handle or TPNULLCONTEXT
+ * @param flags tpsetctxt() flags
+ * @return EXSUCCEED/EXFAIL
+ */
+expublic int ndrxpy_tpsetctxt(TPCONTEXT_T ctxt, long flags)
+{
+    TPCONTEXT_T prev;
+    int prevret;
+    char reqfile[PATH_MAX+1]="";
+
+    if (EXFAIL==(prevret=ndrxpy_tpgetctxt(&prev, 0)))
+    {
+        return EXFAIL;
+    }
+
+    if (EXSUCCEED!=tpsetctxt(ctxt, flags))
+    {
+        int err = tperrno;
+
+        /* keep the thread where it was */
+        if (TPMULTICONTEXTS==prevret)
+        {
+            ndrxpy_tpsetctxt(prev, 0);
+        }
+
+        tperrno = err;
+        return EXFAIL;
+    }
+
+    if (TPNULLCONTEXT==ctxt)
+    {
+        return EXSUCCEED;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(M_ctxlog_mutex);
+        auto it = M_ctxlog.find(ctxt);
+
+        if (M_ctxlog.end()!=it)
+        {
+            M_logpriv = it->second;
+            M_ctxlog.erase(it);
+        }
+    }
+
+    tploggetreqfile(reqfile, sizeof(reqfile));
+
+    if (EXEOS!=reqfile[0])
+    {
+        M_reqfile = reqfile;
+        M_logpriv|=NDRXPY_LOGPRIV_REQUEST;
+    }
+
+    ndrxpy_tplog_invalidate();
+
+    return EXSUCCEED;
+}
+
+/**
+ * @brief Context is freed, drop its saved logger state
+ * @param ctxt context handle
+ */
+expublic void ndrxpy_tplog_ctxfree(TPCONTEXT_T ctxt)
+{
+    std::lock_guard<std::mutex> lock(M_ctxlog_mutex);
+    M_ctxlog.erase(ctxt);
+}
+
 /**
  * @brief Register ATMI logging api
  * 
@@ -69,10 +465,9 @@ expublic void ndrxpy_register_tplog(py::module &m)
     //Logging functions:
     m.def(
         "tplog_debug",
-        [](const char *message)
+        [](py::handle message, py::args args)
         {
-            py::gil_scoped_release release;
-            tplog(log_debug, const_cast<char *>(message));
+            tplog_lazy(log_debug, message, args);
         },
         R"pbdoc(
         Print debug message to log file. Debug is logged as level **5**.
@@ -81,17 +476,19 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
         Parameters
         ----------
-        message : str
+        message : str or bytes
             Debug message to print.
+        *args
+            Optional format arguments, message is formatted with ``%`` operator
+            only if the level is enabled.
         )pbdoc"
         , py::arg("message"));
 
     m.def(
         "tplog_info",
-        [](const char *message)
+        [](py::handle message, py::args args)
         {
-            py::gil_scoped_release release;
-            tplog(log_info, const_cast<char *>(message));
+            tplog_lazy(log_info, message, args);
         },
         R"pbdoc(
         Print info message to log file. Info is logged as level **4**.
@@ -100,17 +497,19 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
         Parameters
         ----------
-        message : str
+        message : str or bytes
             Info message to print.
+        *args
+            Optional format arguments, message is formatted with ``%`` operator
+            only if the level is enabled.
         )pbdoc"
         , py::arg("message"));
 
     m.def(
         "tplog_warn",
-        [](const char *message)
+        [](py::handle message, py::args args)
         {
-            py::gil_scoped_release release;
-            tplog(log_error, const_cast<char *>(message));
+            tplog_lazy(log_error, message, args);
         },
         R"pbdoc(
         Print warning message to log file. Warning is logged as level **3**.
@@ -119,16 +518,18 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
         Parameters
         ----------
-        message : str
+        message : str or bytes
             Warning message to print.
+        *args
+            Optional format arguments, message is formatted with ``%`` operator
+            only if the level is enabled.
         )pbdoc", py::arg("message"));
 
     m.def(
         "tplog_error",
-        [](const char *message)
+        [](py::handle message, py::args args)
         {
-            py::gil_scoped_release release;
-            tplog(log_error, const_cast<char *>(message));
+            tplog_lazy(log_error, message, args);
         },
         R"pbdoc(
         Print error message to log file. Error is logged as level **2**.
@@ -137,16 +538,18 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
         Parameters
         ----------
-        message : str
+        message : str or bytes
             Error message to print.
+        *args
+            Optional format arguments, message is formatted with ``%`` operator
+            only if the level is enabled.
         )pbdoc", py::arg("message"));
 
     m.def(
         "tplog_always",
-        [](const char *message)
+        [](py::handle message, py::args args)
         {
-            py::gil_scoped_release release;
-            tplog(log_error, const_cast<char *>(message));
+            tplog_lazy(log_error, message, args);
         },
         R"pbdoc(
         Print fatal message to log file. Fatal/always is logged as level **1**.
@@ -155,19 +558,31 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
         Parameters
         ----------
-        message : str
+        message : str or bytes
             Fatal message to print.
+        *args
+            Optional format arguments, message is formatted with ``%`` operator
+            only if the level is enabled.
         )pbdoc", py::arg("message"));
 
     m.def(
         "tplog",
-        [](int lev, const char *message)
+        [](int lev, py::handle message, py::args args)
         {
-            py::gil_scoped_release release;
-            tplog(lev, const_cast<char *>(message));
+            tplog_lazy(lev, message, args);
         },
         R"pbdoc(
-        Print logfile message with specified level.
+        Print logfile message with specified level. If level is not enabled
+        for the current logger, call returns without formatting the message.
+
+        .. code-block:: python
+            :caption: tplog example
+            :name: tplog-example
+
+                import endurox as e
+                e.tplog(e.log_debug, "Got %d records from %s", 10, "DB")
+                if e.log.dump_enabled:
+                    e.tplog(e.log_dump, "Details: %s", expensive_fn())
 
         For more details see **tplog(3)** C API call
 
@@ -177,8 +592,11 @@ expublic void ndrxpy_register_tplog(py::module &m)
             Log level with consts: :data:`.log_dump`, :data:`.log_debug`,
             :data:`.log_info`, :data:`.log_warn`, :data:`.log_error`, :data:`.log_always`
             or specify the number (1..6).
-        message : str
+        message : str or bytes
             Message to log.
+        *args
+            Optional format arguments, message is formatted with ``%`` operator
+            only if the level is enabled.
         )pbdoc", py::arg("lev"), py::arg("message"));
 
     m.def(
@@ -191,6 +609,17 @@ expublic void ndrxpy_register_tplog(py::module &m)
             {
                 throw nstd_exception(Nerror);
             }
+
+            if (logger & LOG_FACILITY_TP_THREAD)
+            {
+                M_logpriv|=NDRXPY_LOGPRIV_THREAD;
+            }
+
+            if (logger & LOG_FACILITY_TP_REQUEST)
+            {
+                M_logpriv|=NDRXPY_LOGPRIV_REQUEST;
+            }
+            ndrxpy_tplog_invalidate();
         },
         R"pbdoc(
         Configure Enduro/X logger.
@@ -310,6 +739,39 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
             atmibuf in;
 
+            /* request file name already present in the dict, no need to
+             * build the UBF buffer for the lookup */
+            if (py::isinstance<py::dict>(data))
+            {
+                auto dict = static_cast<py::dict>(data);
+
+                if (dict.contains(NDRXPY_DATA_DATA) &&
+                    (!dict.contains(NDRXPY_DATA_BUFTYPE) ||
+                        std::string(py::str(dict[NDRXPY_DATA_BUFTYPE]))=="UBF"))
+                {
+                    py::object ubf = dict[NDRXPY_DATA_DATA];
+
+                    if (py::isinstance<py::dict>(ubf) && 
+                        static_cast<py::dict>(ubf).contains("EX_NREQLOGFILE"))
+                    {
+                        py::object fname = static_cast<py::dict>(ubf)["EX_NREQLOGFILE"];
+
+                        if (py::isinstance<py::list>(fname) && py::len(fname) > 0)
+                        {
+                            fname = static_cast<py::list>(fname)[0];
+                        }
+
+                        if (py::isinstance<py::str>(fname))
+                        {
+                            std::string val = fname.cast<std::string>();
+                            py::gil_scoped_release release;
+                            reqfile_set(val);
+                            return data;
+                        }
+                    }
+                }
+            }
+
             if (!py::isinstance<py::none>(data))
             {
                 in = ndrx_from_py(data);
@@ -318,25 +780,50 @@ expublic void ndrxpy_register_tplog(py::module &m)
             {
                 char type[8]={EXEOS};
                 char subtype[16]={EXEOS};
+                char reqfile[PATH_MAX+1]={EXEOS};
                 py::gil_scoped_release release;
 
                 //Check is it UBF or not?
 
-                if (tptypes(*in.pp, type, subtype) == EXFAIL)
+                if (nullptr!=*in.pp && tptypes(*in.pp, type, subtype) == EXFAIL)
                 {
                     NDRX_LOG(log_error, "Invalid buffer type");
                     throw std::invalid_argument("Invalid buffer type");
                 }
 
-                if (EXFAIL==tplogsetreqfile( (0==strcmp(type, "UBF")?in.pp:NULL), const_cast<char *>(filename), 
-                    const_cast<char *>(filesvc)))
+                if (0==strcmp(type, "UBF") && EXSUCCEED==tploggetbufreqfile(*in.pp, 
+                        reqfile, sizeof(reqfile)))
+                {
+                    /* name is known, may use cached file */
+                    reqfile_set(reqfile);
+                }
+                else
                 {
-                    // In case if buffer changed..
-                    in.p=*in.pp;
-                    throw atmi_exception(tperrno);   
+                    if (EXFAIL==tplogsetreqfile( (0==strcmp(type, "UBF")?in.pp:NULL), const_cast<char *>(filename), 
+                        const_cast<char *>(filesvc)))
+                    {
+                        throw atmi_exception(tperrno);   
+                    }
+
+                    M_reqfile_idle = false;
+                    tploggetreqfile(reqfile, sizeof(reqfile));
+                    M_reqfile = reqfile;
+
+                    if (M_reqcache_idle_ms.load() > 0)
+                    {
+                        M_reqcache_misses++;
+                    }
+                    M_logpriv|=NDRXPY_LOGPRIV_REQUEST;
+                    ndrxpy_tplog_invalidate();
                 }
-                // In case if buffer changed..
-                in.p=*in.pp;
+                /* buffer is changed via in.pp, which is either ours
+                 * or AtmiBuf handle's */
+            }
+
+            /* handle is updated in place */
+            if (py::isinstance<pyatmibuf>(data))
+            {
+                return data;
             }
 
             //Return python object... (in case if one was passed in...)
@@ -376,7 +863,9 @@ expublic void ndrxpy_register_tplog(py::module &m)
         data: dict
             UBF buffer, where to search for **EX_NREQLOGFILE** field. Or if field is not found
             this buffer is used to call *filesvc*. Parameter is conditional.May use :data:`None` or 
-            empty string if not present.
+            empty string if not present. :class:`.AtmiBuf` handle (e.g. *args.buf* of the service
+            call) is used in place and returned as is. If dictionary contains the
+            **EX_NREQLOGFILE** field, the dictionary is returned without conversion.
         filename : str
             New request file name. Parameter is conditional. May use :data:`None` or 
             empty string if not present.
@@ -398,7 +887,7 @@ expublic void ndrxpy_register_tplog(py::module &m)
         [](std::string filename)
         {
             py::gil_scoped_release release;
-            tplogsetreqfile_direct(const_cast<char *>(filename.c_str()));
+            reqfile_set(filename);
         },
         R"pbdoc(
         Set logfile from given filename.
@@ -459,7 +948,12 @@ expublic void ndrxpy_register_tplog(py::module &m)
             char filename[PATH_MAX+1]="";
             {
                 py::gil_scoped_release release;
-                tploggetreqfile(filename, sizeof(filename));
+
+                /* closed by user, kept open by the cache */
+                if (!M_reqfile_idle)
+                {
+                    tploggetreqfile(filename, sizeof(filename));
+                }
             }
             return py::str(filename);
         },
@@ -518,10 +1012,11 @@ expublic void ndrxpy_register_tplog(py::module &m)
         [](void)
         {
             py::gil_scoped_release release;
-            tplogclosereqfile();
+            reqfile_close();
         },
         R"pbdoc(
-        Close request logging file.
+        Close request logging file. If request file cache is enabled by
+        :func:`.tplogreqcache_config`, file is closed later.
                 
         For more details see **tplogclosereqfile(3)** C API call.
 
@@ -533,6 +1028,8 @@ expublic void ndrxpy_register_tplog(py::module &m)
         {
             py::gil_scoped_release release;
             tplogclosethread();
+            M_logpriv&=~NDRXPY_LOGPRIV_THREAD;
+            ndrxpy_tplog_invalidate();
         },
         R"pbdoc(
         Close thread logging file.
@@ -551,18 +1048,125 @@ expublic void ndrxpy_register_tplog(py::module &m)
 
         )pbdoc");
 
+     m.def(
+        "tplogreqcache_config",
+        [](long idle_ms)
+        {
+            if (idle_ms < 0)
+            {
+                throw std::invalid_argument("Invalid idle time: " + std::to_string(idle_ms));
+            }
+
+            M_reqcache_idle_ms.store(idle_ms);
+
+            if (0==idle_ms)
+            {
+                py::gil_scoped_release release;
+                ndrxpy_tplog_reqcache_sweep(true);
+            }
+        },
+        R"pbdoc(
+        Configure request log file cache. When enabled, :func:`.tplogclosereqfile`
+        does not close the request file immediately. File is kept open for
+        *idle_ms* milliseconds, and if the next request of the thread uses
+        the same file (:func:`.tplogsetreqfile`, :func:`.tplogsetreqfile_direct`),
+        file is not reopened. Idle files are closed by :func:`.tplogreqcache_sweep`,
+        or when other request file is set. For ATMI servers, idle file of the
+        main thread is closed by the server timer (see :func:`.tpext_addtimer`)
+        and expired file is closed before the next service call. Service
+        dispatch threads of multi-threaded servers do not cache the files.
+
+        As Enduro/X keeps one request logger per thread, at most one file
+        per thread is kept open. Until the idle file is closed, logs of the
+        thread are written to that file.
+
+        .. code-block:: python
+            :caption: tplogreqcache_config example
+            :name: tplogreqcache_config-example
+
+                import endurox as e
+                e.tplogreqcache_config(2000)
+                e.tplogsetreqfile_direct("/tmp/cust_1")
+                e.tplogclosereqfile()
+                # no reopen here
+                e.tplogsetreqfile_direct("/tmp/cust_1")
+
+        :raise ValueError:
+            | Invalid idle time.
+
+        Parameters
+        ----------
+        idle_ms: int
+            Idle time in milliseconds. **0** disables the cache and closes
+            idle file of the current thread.
+         )pbdoc", py::arg("idle_ms"));
+
+     m.def(
+        "tplogreqcache_sweep",
+        [](bool force)
+        {
+            py::gil_scoped_release release;
+            return ndrxpy_tplog_reqcache_sweep(force);
+        },
+        R"pbdoc(
+        Close request log file of the current thread, if it is closed by
+        :func:`.tplogclosereqfile` and idle time set by :func:`.tplogreqcache_config`
+        has expired.
+
+        Parameters
+        ----------
+        force: bool
+            Close idle file regardless of the idle time.
+
+        Returns
+        -------
+        ret : int
+            **1** if file was closed, **0** if not.
+         )pbdoc", py::arg("force")=false);
+
+     m.def(
+        "tplogreqcache_stats",
+        [](void)
+        {
+            py::dict ret;
+
+            ret["idle_ms"] = M_reqcache_idle_ms.load();
+            ret["hits"] = M_reqcache_hits.load();
+            ret["misses"] = M_reqcache_misses.load();
+            ret["evictions"] = M_reqcache_evicts.load();
+
+            return ret;
+        },
+        R"pbdoc(
+        Get request log file cache statistics (process wide).
+
+        Returns
+        -------
+        stats : dict
+            Dictionary with keys: **idle_ms** - configured idle time,
+            **hits** - request file set without reopen, **misses** - request
+            file opened while cache enabled, **evictions** - idle files closed
+            by the sweep.
+         )pbdoc");
+
      m.def(
         "tplogdump",
-        [](int lev, const char * comment, py::bytes data)
+        [](int lev, const char * comment, py::object data)
         {
-            std::string val(PyBytes_AsString(data.ptr()), PyBytes_Size(data.ptr()));
+            if (lev > ndrxpy_tplog_level())
+            {
+                return;
+            }
+
+            pybufview val(data);
 
             py::gil_scoped_release release;
-            tplogdump(lev, const_cast<char *>(comment), 
-                const_cast<char *>(val.data()), val.size());
+            tplogdump(lev, const_cast<char *>(comment), val.buf(), val.len());
         },
         R"pbdoc(
-        Dump byte array to log file.
+        Dump byte array to log file. Any object supporting buffer protocol
+        (bytes, bytearray, memoryview, mmap, etc.) is accepted and dumped
+        without copying. If level is not enabled, data is not accessed.
 
         .. code-block:: python
             :caption: tplogdump example
@@ -585,26 +1189,30 @@ expublic void ndrxpy_register_tplog(py::module &m)
         comment: str
             Log title.
         data: bytes
-            Bytes to dump to log.
+            Bytes or other contiguous buffer object to dump to log.
         )pbdoc",
         py::arg("lev"), py::arg("comment"), py::arg("data"));
 
      m.def(
         "tplogdumpdiff",
-        [](int lev, const char * comment, py::bytes data1, py::bytes data2)
+        [](int lev, const char * comment, py::object data1, py::object data2)
         {
-            std::string val1(PyBytes_AsString(data1.ptr()), PyBytes_Size(data1.ptr()));
-            std::string val2(PyBytes_AsString(data2.ptr()), PyBytes_Size(data2.ptr()));
+            if (lev > ndrxpy_tplog_level())
+            {
+                return;
+            }
 
-            long len = std::min(val1.size(), val2.size());
+            pybufview val1(data1);
+            pybufview val2(data2);
+            long len = std::min(val1.len(), val2.len());
 
             py::gil_scoped_release release;
-            tplogdumpdiff(lev, const_cast<char *>(comment), 
-                const_cast<char *>(val1.data()), const_cast<char *>(val2.data()), 
-                len);
+            tplogdumpdiff(lev, const_cast<char *>(comment), val1.buf(), val2.buf(), len);
         },
         R"pbdoc(
         Compare two byte arrays and print differences for the common length.
+        Any objects supporting buffer protocol are accepted and compared
+        without copying. If level is not enabled, data is not accessed.
 
         .. code-block:: python
             :caption: tplogdumpdiff example
@@ -629,9 +1237,9 @@ expublic void ndrxpy_register_tplog(py::module &m)
         comment: str
             Log title.
         data1: bytes
-            Bytes to compare.
+            Bytes or other contiguous buffer object to compare.
         data2: bytes
-            Bytes to compare.
+            Bytes or other contiguous buffer object to compare.
         )pbdoc",
         py::arg("lev"), py::arg("comment"), py::arg("data1"), py::arg("data2"));
 
@@ -741,12 +1349,18 @@ expublic void ndrxpy_register_tplog(py::module &m)
         "tplogprintubf",
         [](int lev, const char *title, py::object data)
         {
+            if (lev > ndrxpy_tplog_level())
+            {
+                return;
+            }
+
             auto in = ndrx_from_py(data);
             py::gil_scoped_release release;
             tplogprintubf(lev, const_cast<char *>(title), reinterpret_cast<UBFH *>(*in.pp));
         },
         R"pbdoc(
-        Print UBF buffer to log file.
+        Print UBF buffer to log file. If level is not enabled, *data* is not
+        converted. :class:`.AtmiBuf` handle is printed without conversion.
 
         .. code-block:: python
             :caption: tplogprintubf example
@@ -770,11 +1384,42 @@ expublic void ndrxpy_register_tplog(py::module &m)
         title: str
             Dump title.
         data: dict
-            UBF buffer to print.
+            UBF buffer or :class:`.AtmiBuf` handle to print.
 
          )pbdoc",
         py::arg("lev"), py::arg("title"), py::arg("data"));
 
+    //Cached level state
+    py::class_<pylogstate>(m, "LogState", R"pbdoc(
+        Cached **tp** topic log level of the current thread, available
+        as :data:`endurox.log`. Level is cached per thread and refreshed
+        after :func:`.tplogconfig`, :func:`.tplogsetreqfile`,
+        :func:`.tplogsetreqfile_direct`, :func:`.tplogclosereqfile` and
+        :func:`.tplogclosethread` calls. Use the flags to guard expensive
+        message preparation.
+
+        .. code-block:: python
+            :caption: LogState example
+            :name: LogState-example
+
+                import endurox as e
+                if e.log.debug_enabled:
+                    e.tplog_debug("State: %s", build_state_dump())
+        )pbdoc")
+        .def_property_readonly("level", [](pylogstate &s)
+            { return ndrxpy_tplog_level(); }, "Current tp log level")
+        .def_property_readonly("dump_enabled", [](pylogstate &s)
+            { return ndrxpy_tplog_level() >= log_dump; }, "Is dump level (6) enabled")
+        .def_property_readonly("debug_enabled", [](pylogstate &s)
+            { return ndrxpy_tplog_level() >= log_debug; }, "Is debug level (5) enabled")
+        .def_property_readonly("info_enabled", [](pylogstate &s)
+            { return ndrxpy_tplog_level() >= log_info; }, "Is info level (4) enabled")
+        .def_property_readonly("warn_enabled", [](pylogstate &s)
+            { return ndrxpy_tplog_level() >= log_warn; }, "Is warning level (3) enabled")
+        .def_property_readonly("error_enabled", [](pylogstate &s)
+            { return ndrxpy_tplog_level() >= log_error; }, "Is error level (2) enabled");
+
+    m.attr("log") = py::cast(pylogstate(), py::return_value_policy::move);
 }
 
 /* vim: set ts=4 sw=4 et smartindent: */
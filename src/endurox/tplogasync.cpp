@@ -0,0 +1,559 @@
+/**
+ * @brief Asynchronous writer for Python tplog calls
+ *
+ * @file tplogasync.cpp
+ */
+/* -----------------------------------------------------------------------------
+ * Python module for Enduro/X
+ * This software is released under MIT license.
+ *
+ * -----------------------------------------------------------------------------
+ * MIT License
+ * Copyright (C) 2022 Mavimax SIA
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * -----------------------------------------------------------------------------
+ */
+
+/*---------------------------Includes-----------------------------------*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+
+#include <atmi.h>
+#include <ubf.h>
+#undef _
+
+#include "exceptions.h"
+#include "ndrx_pymod.h"
+
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*---------------------------Externs------------------------------------*/
+/*---------------------------Macros-------------------------------------*/
+
+#define NDRXPY_LOGASYNC_DFLTCAP     4096    /**< default ring capacity      */
+#define NDRXPY_LOGASYNC_IDLEMS      10      /**< writer idle wait, ms       */
+#define NDRXPY_LOGASYNC_BLOCKUS     100     /**< full ring retry sleep, us  */
+
+/*---------------------------Enums--------------------------------------*/
+/*---------------------------Typedefs-----------------------------------*/
+
+namespace py = pybind11;
+
+/**
+ * @brief Log record slot. Call time, thread and level are captured
+ *  by the producer.
+ */
+typedef struct
+{
+    std::atomic<size_t> seq;    /**< slot sequence (ring state)     */
+    int lev;                    /**< log level                      */
+    struct timeval tv;          /**< call time                      */
+    unsigned long tid;          /**< calling thread                 */
+    std::string msg;            /**< message                        */
+} ndrxpy_logrec_t;
+
+/**
+ * @brief Bounded lock-free ring, multiple producers, single consumer
+ *  (writer thread). Slot sequences according to D.Vyukov bounded queue.
+ */
+class ndrxpy_logring
+{
+public:
+
+    std::unique_ptr<ndrxpy_logrec_t[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;   /**< enqueue position   */
+    alignas(64) std::atomic<size_t> tail;   /**< dequeue position   */
+
+    /**
+     * @brief Allocate ring
+     * @param capacity number of slots, rounded up to power of 2
+     */
+    ndrxpy_logring(size_t capacity)
+    {
+        size_t cap = 2;
+
+        while (cap < capacity)
+        {
+            cap <<= 1;
+        }
+
+        slots.reset(new ndrxpy_logrec_t[cap]);
+        mask = cap-1;
+
+        for (size_t i=0; i<cap; i++)
+        {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Enqueue record
+     * @return false if ring is full
+     */
+    bool push(int lev, struct timeval &tv, unsigned long tid,
+            const char *msg, size_t len)
+    {
+        ndrxpy_logrec_t *slot;
+        size_t pos = head.load(std::memory_order_relaxed);
+
+        while (1)
+        {
+            slot = &slots[pos & mask];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (0==diff)
+            {
+                if (head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->lev = lev;
+        slot->tv = tv;
+        slot->tid = tid;
+        slot->msg.assign(msg, len);
+        slot->seq.store(pos+1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief Dequeue record, consumer only
+     * @return nullptr if ring is empty, otherwise slot which must be
+     *  released with release()
+     */
+    ndrxpy_logrec_t *peek(void)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        ndrxpy_logrec_t *slot = &slots[pos & mask];
+
+        if (slot->seq.load(std::memory_order_acquire)!=pos+1)
+        {
+            return nullptr;
+        }
+
+        return slot;
+    }
+
+    /**
+     * @brief Give slot back to producers
+     * @param slot slot returned by peek()
+     */
+    void release(ndrxpy_logrec_t *slot)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+
+        slot->msg.clear();
+        slot->seq.store(pos+mask+1, std::memory_order_release);
+        tail.store(pos+1, std::memory_order_relaxed);
+    }
+};
+
+/*---------------------------Globals------------------------------------*/
+/*---------------------------Statics------------------------------------*/
+
+/* ring and writer are not static objects, so that process exit without
+ * interpreter finalization does not destroy them under running writer */
+exprivate ndrxpy_logring *M_ring = nullptr;         /**< active ring     */
+exprivate std::atomic<bool> M_active{false};        /**< accepting recs  */
+exprivate std::atomic<int> M_users{0};              /**< producers in    */
+exprivate std::atomic<bool> M_run{false};           /**< writer runs     */
+exprivate std::atomic<bool> M_sleeping{false};      /**< writer is idle  */
+exprivate int M_policy = NDRXPY_LOGASYNC_BLOCK;     /**< full ring mode  */
+exprivate std::thread *M_writer = nullptr;          /**< writer thread   */
+exprivate std::mutex M_mutex;                       /**< idle wait lock  */
+exprivate std::condition_variable M_cond;           /**< idle wait cond  */
+exprivate bool M_atexit = false;                    /**< atexit set      */
+exprivate bool M_catexit = false;                   /**< C atexit set    */
+
+exprivate std::atomic<long> M_queued{0};            /**< records queued  */
+exprivate std::atomic<long> M_written{0};           /**< records written */
+exprivate std::atomic<long> M_dropped{0};           /**< records dropped */
+exprivate std::atomic<long> M_blocked{0};           /**< producer waits  */
+
+/*---------------------------Prototypes---------------------------------*/
+
+/**
+ * @brief Writer thread. Records are written to the process tp logger,
+ *  with original call time and thread.
+ */
+exprivate void logasync_writer(void)
+{
+    ndrxpy_logrec_t *rec;
+    long dropped_rep = 0;
+    struct tm tm;
+    ndrx_debug_t *dbg;
+    bool unflushed = false;
+    int pid = static_cast<int>(getpid());
+
+    while (1)
+    {
+        if (nullptr!=(rec=M_ring->peek()))
+        {
+            /* written to the logger file directly, as tplog() would add
+             * writer's time and thread to the line */
+            if (nullptr!=(dbg=tplogfplock(rec->lev, 0)))
+            {
+                localtime_r(&rec->tv.tv_sec, &tm);
+                fprintf(tplogfpget(dbg, 0),
+                    "t:USER:%d:%05d:[%04d%02d%02d:%02d%02d%02d%06ld:%lx] %s\n",
+                    rec->lev, pid,
+                    tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday,
+                    tm.tm_hour, tm.tm_min, tm.tm_sec,
+                    static_cast<long>(rec->tv.tv_usec), rec->tid, rec->msg.c_str());
+                tplogfpunlock(dbg);
+                unflushed = true;
+            }
+
+            M_ring->release(rec);
+            M_written++;
+            continue;
+        }
+
+        if (unflushed && nullptr!=(dbg=tplogfplock(-1, 0)))
+        {
+            fflush(tplogfpget(dbg, 0));
+            tplogfpunlock(dbg);
+            unflushed = false;
+        }
+
+        if (NDRXPY_LOGASYNC_COUNT==M_policy && M_dropped.load()!=dropped_rep)
+        {
+            long dropped = M_dropped.load();
+            char msg[128];
+
+            snprintf(msg, sizeof(msg), "tplogasync: %ld log messages dropped (total %ld)",
+                dropped-dropped_rep, dropped);
+            tplog(log_error, msg);
+            dropped_rep = dropped;
+        }
+
+        if (!M_run.load())
+        {
+            /* drained */
+            break;
+        }
+
+        /* producers notify only sleeping writer, a missed notification
+         * delays the write by the idle wait at most */
+        std::unique_lock<std::mutex> lock(M_mutex);
+        M_sleeping.store(true);
+
+        if (nullptr==M_ring->peek() && M_run.load())
+        {
+            M_cond.wait_for(lock, std::chrono::milliseconds(NDRXPY_LOGASYNC_IDLEMS));
+        }
+        M_sleeping.store(false);
+    }
+}
+
+/**
+ * @brief Stop writer, remaining records are written. GIL not held.
+ */
+exprivate void logasync_stop_nogil(void)
+{
+    if (!M_run.load())
+    {
+        return;
+    }
+
+    M_active.store(false);
+
+    /* wait for producers blocked on full ring */
+    while (M_users.load() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(NDRXPY_LOGASYNC_BLOCKUS));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(M_mutex);
+        M_run.store(false);
+    }
+    M_cond.notify_one();
+    M_writer->join();
+
+    delete M_writer;
+    M_writer = nullptr;
+    delete M_ring;
+    M_ring = nullptr;
+}
+
+/**
+ * @brief Stop writer, remaining records are written. GIL held.
+ */
+exprivate void logasync_stop(void)
+{
+    py::gil_scoped_release release;
+    logasync_stop_nogil();
+}
+
+/**
+ * @brief Process exit without interpreter finalization (e.g. exit() of
+ *  the server), write remaining records
+ */
+exprivate void logasync_atexit(void)
+{
+    logasync_stop_nogil();
+}
+
+/**
+ * @brief Forked child has no writer thread, log calls are written
+ *  directly. Thread object and ring of the parent are left as is.
+ */
+exprivate void logasync_atfork_child(void)
+{
+    M_active.store(false);
+    M_run.store(false);
+    M_users.store(0);
+    M_writer = nullptr;
+    M_ring = nullptr;
+}
+
+/**
+ * @brief Queue message for asynchronous write
+ * @param lev log level
+ * @param msg message
+ * @param len message length
+ * @return true if message is consumed (queued or dropped), false if
+ *  async mode is not active and message shall be written directly
+ */
+expublic bool ndrxpy_tplog_async(int lev, const char *msg, Py_ssize_t len)
+{
+    struct timeval tv;
+    bool ret = true;
+
+    if (!M_active.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    M_users++;
+
+    if (!M_active.load())
+    {
+        M_users--;
+        return false;
+    }
+
+    gettimeofday(&tv, NULL);
+
+    if (!M_ring->push(lev, tv, static_cast<unsigned long>(pthread_self()), msg, len))
+    {
+        if (NDRXPY_LOGASYNC_BLOCK!=M_policy)
+        {
+            M_dropped++;
+            goto out;
+        }
+
+        M_blocked++;
+
+        {
+            py::gil_scoped_release release;
+
+            do
+            {
+                if (!M_active.load())
+                {
+                    /* stopping, write directly */
+                    ret = false;
+                    goto out;
+                }
+
+                M_cond.notify_one();
+                std::this_thread::sleep_for(std::chrono::microseconds(NDRXPY_LOGASYNC_BLOCKUS));
+
+            } while (!M_ring->push(lev, tv, static_cast<unsigned long>(pthread_self()), msg, len));
+        }
+    }
+
+    M_queued++;
+
+    if (M_sleeping.load(std::memory_order_relaxed))
+    {
+        M_cond.notify_one();
+    }
+
+out:
+    M_users--;
+    return ret;
+}
+
+/**
+ * @brief Register asynchronous logging api
+ *
+ * @param m Pybind11 module handle
+ */
+expublic void ndrxpy_register_tplogasync(py::module &m)
+{
+    m.def(
+        "tplogasync_start",
+        [](long capacity, int policy)
+        {
+            if (capacity < 1)
+            {
+                throw std::invalid_argument("Invalid capacity: " + std::to_string(capacity));
+            }
+
+            if (NDRXPY_LOGASYNC_BLOCK!=policy && NDRXPY_LOGASYNC_DROP!=policy &&
+                NDRXPY_LOGASYNC_COUNT!=policy)
+            {
+                throw std::invalid_argument("Invalid policy: " + std::to_string(policy));
+            }
+
+            logasync_stop();
+
+            M_ring = new ndrxpy_logring(capacity);
+            M_policy = policy;
+            M_queued.store(0);
+            M_written.store(0);
+            M_dropped.store(0);
+            M_blocked.store(0);
+            M_run.store(true);
+            M_writer = new std::thread(logasync_writer);
+            M_active.store(true);
+
+            if (!M_catexit)
+            {
+                /* exit() without interpreter finalization */
+                atexit(logasync_atexit);
+                pthread_atfork(NULL, NULL, logasync_atfork_child);
+                M_catexit = true;
+            }
+
+            if (!M_atexit)
+            {
+                /* flush before interpreter finalizes */
+                py::module::import("atexit").attr("register")(
+                    py::cpp_function([](){ logasync_stop(); }));
+                M_atexit = true;
+            }
+
+            NDRX_LOG(log_info, "Async tplog started, capacity=%ld policy=%d",
+                    static_cast<long>(M_ring->mask+1), policy);
+        },
+        R"pbdoc(
+        Start asynchronous writer for Python log calls (:func:`.tplog`,
+        :func:`.tplog_debug`, etc.). Log calls put the records in the bounded
+        lock-free ring and background thread writes them to the process
+        **tp** logger file. Lines are written as
+        *t:USER:level:pid:[YYYYMMDD:HHMMSSuuuuuu:thread] message*, with the
+        original call time and thread of the log call. Calls from threads which
+        have thread or request logger set (see :func:`.tplogconfig` with
+        :data:`.LOG_FACILITY_TP_THREAD`, :func:`.tplogsetreqfile`) are
+        written directly. If writer is already running, it is restarted.
+
+        .. code-block:: python
+            :caption: tplogasync_start example
+            :name: tplogasync_start-example
+
+                import endurox as e
+                e.tplogasync_start(8192, e.TPLOGASYNC_COUNT)
+                e.tplog_info("Written by the writer thread")
+                e.tplogasync_stop()
+
+        :raise ValueError:
+            | Invalid capacity or policy.
+
+        Parameters
+        ----------
+        capacity: int
+            Number of records in the ring, rounded up to power of 2.
+        policy: int
+            Full ring policy: :data:`.TPLOGASYNC_BLOCK` - wait for free slot,
+            :data:`.TPLOGASYNC_DROP` - drop the message,
+            :data:`.TPLOGASYNC_COUNT` - drop the message and log drop count.
+         )pbdoc",
+        py::arg("capacity") = NDRXPY_LOGASYNC_DFLTCAP,
+        py::arg("policy") = NDRXPY_LOGASYNC_BLOCK);
+
+    m.def(
+        "tplogasync_stop",
+        [](void)
+        {
+            logasync_stop();
+        },
+        R"pbdoc(
+        Stop asynchronous log writer. Queued records are written before
+        return and further log calls are written directly. Writer is stopped
+        at interpreter or process exit automatically. Forked child process
+        writes log calls directly.
+         )pbdoc");
+
+    m.def(
+        "tplogasync_stats",
+        [](void)
+        {
+            py::dict ret;
+
+            ret["active"] = M_active.load();
+            ret["capacity"] = static_cast<long>(nullptr!=M_ring?M_ring->mask+1:0);
+            ret["queued"] = M_queued.load();
+            ret["written"] = M_written.load();
+            ret["dropped"] = M_dropped.load();
+            ret["blocked"] = M_blocked.load();
+
+            return ret;
+        },
+        R"pbdoc(
+        Get asynchronous log writer statistics.
+
+        Returns
+        -------
+        stats : dict
+            Dictionary with keys: **active** - writer accepts records,
+            **capacity** - ring size, **queued** - records queued,
+            **written** - records written, **dropped** - records dropped
+            due to full ring, **blocked** - number of log calls waited
+            for free slot.
+         )pbdoc");
+}
+
+/* vim: set ts=4 sw=4 et smartindent: */
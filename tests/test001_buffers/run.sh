@@ -226,6 +226,19 @@ if [ $RET != 0 ]; then
     go_out -1
 fi
 
+################################################################################
+echo "Buffer snapshot files"
+################################################################################
+
+python3 -m unittest client-bufsnap.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "client-bufsnap.py failed"
+    go_out -1
+fi
+
 ###############################################################################
 echo "Check leaks"
 ###############################################################################
@@ -0,0 +1,69 @@
+import unittest
+import os
+import endurox as e
+import exutils as u
+
+class TestBufSnap(unittest.TestCase):
+
+    SNAP="/tmp/test001_bufsnap.snap"
+
+    def setUp(self):
+        if os.path.exists(self.SNAP):
+            os.remove(self.SNAP)
+
+    def tearDown(self):
+        if os.path.exists(self.SNAP):
+            os.remove(self.SNAP)
+
+    # write & replay records of all buffer types
+    def test_bufsnap_replay(self):
+        bufs = [{"data":{"T_STRING_FLD":"HELLO", "T_LONG_FLD":[1, 2], "T_UBF_FLD":{"T_SHORT_FLD":5}}},
+                {"data":"HELLO STRING"},
+                {"data":b'\x00\x01\x02'},
+                {"buftype":"JSON", "data":'{"a":1}'},
+                {"buftype":"VIEW", "subtype":"UBTESTVIEW2", "data":{"tshort1":5, "tstring1":"HELLO VIEW"}},
+                {}]
+
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            with e.BufSnapWriter(self.SNAP) as wr:
+                for b in bufs:
+                    wr.write(b)
+                wr.write(e.AtmiBuf(bufs[0]))
+                self.assertEqual(wr.records, len(bufs)+1)
+
+            with e.BufSnapReader(self.SNAP) as r:
+                self.assertEqual(len(r), len(bufs)+1)
+                i = 0
+                for b in r:
+                    tperrno, tpurcode, retbuf = e.tpcall("ECHO", b)
+                    self.assertEqual(tperrno, 0)
+                    self.assertEqual(b.todict(), retbuf)
+                    i+=1
+                self.assertEqual(i, len(bufs)+1)
+
+                self.assertEqual(r[0].get("T_UBF_FLD")["T_SHORT_FLD"], [5])
+                self.assertEqual(r[-1].get("T_LONG_FLD", 1), 2)
+                self.assertEqual(r[1].todict()["data"], "HELLO STRING")
+                self.assertEqual(r[2].todict()["data"], b'\x00\x01\x02')
+                self.assertEqual(r[4].todict()["data"]["tstring1"], ["HELLO VIEW"])
+                self.assertEqual(r[5].buftype, "NULL")
+
+                r.seek(6)
+                self.assertEqual(r.tell(), 6)
+                self.assertEqual(next(r).get("T_STRING_FLD"), "HELLO")
+                with self.assertRaises(StopIteration):
+                    next(r)
+                with self.assertRaises(IndexError):
+                    r[7]
+
+            os.remove(self.SNAP)
+
+    # pointers cannot be persisted
+    def test_bufsnap_ptr(self):
+        with e.BufSnapWriter(self.SNAP) as wr:
+            with self.assertRaises(ValueError):
+                wr.write({"data":{"T_PTR_FLD":{"data":"HELLO"}}})
+
+if __name__ == '__main__':
+    unittest.main()
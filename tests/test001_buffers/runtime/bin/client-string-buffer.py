@@ -16,6 +16,56 @@ class TestNull(unittest.TestCase):
             self.assertEqual(tpurcode, 0)
             self.assertEqual(retbuf["buftype"], "STRING")
             self.assertEqual(retbuf["data"], "THIS IS STRING BUFFERT TEST")
-    
+
+    #
+    # Non-ascii strings in both encoding modes
+    #
+    def test_string_enc(self):
+        w = u.NdrxStopwatch()
+        try:
+            while w.get_delta_sec() < u.test_duratation():
+                for enc in ["utf-8", "locale"]:
+                    e.set_strenc(enc)
+                    self.assertEqual(e.get_strenc(), enc)
+                    tperrno, tpurcode, retbuf = e.tpcall("ECHO", {"data":"Sveiki āš"})
+                    self.assertEqual(tperrno, 0)
+                    self.assertEqual(retbuf["data"], "Sveiki āš")
+                    tperrno, tpurcode, retbuf = e.tpcall("ECHO", {"data":{"T_STRING_FLD":["ABC", "āš"]}})
+                    self.assertEqual(tperrno, 0)
+                    self.assertEqual(retbuf["data"]["T_STRING_FLD"], ["ABC", "āš"])
+
+                with self.assertRaises(ValueError):
+                    e.tpcall("ECHO", {"data":{"T_STRING_FLD":"A\x00B"}})
+        finally:
+            e.set_strenc("utf-8")
+
+        with self.assertRaises(ValueError):
+            e.set_strenc("latin1")
+
+    #
+    # String fields passed through as bytes
+    #
+    def test_string_bytes(self):
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            tperrno, tpurcode, retbuf = e.tpcall("ECHO", {"data":"Sveiki āš"}, strenc="bytes")
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["buftype"], "STRING")
+            self.assertEqual(retbuf["data"], "Sveiki āš".encode("utf-8"))
+
+            # send back as is
+            tperrno, tpurcode, retbuf = e.tpcall("ECHO", retbuf)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"], "Sveiki āš")
+
+            tperrno, tpurcode, retbuf = e.tpcall("ECHO", {"data":{"T_STRING_FLD":"āš", "T_LONG_FLD":1}}, strenc="bytes")
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_STRING_FLD"], ["āš".encode("utf-8")])
+            self.assertEqual(retbuf["data"]["T_LONG_FLD"], [1])
+
+            tperrno, tpurcode, retbuf = e.tpcall("ECHO", retbuf)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_STRING_FLD"], ["āš"])
+
 if __name__ == '__main__':
     unittest.main()
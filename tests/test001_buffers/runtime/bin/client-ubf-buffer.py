@@ -67,6 +67,40 @@ class TestUbf(unittest.TestCase):
             self.assertEqual(retbuf["data"]["T_PTR_2_FLD"][2]["subtype"], "UBTESTVIEW2")
             # PTR in PTR
             self.assertEqual(retbuf["data"]["T_PTR_2_FLD"][3]["data"]["T_PTR_FLD"][0]["data"]["T_STRING_FLD"][0], "HELLO")
-    
+
+    # deep embedded UBF trees, with siblings of different sizes
+    def test_ubf_nested(self):
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            d = {"T_STRING_FLD":"LEAF" * 1000}
+            for i in range(6):
+                d = {"T_LONG_FLD":i, "T_UBF_FLD":[d, {"T_SHORT_FLD":i}], "T_STRING_2_FLD":"\u0100" * 100}
+            tperrno, tpurcode, retbuf = e.tpcall("ECHO", { "data":d })
+            self.assertEqual(tperrno, 0)
+            r = retbuf["data"]
+            for i in reversed(range(6)):
+                self.assertEqual(r["T_LONG_FLD"][0], i)
+                self.assertEqual(r["T_STRING_2_FLD"][0], "\u0100" * 100)
+                self.assertEqual(r["T_UBF_FLD"][1]["T_SHORT_FLD"][0], i)
+                r = r["T_UBF_FLD"][0]
+            self.assertEqual(r["T_STRING_FLD"][0], "LEAF" * 1000)
+
+    # buffer referenced from several PTR fields is converted once
+    def test_ubf_ptr_shared(self):
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            hdr = {"data":{"T_STRING_FLD":"HEADER"}}
+            b = e.AtmiBuf({"data":{"T_PTR_FLD":[hdr, hdr, {"data":"OTHER"}], "T_PTR_2_FLD":hdr}})
+            d = b.todict()["data"]
+            self.assertIs(d["T_PTR_FLD"][0], d["T_PTR_FLD"][1])
+            self.assertIs(d["T_PTR_FLD"][0], d["T_PTR_2_FLD"][0])
+            self.assertEqual(d["T_PTR_FLD"][0]["data"]["T_STRING_FLD"][0], "HEADER")
+            self.assertEqual(d["T_PTR_FLD"][2]["data"], "OTHER")
+
+            tperrno, tpurcode, retbuf = e.tpcall("ECHO", b)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_PTR_FLD"][1]["data"]["T_STRING_FLD"][0], "HEADER")
+            self.assertEqual(retbuf["data"]["T_PTR_2_FLD"][0]["data"]["T_STRING_FLD"][0], "HEADER")
+
 if __name__ == '__main__':
     unittest.main()
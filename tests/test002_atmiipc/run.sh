@@ -142,6 +142,19 @@ if [ $RET != 0 ]; then
     go_out -1
 fi
 
+################################################################################
+echo "Running conversational stream test"
+################################################################################
+
+python3 -m unittest convstream.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "convstream.py failed"
+    go_out -1
+fi
+
 ################################################################################
 echo "Running tpnotify test"
 ################################################################################
@@ -0,0 +1,32 @@
+import unittest
+import endurox as e
+import exutils as u
+
+class TestConvStream(unittest.TestCase):
+
+    # stream data to server and read it back in different chunk size
+    def test_convstream(self):
+        payload = bytes(range(256)) * 1000
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            cd = e.tpconnect("CONVSTREAM", {}, e.TPSENDONLY)
+
+            with e.ConvStream(cd, 4096) as conv:
+                self.assertEqual(conv.write(memoryview(payload)), len(payload))
+
+            conv = e.ConvStream(cd)
+            out = bytearray()
+            chunk = bytearray(3000)
+            while True:
+                n = conv.readinto(chunk)
+                if n == 0:
+                    break
+                out += chunk[:n]
+
+            self.assertEqual(bytes(out), payload)
+            self.assertEqual(conv.eof, True)
+            self.assertEqual(conv.revent, e.TPEV_SVCSUCC)
+            self.assertEqual(conv.tpurcode, 7)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -1,6 +1,7 @@
 import unittest
 import endurox as e
 import exutils as u
+import threading
 
 class TestTpgetctxt(unittest.TestCase):
 
@@ -63,6 +64,53 @@ class TestTpgetctxt(unittest.TestCase):
             e.tpfreectxt(t33)
 
 
+    # pooled contexts bound to threads
+    def test_ctxpool(self):
+
+        try:
+            e.TpCtxPool(0)
+        except ValueError:
+            pass
+        else:
+            self.assertEqual(True,False)
+
+        pool = e.TpCtxPool(2)
+        self.assertEqual(pool.size, 2)
+        self.assertEqual(pool.available, 2)
+        res = []
+
+        def worker():
+            for i in range(10):
+                with pool.bind():
+                    tperrno, tpurcode, retbuf = e.tpcall("OKSVC", { "data":{"T_STRING_FLD":"Hi Jim"}})
+                    res.append(tperrno)
+
+        threads = [threading.Thread(target=worker) for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        self.assertEqual(res, [0]*40)
+        self.assertEqual(pool.leases, 40)
+        self.assertEqual(pool.available, 2)
+
+        # thread context is restored after the block
+        ret, _ = e.tpgetctxt()
+        self.assertEqual(ret, e.TPNULLCONTEXT)
+
+        with pool.bind():
+            with pool.bind():
+                try:
+                    with pool.bind(0.1):
+                        pass
+                except e.AtmiException as ex:
+                    self.assertEqual(ex.code,e.TPETIME)
+                else:
+                    self.assertEqual(True,False)
+
+        pool.close()
+
 if __name__ == '__main__':
     unittest.main()
 
@@ -16,6 +16,9 @@ class Server:
         e.tpadvertise('EVSVC', 'EVSVC', self.EVSVC)
         e.tpadvertise('EVSVC2', 'EVSVC2', self.EVSVC)
         e.tpadvertise('CONVSVC', 'CONVSVC', self.CONVSVC)
+        e.tpadvertise('INPLACESVC', 'INPLACESVC', self.INPLACESVC)
+        e.tpadvertise('PATCHSVC', 'PATCHSVC', self.PATCHSVC)
+        e.tpadvertise('CONVSTREAM', 'CONVSTREAM', self.CONVSTREAM)
         e.tpadvertise('NOTIFSV', 'NOTIFSV', self.NOTIFSV)
         e.tpadvertise('BCASTSV', 'BCASTSV', self.BCASTSV)
         e.tpadvertise('TOUT', 'TOUT', self.TOUT)
@@ -49,6 +52,34 @@ class Server:
             args.data["data"]["T_STRING_2_FLD"]=args.data["data"]["T_STRING_FLD"][0]
         return e.tpreturn(e.TPSUCCESS, 5, args.data)
 
+    #
+    # return modified request buffer
+    #
+    def INPLACESVC(self, args):
+        d = args.data["data"]
+        d["T_STRING_2_FLD"]=d["T_STRING_FLD"][0]
+        d["T_LONG_FLD"]=d["T_LONG_FLD"][:1]
+        del d["T_SHORT_FLD"]
+        return e.tpreturn_inplace(e.TPSUCCESS, 5, args.data)
+
+    def PATCHSVC(self, args):
+        # handle kept from the previous call is released with that call
+        kept = getattr(self, "kept", None)
+        if kept is not None:
+            try:
+                kept.get("T_STRING_FLD")
+                assert False
+            except ValueError:
+                pass
+        b = args.buf
+        assert args.buf is b
+        self.kept = b
+        b.set("T_STRING_2_FLD", 0, b.get("T_STRING_FLD"))
+        b.delete("T_LONG_FLD", 2)
+        b.update({"T_SHORT_FLD":[7, 8]})
+        b.project(["T_STRING_FLD", "T_STRING_2_FLD", "T_LONG_FLD", "T_SHORT_FLD"])
+        return e.tpreturn(e.TPSUCCESS, b.occur("T_LONG_FLD"), b)
+
     #
     # Forwarding service
     #
@@ -91,6 +122,18 @@ class Server:
 
         return e.tpreturn(e.TPSUCCESS, 6, {"data":{"T_STRING_FLD":"From server 2"}})
 
+    #
+    # read the stream till client gives control back, then stream
+    # it back in smaller chunks
+    #
+    def CONVSTREAM(self, args):
+        data = e.ConvStream(args.cd).read()
+
+        with e.ConvStream(args.cd, 1000, 0) as conv:
+            conv.write(memoryview(data))
+
+        return e.tpreturn(e.TPSUCCESS, 7, {})
+
     # send notification to the client
     def NOTIFSV(self, args):
         e.tpnotify(args.cltid, {"data":"HELLO WORLD"}, 0)
@@ -2,6 +2,7 @@ import unittest
 import endurox as e
 import exutils as u
 import gc
+import threading
 
 class TestTpcall(unittest.TestCase):
 
@@ -14,6 +15,60 @@ class TestTpcall(unittest.TestCase):
             self.assertEqual(tpurcode, 5)
             self.assertEqual(retbuf["data"]["T_STRING_2_FLD"][0], "Hi Jim")
 
+    # service updates request buffer in place
+    def test_tpcall_inplace(self):
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            tperrno, tpurcode, retbuf = e.tpcall("INPLACESVC", { "data":{"T_STRING_FLD":"Hi Jim", 
+                "T_LONG_FLD":[1,2,3], "T_SHORT_FLD":5, "T_DOUBLE_FLD":1.5}})
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(tpurcode, 5)
+            self.assertEqual(retbuf["data"], {"T_STRING_FLD":["Hi Jim"], "T_STRING_2_FLD":["Hi Jim"],
+                "T_LONG_FLD":[1], "T_DOUBLE_FLD":[1.5]})
+
+    # reply built by patching request buffer handle
+    def test_tpcall_atmibuf(self):
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            b = e.AtmiBuf({ "data":{"T_STRING_FLD":"Hi Jim", 
+                "T_LONG_FLD":[1,2,3], "T_SHORT_FLD":5, "T_DOUBLE_FLD":1.5}})
+            self.assertEqual(b.buftype, "UBF")
+            self.assertEqual(b.occur("T_LONG_FLD"), 3)
+            self.assertTrue("T_DOUBLE_FLD" in b)
+            tperrno, tpurcode, retbuf = e.tpcall("PATCHSVC", b)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(tpurcode, 2)
+            self.assertEqual(retbuf["data"], {"T_STRING_FLD":["Hi Jim"], "T_STRING_2_FLD":["Hi Jim"],
+                "T_LONG_FLD":[1, 2], "T_SHORT_FLD":[7, 8]})
+
+            # request buffer is not changed by the call
+            self.assertEqual(b.get("T_LONG_FLD", 2), 3)
+            self.assertEqual(b.todict()["data"]["T_DOUBLE_FLD"], [1.5])
+
+            with self.assertRaises(e.UbfException) as ex:
+                b.get("T_LONG_FLD", 3)
+            self.assertEqual(ex.exception.code,e.BNOTPRES)
+
+    # reply lands in hinted buffer, check the hint statistics
+    def test_tpcall_rplyhint(self):
+        e.tprplyhintstats(True)
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            tperrno, tpurcode, retbuf = e.tpcall("OKSVC", { "data":{"T_STRING_FLD":"Hi Jim"}}, rtype="UBF", rsize=2048)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_STRING_2_FLD"][0], "Hi Jim")
+
+            # wrong type
+            tperrno, tpurcode, retbuf = e.tpcall("OKSVC", { "data":{"T_STRING_FLD":"Hi Jim"}}, rtype="STRING")
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_STRING_2_FLD"][0], "Hi Jim")
+
+        stats = e.tprplyhintstats(True)
+        self.assertEqual(stats["typemiss"] * 2, stats["calls"])
+        self.assertEqual(stats["sizemiss"], 0)
+        stats = e.tprplyhintstats()
+        self.assertEqual(stats["calls"], 0)
+
     # validate error handling
     def test_tpcall_fail(self):
         log = u.NdrxLogConfig()
@@ -47,6 +102,76 @@ class TestTpcall(unittest.TestCase):
 
         log.restore()
 
+    # client side reply cache
+    def test_tpcall_cache(self):
+
+        try:
+            e.tpcallcache_config("OKSVC", -1)
+        except ValueError:
+            pass
+        else:
+            self.assertEqual(True,False)
+
+        e.tpcallcache_config("OKSVC", 60000, 2)
+        e.tpcallcache_config("FAILSVC", 60000)
+
+        for i in range(3):
+            for name in ["Jim", "Joe"]:
+                tperrno, tpurcode, retbuf = e.tpcall("OKSVC", { "data":{"T_STRING_FLD":name}})
+                self.assertEqual(tperrno, 0)
+                self.assertEqual(tpurcode, 5)
+                self.assertEqual(retbuf["data"]["T_STRING_2_FLD"][0], name)
+            tperrno, tpurcode, retbuf = e.tpcall("FAILSVC", { "data":{"T_STRING_FLD":"Jim"}})
+            self.assertEqual(tperrno, e.TPESVCFAIL)
+
+        stats = e.tpcallcache_stats()
+        self.assertEqual(stats["OKSVC"]["hits"], 4)
+        self.assertEqual(stats["OKSVC"]["misses"], 2)
+        self.assertEqual(stats["OKSVC"]["entries"], 2)
+        # failures are not cached
+        self.assertEqual(stats["FAILSVC"]["hits"], 0)
+        self.assertEqual(stats["FAILSVC"]["entries"], 0)
+
+        # LRU limit
+        tperrno, tpurcode, retbuf = e.tpcall("OKSVC", { "data":{"T_STRING_FLD":"Ann"}})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(e.tpcallcache_stats()["OKSVC"]["evictions"], 1)
+
+        e.tpcallcache_invalidate("OKSVC")
+        self.assertEqual(e.tpcallcache_stats()["OKSVC"]["entries"], 0)
+
+        e.tpcallcache_config("OKSVC", 0)
+        e.tpcallcache_config("FAILSVC", 0)
+        self.assertEqual(e.tpcallcache_stats(), {})
+
+    # identical concurrent calls share one service call
+    def test_tpcall_flight(self):
+
+        e.tpcallflight_config("TOUT")
+        res = []
+        before = e.tpcallflight_stats()
+
+        def caller():
+            e.tpinit()
+            tperrno, tpurcode, retbuf = e.tpcall("TOUT", { "data":{"T_SHORT_FLD":1}})
+            res.append(tperrno)
+            e.tpterm()
+
+        threads = [threading.Thread(target=caller) for i in range(8)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        stats = e.tpcallflight_stats()
+        self.assertEqual(res, [0]*8)
+        self.assertEqual(stats["leaders"]+stats["followers"]-
+            before["leaders"]-before["followers"], 8)
+        self.assertGreater(stats["followers"], before["followers"])
+        self.assertEqual(stats["inflight"], 0)
+
+        e.tpcallflight_config("TOUT", False)
+
 if __name__ == '__main__':
     unittest.main()
 
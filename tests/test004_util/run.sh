@@ -154,6 +154,71 @@ if [ $RET != 0 ]; then
     go_out -1
 fi
 
+################################################################################
+echo "Running batched fdpoller test"
+################################################################################
+
+python3 -m unittest pollbatchcl.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "pollbatchcl.py failed"
+    go_out -1
+fi
+
+################################################################################
+echo "Running server timer test"
+################################################################################
+
+python3 -m unittest timercl.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "timercl.py failed"
+    go_out -1
+fi
+
+################################################################################
+echo "Running asyncio server test"
+################################################################################
+
+python3 -m unittest asynccl.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "asynccl.py failed"
+    go_out -1
+fi
+
+################################################################################
+echo "Running worker pool test"
+################################################################################
+
+python3 -m unittest poolcl.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "poolcl.py failed"
+    go_out -1
+fi
+
+################################################################################
+echo "Running content based routing test"
+################################################################################
+
+python3 -m unittest routecl.py
+
+RET=$?
+
+if [ $RET != 0 ]; then
+    echo "routecl.py failed"
+    go_out -1
+fi
+
 ################################################################################
 echo "Running tplog.py test"
 ################################################################################
@@ -0,0 +1,40 @@
+import unittest
+import endurox as e
+import time
+
+class TestAsyncio(unittest.TestCase):
+
+    # coroutine services are served concurrently
+    def test_asyncio(self):
+
+        start = time.time()
+        cds = []
+        for i in range(10):
+            cds.append(e.tpacall("ASYNCSV", {"data":{"T_LONG_FLD":i}}))
+
+        # sync service is served while coroutines wait
+        tperrno, _, retbuf = e.tpcall("SYNCSV", {"data":{"T_LONG_FLD":100}})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 100)
+
+        for i, cd in enumerate(cds):
+            tperrno, _, retbuf, _ = e.tpgetrply(cd)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], i+1)
+
+        # sequential serving would take 2 sec
+        self.assertLess(time.time()-start, 1.5)
+
+    # coroutine without reply
+    def test_asyncio_norply(self):
+
+        for svc in ["ASYNCNORPLY", "ASYNCRAISE"]:
+            try:
+                e.tpcall(svc, {})
+            except e.AtmiException as ex:
+                self.assertEqual(ex.code,e.TPESVCERR)
+            else:
+                self.assertEqual(True,False)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+import sys
+import asyncio
+import threading
+import endurox as e
+
+#
+# Test server, asyncio service handlers
+#
+class Server:
+
+    def tpsvrinit(self, args):
+        e.userlog('Server startup')
+        # loop belongs to the server main thread
+        errs = []
+        def other():
+            try:
+                e.tpext_asyncio()
+            except ValueError as ex:
+                errs.append(ex)
+        t = threading.Thread(target=other)
+        t.start()
+        t.join()
+        assert len(errs) == 1
+        loop = e.tpext_asyncio()
+        assert loop is asyncio.get_event_loop()
+        e.tpadvertise('ASYNCSV', 'ASYNCSV', self.ASYNCSV)
+        e.tpadvertise('ASYNCNORPLY', 'ASYNCNORPLY', self.ASYNCNORPLY)
+        e.tpadvertise('ASYNCRAISE', 'ASYNCRAISE', self.ASYNCRAISE)
+        e.tpadvertise('SYNCSV', 'SYNCSV', self.SYNCSV)
+        return 0
+
+    def tpsvrdone(self):
+        e.userlog('Server shutdown')
+
+    # reply after the wait, requests are served concurrently
+    async def ASYNCSV(self, args):
+        await asyncio.sleep(0.2)
+        args.data["data"]["T_LONG_FLD"] = args.data["data"]["T_LONG_FLD"][0] + 1
+        return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+    # no reply, caller gets TPESVCERR
+    async def ASYNCNORPLY(self, args):
+        await asyncio.sleep(0.01)
+
+    # exception, caller gets TPESVCERR
+    async def ASYNCRAISE(self, args):
+        await asyncio.sleep(0.01)
+        raise Exception("failed")
+
+    # ordinary service in the same server
+    def SYNCSV(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+if __name__ == '__main__':
+    e.run(Server(), sys.argv)
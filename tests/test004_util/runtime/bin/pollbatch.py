@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+import sys, os, select
+import endurox as e
+
+paths = ["/tmp/tmp_py_b1", "/tmp/tmp_py_b2"]
+fds = []
+counts = {}
+batches = 0
+
+#
+# all events of the poll cycle
+#
+def batch(events):
+    global batches
+    batches+=1
+    for fd, revents, name in events:
+        assert name in counts
+        if revents & select.POLLIN:
+            counts[name]+=len(os.read(fd, 1024))
+    return 0
+
+#
+# first time poller init...
+#
+def b4poll():
+    for i, fd in enumerate(fds):
+        e.tpext_addpollerfd(fd, select.POLLIN, paths[i], None)
+    e.tpext_delb4pollcb()
+    return 0
+
+#
+# Test batched poller events
+#
+class Server:
+
+    def tpsvrinit(self, args):
+        e.userlog('Server startup')
+        for path in paths:
+            os.remove(path) if os.path.exists(path) else None
+            os.mkfifo(path, 0O644)
+            fds.append(os.open(path, os.O_NONBLOCK | os.O_RDWR))
+            counts[path] = 0
+        e.tpext_addpollbatchcb(batch)
+        e.tpext_addb4pollcb(b4poll)
+        e.tpadvertise('POLLBATCHST', 'POLLBATCHST', self.POLLBATCHST)
+        return 0
+
+    def tpsvrdone(self):
+        for i, fd in enumerate(fds):
+            os.close(fd)
+            os.remove(paths[i]) if os.path.exists(paths[i]) else None
+        e.userlog('Server shutdown')
+
+    def POLLBATCHST(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0, {"data":{"T_LONG_FLD":[counts[p] for p in paths], 
+            "T_LONG_2_FLD":batches}})
+
+
+if __name__ == '__main__':
+    e.run(Server(), sys.argv)
@@ -0,0 +1,31 @@
+import unittest
+import endurox as e
+import exutils as u
+import os
+import time
+
+class TestPollBatch(unittest.TestCase):
+
+    def test_pollbatch_ok(self):
+        paths = ["/tmp/tmp_py_b1", "/tmp/tmp_py_b2"]
+        sent = 0
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            for path in paths:
+                outx = os.open(path, os.O_WRONLY)
+                os.write(outx, b'\x01')
+                os.close(outx)
+            sent+=1
+
+        # wait for all bytes to be delivered
+        for i in range(100):
+            tperrno, _, retbuf = e.tpcall("POLLBATCHST", {})
+            if retbuf["data"]["T_LONG_FLD"] == [sent, sent]:
+                break
+            time.sleep(0.1)
+
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"], [sent, sent])
+        self.assertGreater(retbuf["data"]["T_LONG_2_FLD"][0], 0)
+
+if __name__ == '__main__':
+    unittest.main()
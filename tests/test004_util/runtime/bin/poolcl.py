@@ -0,0 +1,46 @@
+import unittest
+import endurox as e
+import time
+
+class TestWorkerPool(unittest.TestCase):
+
+    # requests are served by the worker processes in parallel
+    def test_workerpool(self):
+
+        start = time.time()
+        cds = []
+        for i in range(8):
+            cds.append(e.tpacall("POOLSV", {"data":{"T_LONG_FLD":i}}))
+
+        for i, cd in enumerate(cds):
+            tperrno, _, retbuf, _ = e.tpgetrply(cd)
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], i+1)
+
+        # sequential serving would take 1.6 sec
+        self.assertLess(time.time()-start, 1.2)
+
+        tperrno, _, retbuf = e.tpcall("POOLPID", {})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 1)
+
+        for svc in ["POOLNORPLY", "POOLEXIT"]:
+            try:
+                e.tpcall(svc, {})
+            except e.AtmiException as ex:
+                self.assertEqual(ex.code,e.TPESVCERR)
+            else:
+                self.assertEqual(True,False)
+
+        # pool continues with the restarted worker
+        tperrno, _, retbuf = e.tpcall("POOLSV", {"data":{"T_LONG_FLD":1}})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 2)
+
+        tperrno, _, retbuf = e.tpcall("POOLSTATS", {})
+        self.assertEqual(tperrno, 0)
+        # workers, queued, done, pending, restarts
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"], [4, 12, 12, 0, 1])
+
+if __name__ == '__main__':
+    unittest.main()
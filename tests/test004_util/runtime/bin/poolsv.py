@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+
+import sys
+import os
+import time
+import endurox as e
+
+#
+# Test server, worker pool
+#
+class Server:
+
+    def tpsvrinit(self, args):
+        e.userlog('Server startup')
+        self.pid = os.getpid()
+        try:
+            e.tpext_workerpool(4)
+            assert False
+        except ValueError:
+            pass
+        e.tpext_pooladvertise('POOLSV', 'POOLSV', self.POOLSV)
+        e.tpext_pooladvertise('POOLNORPLY', 'POOLNORPLY', self.POOLNORPLY)
+        e.tpext_pooladvertise('POOLPID', 'POOLPID', self.POOLPID)
+        e.tpext_pooladvertise('POOLEXIT', 'POOLEXIT', self.POOLEXIT)
+        try:
+            e.tpext_workerpool(0)
+            assert False
+        except ValueError:
+            pass
+        e.tpext_workerpool(4, 2)
+        try:
+            e.tpext_workerpool(4)
+            assert False
+        except ValueError:
+            pass
+        try:
+            e.tpext_pooladvertise('POOLLATE', 'POOLLATE', self.POOLSV)
+            assert False
+        except ValueError:
+            pass
+        e.tpadvertise('POOLSTATS', 'POOLSTATS', self.POOLSTATS)
+        return 0
+
+    def tpsvrdone(self):
+        e.userlog('Server shutdown')
+
+    # served by worker process
+    def POOLSV(self, args):
+        time.sleep(0.2)
+        args.data["data"]["T_LONG_FLD"] = args.data["data"]["T_LONG_FLD"][0] + 1
+        return e.tpreturn(e.TPSUCCESS, 0, args.data)
+
+    # no reply, caller gets TPESVCERR
+    def POOLNORPLY(self, args):
+        pass
+
+    # 1 if served by other process
+    def POOLPID(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0,
+            {"data":{"T_LONG_FLD":int(os.getpid() != self.pid)}})
+
+    # worker exits, caller gets TPESVCERR, worker is started again
+    def POOLEXIT(self, args):
+        os._exit(1)
+
+    # served by dispatcher
+    def POOLSTATS(self, args):
+        stats = e.tpext_workerpoolstats()
+        retbuf = {"data":{"T_LONG_FLD":[stats["workers"], stats["queued"], 
+            stats["done"], stats["pending"], stats["restarts"]]}}
+        return e.tpreturn(e.TPSUCCESS, 0, retbuf)
+
+if __name__ == '__main__':
+    e.run(Server(), sys.argv)
@@ -0,0 +1,40 @@
+import unittest
+import endurox as e
+
+class TestRoute(unittest.TestCase):
+
+    # requests are routed by the rules
+    def test_route(self):
+
+        tperrno, _, retbuf = e.tpcall("ROUTESV", {"data":{"T_STRING_FLD":"OPEN"}})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 1)
+
+        tperrno, _, retbuf = e.tpcall("ROUTESV", {"data":{"T_STRING_FLD":"CLOSE", "T_LONG_FLD":1}})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 2)
+
+        tperrno, _, retbuf = e.tpcall("ROUTEDFLT", {"data":{"T_STRING_FLD":"OTHER"}})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 3)
+
+    # rules apply to the routed service only
+    def test_route_plain(self):
+
+        for svc in ["ROUTEPLAIN", "ROUTEREADV"]:
+            tperrno, _, retbuf = e.tpcall(svc, {"data":{"T_STRING_FLD":"OTHER"}})
+            self.assertEqual(tperrno, 0)
+            self.assertEqual(retbuf["data"]["T_LONG_FLD"][0], 4)
+
+    # not matched requests are rejected
+    def test_route_reject(self):
+
+        for data in [{"data":{"T_STRING_FLD":"CLOSE", "T_LONG_FLD":0}}, 
+                     {"data":{"T_STRING_FLD":"OTHER"}}, 
+                     {"data":"STRING"}]:
+            tperrno, tpurcode, _ = e.tpcall("ROUTESV", data)
+            self.assertEqual(tperrno, e.TPESVCFAIL)
+            self.assertEqual(tpurcode, 5)
+
+if __name__ == '__main__':
+    unittest.main()
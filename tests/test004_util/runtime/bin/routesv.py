@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+
+import sys
+import endurox as e
+
+#
+# Test server, content based routing
+#
+class Server:
+
+    def tpsvrinit(self, args):
+        e.userlog('Server startup')
+        try:
+            e.tpext_advertiseroute('ROUTEBAD', 'ROUTEBAD', [("T_STRING_FLD==", self.OPEN)])
+            assert False
+        except e.UbfException:
+            pass
+        e.tpext_advertiseroute('ROUTESV', 'ROUTESV',
+            [("T_STRING_FLD=='OPEN'", self.OPEN),
+             ("T_STRING_FLD=='CLOSE' && T_LONG_FLD > 0", self.CLOSE)], rcode=5)
+        e.tpext_advertiseroute('ROUTEDFLT', 'ROUTEDFLT',
+            [("T_STRING_FLD=='OPEN'", self.OPEN)], self.DFLT)
+        # other service of the same function is not routed
+        e.tpadvertise('ROUTEPLAIN', 'ROUTESV', self.PLAIN)
+        # rules are removed with the service
+        e.tpext_advertiseroute('ROUTEREADV', 'ROUTEREADV',
+            [("T_STRING_FLD=='OPEN'", self.OPEN)], rcode=5)
+        e.tpunadvertise('ROUTEREADV')
+        e.tpadvertise('ROUTEREADV', 'ROUTEREADV', self.PLAIN)
+        return 0
+
+    def tpsvrdone(self):
+        e.userlog('Server shutdown')
+
+    def OPEN(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0, {"data":{"T_LONG_FLD":1}})
+
+    def CLOSE(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0, {"data":{"T_LONG_FLD":2}})
+
+    def DFLT(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0, {"data":{"T_LONG_FLD":3}})
+
+    def PLAIN(self, args):
+        return e.tpreturn(e.TPSUCCESS, 0, {"data":{"T_LONG_FLD":4}})
+
+if __name__ == '__main__':
+    e.run(Server(), sys.argv)
@@ -0,0 +1,43 @@
+import unittest
+import endurox as e
+import time
+
+class TestTimer(unittest.TestCase):
+
+    # server timers
+    def test_timer(self):
+
+        time.sleep( 2 )
+
+        tperrno, _, retbuf = e.tpcall("TIMERSTATS", {})
+        self.assertEqual(tperrno, 0)
+        cnt = retbuf["data"]["T_LONG_FLD"]
+        # 50ms period, at least half of the ticks
+        self.assertGreater(cnt[0], 20)
+        self.assertEqual(cnt[1], 1)
+        self.assertEqual(cnt[2], 0)
+        self.assertEqual(cnt[3], 3)
+
+    # deferred work
+    def test_defer(self):
+
+        for i in range(10):
+            tperrno, _, retbuf = e.tpcall("DEFERTEST", {})
+            self.assertEqual(tperrno, 0)
+
+        tperrno, _, retbuf = e.tpcall("DEFERSTATS", {})
+        self.assertEqual(tperrno, 0)
+        # calls, batches, items, pending, failed, method batches, method items,
+        # thread calls
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"], [10, 10, 30, 0, 0, 10, 30, 0])
+
+        # other thread wakes up the poller, drained before next request
+        tperrno, _, retbuf = e.tpcall("DEFERTHREAD", {})
+        self.assertEqual(tperrno, 0)
+        time.sleep(0.5)
+        tperrno, _, retbuf = e.tpcall("DEFERSTATS", {})
+        self.assertEqual(tperrno, 0)
+        self.assertEqual(retbuf["data"]["T_LONG_FLD"][7], 1)
+
+if __name__ == '__main__':
+    unittest.main()
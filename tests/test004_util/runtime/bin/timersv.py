@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+import sys
+import threading
+import endurox as e
+
+# timer fire counters
+M_cnt = {"periodic":0, "oneshot":0, "cancelled":0, "selfdel":0}
+
+def tick(tid, ptr1):
+    M_cnt[ptr1]+=1
+    return 0
+
+# deferred work counters
+M_def = {"calls":0, "batches":0, "items":0, "mbatches":0, "mitems":0, "tcalls":0}
+
+def on_defer(a, b):
+    M_def["calls"]+=a+b
+
+def on_tdefer():
+    M_def["tcalls"]+=1
+
+def on_batch(items):
+    M_def["batches"]+=1
+    M_def["items"]+=len(items)
+
+def selfdel(tid, ptr1):
+    M_cnt["selfdel"]+=1
+    if M_cnt["selfdel"] >= 3:
+        assert e.tpext_deltimer(tid)
+    return 0
+
+#
+# Test server timers
+#
+class Server:
+
+    def tpsvrinit(self, args):
+        e.userlog('Server startup')
+        e.tpext_addtimer(50, tick, True, "periodic")
+        e.tpext_addtimer(100, tick, False, "oneshot")
+        tid = e.tpext_addtimer(100, tick, False, "cancelled")
+        assert e.tpext_deltimer(tid)
+        assert not e.tpext_deltimer(tid)
+        e.tpext_addtimer(20, selfdel, True)
+        e.tpadvertise('TIMERSTATS', 'TIMERSTATS', self.TIMERSTATS)
+        e.tpadvertise('DEFERTEST', 'DEFERTEST', self.DEFERTEST)
+        e.tpadvertise('DEFERSTATS', 'DEFERSTATS', self.DEFERSTATS)
+        e.tpadvertise('DEFERTHREAD', 'DEFERTHREAD', self.DEFERTHREAD)
+        try:
+            e.tpext_deferbudget(-1)
+            assert False
+        except ValueError:
+            pass
+        assert e.tpext_deferbudget(10) == 50
+        return 0
+
+    def tpsvrdone(self):
+        e.userlog('Server shutdown')
+
+    # batch by bound method, new method object on each access
+    def on_mbatch(self, items):
+        M_def["mbatches"]+=1
+        M_def["mitems"]+=len(items)
+
+    # get current statistics...
+    def TIMERSTATS(self, args):
+        retbuf = {"data":{"T_LONG_FLD":[M_cnt["periodic"], M_cnt["oneshot"], 
+            M_cnt["cancelled"], M_cnt["selfdel"]]}}
+        return e.tpreturn(e.TPSUCCESS, 0, retbuf)
+
+    # queue deferred work, run before next poll
+    def DEFERTEST(self, args):
+        e.tpext_defer(on_defer, 1, 0)
+        for i in range(3):
+            e.tpext_deferbatch(on_batch, i)
+            e.tpext_deferbatch(self.on_mbatch, i)
+        return e.tpreturn(e.TPSUCCESS, 0, {})
+
+    # queued by other thread while server waits in poll
+    def DEFERTHREAD(self, args):
+        threading.Timer(0.1, e.tpext_defer, args=(on_tdefer,)).start()
+        return e.tpreturn(e.TPSUCCESS, 0, {})
+
+    def DEFERSTATS(self, args):
+        st = e.tpext_deferstats()
+        retbuf = {"data":{"T_LONG_FLD":[M_def["calls"], M_def["batches"], 
+            M_def["items"], st["pending"], st["failed"],
+            M_def["mbatches"], M_def["mitems"], M_def["tcalls"]]}}
+        return e.tpreturn(e.TPSUCCESS, 0, retbuf)
+
+if __name__ == '__main__':
+    e.run(Server(), sys.argv)
@@ -18,7 +18,30 @@ class TestTpexport(unittest.TestCase):
             buf=e.tpexport({"buftype":"UBF", "data":{"T_STRING_FLD":["HELLO TEST", "HELLO 2"]}}, e.TPEX_STRING)
             buf2=e.tpimport(buf, e.TPEX_STRING)
             self.assertEqual(buf2, {"buftype":"UBF", "data":{"T_STRING_FLD":["HELLO TEST", "HELLO 2"]}})
-            
+
+            # import from buffer objects
+            buf=e.tpexport({"data":"HELLO"})
+            self.assertEqual(e.tpimport(bytearray(buf)), {"buftype":"STRING", "data":"HELLO"})
+            self.assertEqual(e.tpimport(memoryview(buf)), {"buftype":"STRING", "data":"HELLO"})
+
+    def test_tpexport_many(self):
+        w = u.NdrxStopwatch()
+        while w.get_delta_sec() < u.test_duratation():
+            org = [{"buftype":"UBF", "data":{"T_STRING_FLD":["HELLO TEST"], "T_LONG_FLD":[1, 2]}},
+                {"buftype":"STRING", "data":"HELLO"},
+                {"buftype":"CARRAY", "data":b'\x00\x01' * 1000}]
+            for flags in [0, e.TPEX_STRING]:
+                bufs=e.tpexport_many(org, flags)
+                self.assertEqual(len(bufs), 3)
+                for i in range(3):
+                    self.assertEqual(bufs[i], e.tpexport(org[i], flags))
+                self.assertEqual(e.tpimport_many(bufs, flags), org)
+
+            self.assertEqual(e.tpexport_many([]), [])
+
+            with self.assertRaises(e.AtmiException):
+                e.tpimport_many([e.tpexport(org[0]), b'{"buftype":"UBF"'])
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -48,6 +48,95 @@ class TestTplog(unittest.TestCase):
 
         e.tpterm()
 
+    # level gated formatting
+    def test_tplog_lazy(self):
+        e.tpinit()
+
+        filename = "%s/tplog_lazy" % e.tuxgetenv('NDRX_ULOG')
+        os.remove(filename) if os.path.exists(filename) else None
+        e.tplogconfig(e.LOG_FACILITY_TP, e.log_info, None, "TEST", filename)
+
+        self.assertEqual(e.log.level, e.log_info)
+        self.assertEqual(e.log.info_enabled, True)
+        self.assertEqual(e.log.error_enabled, True)
+        self.assertEqual(e.log.debug_enabled, False)
+        self.assertEqual(e.log.dump_enabled, False)
+
+        e.tplog_info("HELLO %s %d", "LAZY", 1)
+        self.assertEqual(chk_file(filename, "HELLO LAZY 1"), 1)
+
+        # no args, message is not formatted
+        e.tplog_info("HELLO 100%")
+        self.assertEqual(chk_file(filename, "HELLO 100%"), 1)
+
+        # disabled level, arguments are not formatted
+        class Fail:
+            def __str__(self):
+                raise Exception("must not format")
+        e.tplog_debug("HELLO %s", Fail())
+        e.tplog(e.log_dump, "HELLO %s", Fail())
+
+        with self.assertRaises(Exception):
+            e.tplog_info("HELLO %s", Fail())
+
+        # bytes message, as accepted before lazy formatting
+        e.tplog_info(b"HELLO BYTES")
+        self.assertEqual(chk_file(filename, "HELLO BYTES"), 1)
+        e.tplog_info(b"HELLO %s %d", b"BYTES", 2)
+        self.assertEqual(chk_file(filename, "HELLO BYTES 2"), 1)
+
+        # cache is refreshed by tplogconfig
+        e.tplogconfig(e.LOG_FACILITY_TP, -1, "tp=5", None, None)
+        self.assertEqual(e.log.level, e.log_debug)
+        self.assertEqual(e.log.debug_enabled, True)
+        e.tplog_debug("HELLO %s", "DEBUG2")
+        self.assertEqual(chk_file(filename, "HELLO DEBUG2"), 1)
+
+        e.tpterm()
+
+    # asynchronous writer
+    def test_tplog_async(self):
+        e.tpinit()
+
+        filename = "%s/tplog_async" % e.tuxgetenv('NDRX_ULOG')
+        os.remove(filename) if os.path.exists(filename) else None
+        e.tplogconfig(e.LOG_FACILITY_TP, e.log_info, None, "TEST", filename)
+
+        with self.assertRaises(ValueError):
+            e.tplogasync_start(0, e.TPLOGASYNC_BLOCK)
+
+        with self.assertRaises(ValueError):
+            e.tplogasync_start(100, 99)
+
+        e.tplogasync_start(100, e.TPLOGASYNC_BLOCK)
+        self.assertEqual(e.tplogasync_stats()["capacity"], 128)
+        for i in range(1000):
+            e.tplog_info("HELLO ASYNC %d" % i)
+        e.tplogasync_stop()
+
+        stats = e.tplogasync_stats()
+        self.assertEqual(stats["active"], False)
+        self.assertEqual(stats["queued"], 1000)
+        self.assertEqual(stats["written"], 1000)
+        self.assertEqual(stats["dropped"], 0)
+        self.assertEqual(chk_file(filename, "] HELLO ASYNC 999"), 1)
+
+        # drop policy, every call is accounted
+        e.tplogasync_start(2, e.TPLOGASYNC_COUNT)
+        for i in range(1000):
+            e.tplog_info("HELLO DROP %d" % i)
+        e.tplogasync_stop()
+
+        stats = e.tplogasync_stats()
+        self.assertEqual(stats["written"] + stats["dropped"], 1000)
+        self.assertEqual(stats["queued"], stats["written"])
+
+        # stopped, written directly
+        e.tplog_info("HELLO SYNC")
+        self.assertEqual(chk_file(filename, "HELLO SYNC"), 1)
+
+        e.tpterm()
+
     # request logging...
     def test_tplog_reqfile(self):
         e.tpinit()
@@ -82,6 +171,21 @@ class TestTplog(unittest.TestCase):
         self.assertEqual(out["buftype"], "NULL")
         e.tplogclosereqfile()
 
+        # file name in dict, returned without conversion
+        buf = {"data":{"EX_NREQLOGFILE":filename, "T_STRING_FLD":"X"}}
+        out = e.tplogsetreqfile(buf, None, None)
+        self.assertIs(out, buf)
+        self.assertEqual(e.tploggetreqfile(), filename)
+        e.tplogclosereqfile()
+
+        # native buffer handle, updated in place
+        h = e.AtmiBuf({"data":{"T_STRING_FLD":"X"}})
+        out = e.tplogsetreqfile(h, filename, None)
+        self.assertIs(out, h)
+        self.assertEqual(h.get("EX_NREQLOGFILE"), filename)
+        self.assertEqual(e.tploggetreqfile(), filename)
+        e.tplogclosereqfile()
+
 
         # set thread logger
         e.tplogconfig(e.LOG_FACILITY_TP_THREAD, e.log_info, "file=%s" % filename_th, "TEST", None)
@@ -95,6 +199,66 @@ class TestTplog(unittest.TestCase):
         # log some stuff...
         e.tpterm()
     
+    # request file cache
+    def test_tplog_reqcache(self):
+        e.tpinit()
+        filename_def = "%s/tplog_rc_def" % e.tuxgetenv('NDRX_ULOG')
+        filename1 = "%s/tplog_rc_1" % e.tuxgetenv('NDRX_ULOG')
+        filename2 = "%s/tplog_rc_2" % e.tuxgetenv('NDRX_ULOG')
+        for f in [filename_def, filename1, filename2]:
+            os.remove(f) if os.path.exists(f) else None
+
+        e.tplogconfig(e.LOG_FACILITY_TP, e.log_info, "file=%s" % filename_def, "TEST", None)
+
+        with self.assertRaises(ValueError):
+            e.tplogreqcache_config(-1)
+
+        e.tplogreqcache_config(60000)
+        st = e.tplogreqcache_stats()
+
+        e.tplogsetreqfile_direct(filename1)
+        e.tplog_error("HELLO RC1")
+        e.tplogclosereqfile()
+        self.assertEqual(e.tploggetreqfile(), "")
+        # not expired
+        self.assertEqual(e.tplogreqcache_sweep(), 0)
+
+        # same file, reused
+        e.tplogsetreqfile({"data":{"EX_NREQLOGFILE":filename1}}, None, None)
+        self.assertEqual(e.tploggetreqfile(), filename1)
+        e.tplog_error("HELLO RC2")
+        e.tplogclosereqfile()
+
+        # other file
+        e.tplogsetreqfile_direct(filename2)
+        e.tplog_error("HELLO RC3")
+        e.tplogclosereqfile()
+
+        self.assertEqual(e.tplogreqcache_sweep(True), 1)
+        self.assertEqual(e.tplogreqcache_sweep(True), 0)
+        e.tplog_error("HELLO RC4")
+
+        self.assertEqual(chk_file(filename1, "HELLO RC1"), 1)
+        self.assertEqual(chk_file(filename1, "HELLO RC2"), 1)
+        self.assertEqual(chk_file(filename2, "HELLO RC3"), 1)
+        self.assertEqual(chk_file(filename_def, "HELLO RC4"), 1)
+
+        st2 = e.tplogreqcache_stats()
+        self.assertEqual(st2["idle_ms"], 60000)
+        self.assertEqual(st2["hits"] - st["hits"], 1)
+        self.assertEqual(st2["misses"] - st["misses"], 2)
+        self.assertEqual(st2["evictions"] - st["evictions"], 1)
+
+        # disable, closed immediately
+        e.tplogreqcache_config(0)
+        e.tplogsetreqfile_direct(filename1)
+        e.tplogclosereqfile()
+        self.assertEqual(e.tplogreqcache_sweep(True), 0)
+        e.tplog_error("HELLO RC5")
+        self.assertEqual(chk_file(filename_def, "HELLO RC5"), 1)
+
+        e.tpterm()
+
     # test dump commands...
     def test_tplog_dump(self):
         e.tpinit()
@@ -112,6 +276,24 @@ class TestTplog(unittest.TestCase):
         self.assertEqual(chk_file(filename, "ff 02 04"), 1)
         self.assertEqual(chk_file(filename, "ff 02 04 05"), 0)
 
+        # buffer protocol objects
+        e.tplogdump(e.log_error, "HELLO DUMP3", memoryview(bytearray(b'\x0a\x0b\x0c'))[1:])
+        self.assertEqual(chk_file(filename, "HELLO DUMP3"), 1)
+        self.assertEqual(chk_file(filename, "0b 0c"), 1)
+
+        e.tplogdumpdiff(e.log_error, "HELLO DUMP4", bytearray(b'\xee\x01'), memoryview(b'\xee\x03'))
+        self.assertEqual(chk_file(filename, "HELLO DUMP4"), 1)
+        self.assertEqual(chk_file(filename, "ee 03"), 1)
+
+        # level disabled, data is not accessed
+        e.tplogdump(e.log_debug, "HELLO DUMP5", None)
+        e.tplogdumpdiff(e.log_debug, "HELLO DUMP6", None, None)
+        self.assertEqual(chk_file(filename, "HELLO DUMP5"), 0)
+        self.assertEqual(chk_file(filename, "HELLO DUMP6"), 0)
+
+        with self.assertRaises(TypeError):
+            e.tplogdump(e.log_error, "HELLO DUMP7", None)
+
         e.tpterm()
 
     # test fileno...
@@ -142,6 +324,15 @@ class TestTplog(unittest.TestCase):
         self.assertEqual(chk_file(filename, "T_STRING_FLD\tSTRING1"), 1)
         self.assertEqual(chk_file(filename, "T_STRING_10_FLD\tHELLO STRING"), 1)
 
+        h = e.AtmiBuf({"data":{"T_STRING_FLD":"STRING2"}})
+        e.tplogprintubf(e.log_info, "TEST_HANDLE", h)
+        self.assertEqual(chk_file(filename, "TEST_HANDLE"), 1)
+        self.assertEqual(chk_file(filename, "T_STRING_FLD\tSTRING2"), 1)
+
+        # level disabled, buffer is not converted
+        e.tplogprintubf(e.log_debug, "TEST_SKIP", {"data":{"NO_SUCH_FLD":"X"}})
+        self.assertEqual(chk_file(filename, "TEST_SKIP"), 0)
+
         e.tpterm()
 
     def test_tplogqinfo(self):